@@ -0,0 +1,236 @@
+// Tile Cache Deduplication Check
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+/*  Checks the deduplication of identical tiles in our tile cache
+    (CACHE_DEDUPLICATION). Blank tiles with identical data must share a
+    single buffer, which is counted once towards the cache size and freed
+    once the last of them has gone. Deduplication must otherwise leave the
+    cache unchanged: W-TinyLFU admission must still protect a hot set of
+    distinct tiles from scan traffic and GDSF eviction must keep the same
+    mix of large and small tiles. Run by "make check"
+*/
+
+
+#include "Cache.h"
+
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <cstdlib>
+
+using namespace std;
+
+
+/// Size of our caches in MB
+#define DEDUP_CACHE_SIZE 10
+#define GDSF_CACHE_SIZE 1
+
+/// Number and size in bytes of the identical blank tiles we insert
+#define BLANK_TILES 100
+#define BLANK_SIZE 16000
+
+/// Size of each tile of our traffic replay in bytes
+#define REPLAY_TILE_SIZE 16000
+
+/// Number of tiles in the hot set, which fills about 60% of our cache
+#define REPLAY_HOT_TILES 400
+
+/// Number of scan requests made for each hot request
+#define REPLAY_SCAN_RATIO 2
+
+/// Number of hot requests made before and after measurement starts
+#define REPLAY_WARMUP 20000
+#define REPLAY_REQUESTS 50000
+
+/// Number and size in bytes of the large and small tiles of our GDSF replay
+#define GDSF_LARGE_TILES 5
+#define GDSF_LARGE_SIZE 150000
+#define GDSF_SMALL_TILES 200
+#define GDSF_SMALL_SIZE 2000
+
+
+
+/// Create a tile
+/** @param image image path
+    @param tile tile number
+    @param size tile data length in bytes
+    @param blank whether the tile should be blank rather than have data distinct from all other tiles
+    @return tile
+*/
+static RawTile create( const string& image, int tile, unsigned int size, bool blank ){
+
+  RawTile rawtile( tile, 0, 0, 0, 256, 256, 3, 8 );
+  rawtile.filename = image;
+  rawtile.compressionType = ImageEncoding::JPEG;
+  rawtile.quality = 75;
+  rawtile.allocate( size );
+  rawtile.dataLength = size;
+  memset( rawtile.data, 0, size );
+  if( !blank ){
+    memcpy( rawtile.data, &tile, sizeof(tile) );
+    memcpy( (char*) rawtile.data + sizeof(tile), image.data(), min( (size_t) size - sizeof(tile), image.size() ) );
+  }
+  rawtile.share();
+  return rawtile;
+}
+
+
+
+/// Request a tile, inserting it into the cache on a miss as TileManager does
+/** @param cache tile cache
+    @param image image path
+    @param tile tile number
+    @param size tile data length in bytes
+    @return whether the tile was found in the cache
+*/
+static bool request( Cache& cache, const string& image, int tile, unsigned int size = REPLAY_TILE_SIZE ){
+
+  RawTile rawtile;
+  if( cache.getTile( image, 0, tile, 0, 0, ImageEncoding::JPEG, 75, rawtile ) ) return true;
+
+  // All our tiles cost the same to generate
+  cache.insert( create( image, tile, size, false ), 1000 );
+  return false;
+}
+
+
+
+/// Replay viewer traffic on a hot set mixed with one-off scan requests through a cache with admission
+/** @param deduplication whether to enable deduplication
+    @return hit ratio of requests for the hot set once the cache has warmed up
+*/
+static double replay( bool deduplication ){
+
+  Cache cache( DEDUP_CACHE_SIZE, 1, Cache::LRU, true, false, deduplication );
+
+  // Use the same pseudo-random sequence for each run
+  mt19937 generator( 2026 );
+  uniform_int_distribution<int> hot( 0, REPLAY_HOT_TILES - 1 );
+
+  int scan = 0;
+  unsigned long hits = 0;
+
+  for( int n = 0; n < REPLAY_WARMUP + REPLAY_REQUESTS; n++ ){
+    bool hit = request( cache, "hot.tif", hot( generator ) );
+    if( n >= REPLAY_WARMUP && hit ) hits++;
+    for( int i = 0; i < REPLAY_SCAN_RATIO; i++ ) request( cache, "scan.tif", scan++ );
+  }
+
+  return (double) hits / REPLAY_REQUESTS;
+}
+
+
+
+/// Replay requests for large and small tiles through a GDSF cache too small to hold them all
+/** @param deduplication whether to enable deduplication
+    @param large number of large tiles left in the cache
+    @param small number of small tiles left in the cache
+*/
+static void gdsf( bool deduplication, int& large, int& small ){
+
+  Cache cache( GDSF_CACHE_SIZE, 1, Cache::GDSF, false, false, deduplication );
+
+  // Request the small tiles first, so that an LRU policy would evict them in favour of the large ones
+  for( int i = 0; i < GDSF_SMALL_TILES; i++ ) request( cache, "small.tif", i, GDSF_SMALL_SIZE );
+  for( int i = 0; i < GDSF_LARGE_TILES; i++ ) request( cache, "large.tif", i, GDSF_LARGE_SIZE );
+
+  large = small = 0;
+  RawTile rawtile;
+  for( int i = 0; i < GDSF_LARGE_TILES; i++ ){
+    if( cache.getTile( "large.tif", 0, i, 0, 0, ImageEncoding::JPEG, 75, rawtile ) ) large++;
+  }
+  for( int i = 0; i < GDSF_SMALL_TILES; i++ ){
+    if( cache.getTile( "small.tif", 0, i, 0, 0, ImageEncoding::JPEG, 75, rawtile ) ) small++;
+  }
+}
+
+
+
+int main(){
+
+  int status = EXIT_SUCCESS;
+
+  // Insert identical blank tiles into caches with and without deduplication
+  Cache plain( DEDUP_CACHE_SIZE );
+  Cache deduplicating( DEDUP_CACHE_SIZE, 1, Cache::LRU, false, false, true );
+  for( int i = 0; i < BLANK_TILES; i++ ){
+    plain.insert( create( "blank.tif", i, BLANK_SIZE, true ) );
+    deduplicating.insert( create( "blank.tif", i, BLANK_SIZE, true ) );
+  }
+
+  // Each tile of our deduplicating cache must share the data of the first
+  RawTile first, last;
+  deduplicating.getTile( "blank.tif", 0, 0, 0, 0, ImageEncoding::JPEG, 75, first );
+  deduplicating.getTile( "blank.tif", 0, BLANK_TILES - 1, 0, 0, ImageEncoding::JPEG, 75, last );
+
+  float plainSize = plain.getMemorySize();
+  float dedupSize = deduplicating.getMemorySize();
+
+  cout << fixed << setprecision( 3 )
+       << BLANK_TILES << " blank tiles without deduplication: " << plainSize << " MB" << endl
+       << BLANK_TILES << " blank tiles with deduplication:    " << dedupSize << " MB" << endl;
+
+  if( !first.data || first.data != last.data ){
+    cerr << "cache-dedup: identical tiles do not share a single buffer" << endl;
+    status = EXIT_FAILURE;
+  }
+
+  // Our deduplicated data should be counted once, leaving just the overhead of each entry
+  if( dedupSize * 10 > plainSize ){
+    cerr << "cache-dedup: shared tile data is counted more than once towards the cache size" << endl;
+    status = EXIT_FAILURE;
+  }
+
+  // Once every tile sharing the data has gone, so must the data
+  deduplicating.purge( "blank.tif" );
+  if( deduplicating.getMemorySize() != 0 ){
+    cerr << "cache-dedup: shared tile data is still counted after all its tiles were removed" << endl;
+    status = EXIT_FAILURE;
+  }
+
+  // Deduplication must not change the size of our admission window
+  double tinylfu = replay( false );
+  double deduplicated = replay( true );
+
+  cout << "Hot set hit ratio with admission: " << tinylfu << endl
+       << "Hot set hit ratio with admission and deduplication: " << deduplicated << endl;
+
+  if( deduplicated < 0.9 || deduplicated < tinylfu - 0.01 ){
+    cerr << "cache-dedup: admission did not protect the hot set from scan traffic with deduplication" << endl;
+    status = EXIT_FAILURE;
+  }
+
+  // GDSF should keep the same tiles whether or not deduplication is enabled
+  int large, small, dlarge, dsmall;
+  gdsf( false, large, small );
+  gdsf( true, dlarge, dsmall );
+
+  cout << "GDSF tiles kept: " << large << " large and " << small << " small" << endl
+       << "GDSF tiles kept with deduplication: " << dlarge << " large and " << dsmall << " small" << endl;
+
+  if( small != GDSF_SMALL_TILES || dlarge != large || dsmall != small ){
+    cerr << "cache-dedup: GDSF eviction does not account for the sizes of deduplicated tiles" << endl;
+    status = EXIT_FAILURE;
+  }
+
+  return status;
+}
@@ -0,0 +1,144 @@
+// Tile Cache Traffic Replay
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+/*  Replays a synthetic mix of viewer and scan traffic through our tile cache with
+    and without W-TinyLFU admission (CACHE_ADMISSION) and checks that admission
+    keeps more of the frequently viewed tiles in the cache. Viewers repeatedly
+    request tiles from a hot set that fits comfortably within the cache, while a
+    region export or crawler requests an endless stream of tiles that are never
+    seen again. The same traffic is also replayed through a cache split into
+    several shards, each of which must protect its share of the hot set.
+    Run by "make check"
+*/
+
+
+#include "Cache.h"
+
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <cstdlib>
+
+using namespace std;
+
+
+/// Size of our cache in MB
+#define REPLAY_CACHE_SIZE 10
+
+/// Number of shards of our sharded cache
+#define REPLAY_SHARDS 4
+
+/// Size of each tile in bytes
+#define REPLAY_TILE_SIZE 16000
+
+/// Number of tiles in the hot set, which fills about 60% of our cache
+#define REPLAY_HOT_TILES 400
+
+/// Number of scan requests made for each hot request
+#define REPLAY_SCAN_RATIO 2
+
+/// Number of hot requests made before and after measurement starts
+#define REPLAY_WARMUP 20000
+#define REPLAY_REQUESTS 50000
+
+
+
+/// Request a tile, inserting it into the cache on a miss as TileManager does
+/** @param cache tile cache
+    @param image image path
+    @param tile tile number
+    @return whether the tile was found in the cache
+*/
+static bool request( Cache& cache, const string& image, int tile ){
+
+  RawTile rawtile;
+  if( cache.getTile( image, 0, tile, 0, 0, ImageEncoding::JPEG, 75, rawtile ) ) return true;
+
+  rawtile = RawTile( tile, 0, 0, 0, 256, 256, 3, 8 );
+  rawtile.filename = image;
+  rawtile.compressionType = ImageEncoding::JPEG;
+  rawtile.quality = 75;
+  rawtile.allocate( REPLAY_TILE_SIZE );
+  rawtile.dataLength = REPLAY_TILE_SIZE;
+  memset( rawtile.data, tile & 0xff, REPLAY_TILE_SIZE );
+  rawtile.share();
+
+  cache.insert( rawtile );
+  return false;
+}
+
+
+
+/// Replay our traffic mix through a cache
+/** @param admission whether to enable W-TinyLFU admission
+    @param shards number of cache shards
+    @return hit ratio of requests for the hot set once the cache has warmed up
+*/
+static double replay( bool admission, unsigned int shards = 1 ){
+
+  Cache cache( REPLAY_CACHE_SIZE, shards, Cache::LRU, admission );
+
+  // Use the same pseudo-random sequence for each run
+  mt19937 generator( 2026 );
+  uniform_int_distribution<int> hot( 0, REPLAY_HOT_TILES - 1 );
+
+  int scan = 0;
+  unsigned long hits = 0;
+
+  for( int n = 0; n < REPLAY_WARMUP + REPLAY_REQUESTS; n++ ){
+    bool hit = request( cache, "hot.tif", hot( generator ) );
+    if( n >= REPLAY_WARMUP && hit ) hits++;
+    for( int i = 0; i < REPLAY_SCAN_RATIO; i++ ) request( cache, "scan.tif", scan++ );
+  }
+
+  return (double) hits / REPLAY_REQUESTS;
+}
+
+
+
+int main(){
+
+  int status = EXIT_SUCCESS;
+
+  double lru = replay( false );
+  double tinylfu = replay( true );
+  double sharded = replay( true, REPLAY_SHARDS );
+
+  cout << fixed << setprecision( 3 )
+       << "Hot set hit ratio without admission: " << lru << endl
+       << "Hot set hit ratio with admission:    " << tinylfu << endl
+       << "Hot set hit ratio with admission and " << REPLAY_SHARDS << " shards: " << sharded << endl;
+
+  // Admission should keep nearly all of our hot set in the cache, whereas scans flush it from a plain LRU cache
+  if( tinylfu <= lru || tinylfu < 0.9 ){
+    cerr << "cache-replay: admission did not protect the hot set from scan traffic" << endl;
+    status = EXIT_FAILURE;
+  }
+
+  // Our hot set should be spread evenly enough across shards for each to protect its share of it
+  if( sharded < 0.9 ){
+    cerr << "cache-replay: admission did not protect the hot set from scan traffic with " << REPLAY_SHARDS << " shards" << endl;
+    status = EXIT_FAILURE;
+  }
+
+  return status;
+}
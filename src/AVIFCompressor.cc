@@ -21,6 +21,7 @@
 
 
 #include "AVIFCompressor.h"
+#include "ThreadBudget.h"
 
 #if HAVE_STL_THREAD
 #include <thread>
@@ -149,9 +150,10 @@ unsigned int AVIFCompressor::Compress( RawTile& rawtile ){
   encoder->maxQuantizer = AVIF_QUANTIZER_WORST_QUALITY;
 #endif
 
-  // Set threading concurrency
+  // Set threading concurrency to our request's thread budget if we have one
 #if AVIF_VERSION_MAJOR >= 1 && HAVE_STL_THREAD
-  rgb.maxThreads = std::thread::hardware_concurrency();
+  rgb.maxThreads = ThreadBudget::threads();
+  if( rgb.maxThreads == 0 ) rgb.maxThreads = std::thread::hardware_concurrency();
   encoder->maxThreads = rgb.maxThreads;
 #endif
 
@@ -167,6 +169,15 @@ unsigned int AVIFCompressor::Compress( RawTile& rawtile ){
   writeExifMetadata();
 
 
+  // Encoding is expensive, so check whether our client is still there
+  if( cancelled() ){
+    avifImageDestroy( avif );
+    avif = NULL;
+    avifEncoderDestroy( encoder );
+    encoder = NULL;
+    throw request_cancelled( "AVIFCompressor :: request cancelled by client" );
+  }
+
   if( (OK=avifEncoderAddImage( encoder, avif, 1, AVIF_ADD_IMAGE_FLAG_SINGLE )) != AVIF_RESULT_OK ){
     throw string( "AVIFCompressor :: Failed to add image to encoder: " + string(avifResultToString(OK)) );
   }
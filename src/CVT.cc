@@ -173,7 +173,7 @@ void CVT::send( Session* session ){
 
 
   // Set up our TileManager object
-  TileManager tilemanager( session->tileCache, *session->image, compressor, session->logfile, session->loglevel );
+  TileManager tilemanager( session->tileCache, *session->image, compressor, session->logfile, session->loglevel, session->degradation );
 
 
   // First calculate histogram if we have asked for either binarization,
@@ -197,9 +197,7 @@ void CVT::send( Session* session ){
     }
 
     // Insert the histogram into our image cache
-    const string key = (*session->image)->getImagePath();
-    imageCacheMapType::iterator i = session->imageCache->find(key);
-    if( i != session->imageCache->end() ) (i->second).histogram = (*session->image)->histogram;
+    session->imageCache->setHistogram( (*session->image)->getImagePath(), (*session->image)->histogram );
   }
 
 
@@ -382,7 +380,8 @@ void CVT::send( Session* session ){
     string interpolation_type;
     if( session->loglevel >= 5 ) function_timer.start();
 
-    unsigned int interpolation = Environment::getInterpolation();
+    // Use the cheaper nearest neighbour interpolation if we are overloaded
+    unsigned int interpolation = (session->degradation > 0) ? 0 : Environment::getInterpolation();
     switch( interpolation ){
      case 0:
       interpolation_type = "nearest neighbour";
@@ -573,6 +572,9 @@ void CVT::send( Session* session ){
   }
 
 
+  // No point compressing anything if our client has already gone away
+  if( session->cancellation ) session->cancellation->check( "CVT" );
+
   // Initialise our output compression object
   compressor->InitCompression( complete_image, resampled_height );
 
@@ -604,6 +606,15 @@ void CVT::send( Session* session ){
 
   for( int n=0; n<strips; n++ ){
 
+    // Stop compressing if our client has gone away
+    if( session->cancellation && session->cancellation->isCancelled() ){
+      // Release our compressor's resources before abandoning the request
+      try{ compressor->Finish( output ); }
+      catch( ... ){}
+      delete[] output;
+      throw request_cancelled( "CVT :: request cancelled by client" );
+    }
+
     // Get the starting index for this strip of data
     unsigned char* input = &((unsigned char*)complete_image.data)[n*strip_height*resampled_width*channels];
 
@@ -2,7 +2,7 @@
 
 /*  IIP Image Server
 
-    Copyright (C) 2005-2022 Ruven Pillay.
+    Copyright (C) 2005-2026 Ruven Pillay.
     Based on an LRU cache by Patrick Audley <http://blackcat.ca/lifeline/query.php/tag=LRU_CACHE>
     Copyright (C) 2004 by Patrick Audley
 
@@ -80,91 +80,653 @@ namespace __gnu_cxx {
 
 
 #include <list>
+#include <vector>
+#include <map>
+#include <set>
 #include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include "RawTile.h"
+#include "TileKey.h"
+#include "FrequencySketch.h"
+#include "RawTileCodec.h"
+
+
+
+/// Interface to a second, larger tier of cache behind our in-memory Cache
+/** Encoded tiles evicted from the in-memory cache are passed to this tier and are
+    looked up there on an in-memory miss. Implementations must be thread-safe, as
+    they are called concurrently from all our worker threads.
+ */
+class SecondaryCache {
+
+ public:
+
+  virtual ~SecondaryCache() {};
+
+  /// Store a tile evicted from the in-memory cache
+  /** May be called by several threads at once and should not block for long
+   *  @param tile tile, which shares its data with the evicted cache entry
+   */
+  virtual void insert( const RawTile& tile ) = 0;
+
+  /// Look up a tile
+  /** @param key tile index
+   *  @param tile RawTile into which the tile is read
+   *  @return whether the tile was found
+   */
+  virtual bool getTile( const TileKey& key, RawTile& tile ) = 0;
+
+  /// Remove a tile that has been superseded by a newer version
+  /** @param key tile index */
+  virtual void remove( const TileKey& key ) = 0;
+
+  /// Remove all tiles of an image
+  /** @param image interned image id as held by TileKey
+   *  @return number of tiles removed
+   */
+  virtual unsigned int purge( uint32_t image ) = 0;
+
+};
 
 
 
 /// Cache to store raw tile data
+/** The cache is partitioned by a hash of the tile index into a number of shards,
+    each with its own mutex, list and index, so that several worker threads can
+    use the cache at the same time without contending for a single lock. The
+    memory used by all shards is accounted for globally, so that the cache as a
+    whole remains within its maximum size. Cached tiles hold their data in shared,
+    immutable buffers. Tiles are returned as copies that share this buffer, so no
+    data is copied on a hit, and evicting a tile only frees its data once the last
+    of these copies has been destroyed. The public interface is virtual
+    so that alternative storage backends, such as the shared memory SharedCache,
+    can be used in place of this class.
+
+    Tiles are evicted either in least recently used order or, with the CLOCK
+    policy, in an approximation of it that merely marks a tile as referenced
+    when it is used rather than moving it to the head of its list. Tiles that
+    have been referenced are given a second chance when they reach the tail.
+    The GDSF (GreedyDual-Size-Frequency) policy instead evicts the tile with the
+    lowest priority, where priority grows with the cost of regenerating a tile
+    and with the number of times it has been used, and falls with its size.
+    An inflation value, raised to the priority of each evicted tile, ages tiles
+    that are no longer used.
+
+    Optionally, new tiles can be made to earn their place in the cache using the
+    W-TinyLFU admission scheme. Each shard keeps a sketch of how often each tile
+    has recently been looked up. New tiles first enter a small LRU window. Tiles
+    leaving the window are only admitted to the main cache if they have been
+    looked up more often than the tile they would displace, so that tiles seen
+    once by a large region export or scan cannot flush frequently used tiles.
+
+    Tiles with byte-identical data, such as the blank margins of scanned documents,
+    can optionally be deduplicated. Tile data is then looked up by a hash of its
+    content and tiles with identical data share a single buffer. The data of each
+    distinct buffer is counted once towards the cache size, independently of the
+    shards of the tiles that share it.
+
+    Images can be pinned, in which case their tiles are held in a separate list in
+    each shard and are never evicted, though they still count towards the cache size.
+
+    Each shard also indexes its tiles by image, so that all the tiles of an image
+    that has been modified or is to be purged can be removed at once.
+
+    The cache also keeps track of tiles that are currently being decoded, so that
+    concurrent requests for the same missing tile can wait for and share a single
+    decode rather than each decoding the tile themselves.
+
+    RAW tiles, which are much larger than encoded tiles, can optionally be stored
+    losslessly compressed and are then decompressed on each hit. The cache size
+    accounts for their compressed size, so that many more of them can be held.
+
+    A SecondaryCache can be placed behind the cache, in which case encoded tiles
+    evicted from the cache are handed to it and it is searched on a cache miss.
+ */
 
 class Cache {
 
 
- private:
+ public:
 
-  /// Basic object storage size
-  int tileSize;
+  /// Eviction policies
+  enum Policy { LRU = 0, CLOCK = 1, GDSF = 2 };
+
+  /// Hit and miss counters
+  struct Statistics {
+    unsigned long hits;         ///< Number of lookups that found a tile
+    unsigned long misses;       ///< Number of lookups that did not
+    unsigned long hitBytes;     ///< Bytes of tile data returned by hits
+    unsigned long missBytes;    ///< Bytes of tile data inserted after misses
+    Statistics() : hits( 0 ), misses( 0 ), hitBytes( 0 ), missBytes( 0 ) {};
+    /// Return the proportion of lookups that found a tile
+    float hitRatio() const { return (hits + misses) ? (float) hits / (hits + misses) : 0.0; };
+    /// Return the proportion of tile data that was served from the cache
+    float byteHitRatio() const { return (hitBytes + missBytes) ? (float) hitBytes / (hitBytes + missBytes) : 0.0; };
+  };
 
-  /// Max memory size in bytes
-  unsigned long maxSize;
 
-  /// Current memory running total
-  unsigned long currentSize;
+ private:
+
+  /// Cache entry
+  struct Entry {
+    TileKey key;                ///< Tile index
+    RawTile tile;               ///< Cached tile
+    bool referenced;            ///< Whether the tile has been inserted or used since it was last passed over for eviction
+    unsigned long cost;         ///< Time taken to generate the tile in microseconds
+    unsigned int frequency;     ///< Number of times the tile has been used
+    double priority;            ///< GDSF priority
+    bool windowed;              ///< Whether the tile is in the admission window rather than our main list
+    uint32_t rawLength;         ///< Uncompressed data length of a compressed RAW tile or 0 if stored as is
+    uint64_t digest;            ///< Hash of the data if held in our content store, otherwise 0
+    bool pinned;                ///< Whether the tile belongs to a pinned image and is never evicted
+    Entry( const TileKey& k, const RawTile& r, unsigned long c ) :
+      key( k ), tile( r ), referenced( true ), cost( c ), frequency( 1 ), priority( 0 ), windowed( false ),
+      rawLength( 0 ), digest( 0 ), pinned( false ) { tile.share(); };
+  };
 
   /// Main cache storage typedef
 #ifdef HAVE_EXT_POOL_ALLOCATOR
-  typedef std::list < std::pair<const std::string,RawTile>,
-    __gnu_cxx::__pool_alloc< std::pair<const std::string,RawTile> > > TileList;
+  typedef std::list < Entry, __gnu_cxx::__pool_alloc< Entry > > TileList;
 #else
-  typedef std::list < std::pair<const std::string,RawTile> > TileList;
+  typedef std::list < Entry > TileList;
 #endif
 
   /// Main cache list iterator typedef
-  typedef std::list < std::pair<const std::string,RawTile> >::iterator List_Iter;
+  typedef TileList::iterator List_Iter;
 
   /// Index typedef
 #ifdef HAVE_EXT_POOL_ALLOCATOR
-  typedef HASHMAP < std::string, List_Iter,
-    __gnu_cxx::hash< const std::string >,
-    std::equal_to< const std::string >,
-    __gnu_cxx::__pool_alloc< std::pair<const std::string, List_Iter> >
+  typedef HASHMAP < TileKey, List_Iter,
+    __gnu_cxx::hash< TileKey >,
+    std::equal_to< TileKey >,
+    __gnu_cxx::__pool_alloc< std::pair<const TileKey, List_Iter> >
     > TileMap;
 #else
-  typedef HASHMAP < std::string,List_Iter > TileMap;
+  typedef HASHMAP < TileKey,List_Iter > TileMap;
 #endif
 
 
-  /// Main cache storage object
-  TileList tileList;
+  /// Tiles of an image held by a shard
+  struct ImageIndex {
+    std::set<TileKey> keys;     ///< Keys of the image's tiles
+    time_t timestamp;           ///< Newest image modification timestamp of these tiles
+    ImageIndex() : timestamp( 0 ) {};
+  };
+
+  /// A partition of our cache
+  struct Shard {
+    TileList tileList;          ///< Tiles from the most to the least recently used
+    TileList window;            ///< Admission window from the most to the least recently used
+    TileList pinned;            ///< Tiles of pinned images, which are never evicted
+    TileMap tileMap;            ///< Index into all of our lists
+    HASHMAP < uint32_t, ImageIndex > images;  ///< Our tiles indexed by image
+    unsigned long size;         ///< Memory used by this shard in bytes
+    unsigned long windowSize;   ///< Size of our admission window in bytes, including any deduplicated data
+    std::set< std::pair<double,TileKey> > queue;  ///< Tiles in our main list ordered by GDSF priority
+    double inflation;           ///< GDSF inflation value
+    FrequencySketch sketch;     ///< Recent lookup frequencies used for admission
+    std::mutex mutex;           ///< Mutex protecting this shard
+    Shard( unsigned long entries ) : size( 0 ), windowSize( 0 ), inflation( 0 ), sketch( entries ) {};
+  };
+
+  /// Basic object storage size
+  int tileSize;
+
+  /// Max memory size in bytes, which may be changed while the cache is in use
+  std::atomic<unsigned long> maxSize;
+
+  /// Current memory running total across all shards
+  std::atomic<unsigned long> currentSize;
+
+  /// Our shards
+  std::vector< std::unique_ptr<Shard> > shards;
+
+  /// Eviction policy
+  Policy policy;
+
+  /// Whether new tiles must pass our admission filter
+  bool admission;
+
+  /// Maximum size of the admission window of each shard in bytes
+  unsigned long windowMax;
+
+  /// Whether RAW tiles are stored compressed
+  bool compression;
+
+  /// Whether tiles with identical data share a single buffer
+  bool deduplication;
+
+  /// A tile data buffer shared by all cached tiles with identical data
+  struct Content {
+    std::shared_ptr<void> buffer;   ///< Shared data buffer
+    uint32_t length;            ///< Data length
+    unsigned int references;    ///< Number of cached tiles sharing this buffer
+  };
+
+  /// Content store of shared data buffers indexed by hash
+  HASHMAP < uint64_t, Content > contents;
+
+  /// Memory used by our content store in bytes, which is also included in currentSize
+  std::atomic<unsigned long> contentSize;
+
+  /// Mutex protecting our content store. May be locked while a shard is locked, but not the reverse
+  std::mutex contentMutex;
+
+  /// Counters for our hit and byte hit ratios
+  std::atomic<unsigned long> hits, misses, hitBytes, missBytes;
+
+  /// Optional second tier to which evicted tiles are passed
+  SecondaryCache* secondary;
+
+  /// Whether our lookups fall back to our second tier
+  bool secondaryLookups;
+
+  /// Interned ids of pinned images
+  std::set<uint32_t> pinnedImages;
+
+
+  /// A tile decode in progress
+  struct Flight {
+    bool done;                  ///< Whether the decode has finished
+    bool ok;                    ///< Whether the decode succeeded
+    unsigned int waiters;       ///< Number of threads waiting for the result
+    RawTile tile;               ///< Decoded tile, only published if there are waiters
+    Flight() : done( false ), ok( false ), waiters( 0 ) {};
+  };
 
-  /// Main Cache storage index object
-  TileMap tileMap;
+  /// Decodes in progress indexed by tile key
+  std::map < TileKey, std::shared_ptr<Flight> > flights;
+
+  /// Mutex protecting our in-flight decodes
+  std::mutex flightMutex;
+
+  /// Condition variable signalling the completion of a decode
+  std::condition_variable flightCondition;
+
+
+  /// Return the shard to which a key belongs
+  /** Shards are chosen from the upper half of the key's hash, as each shard's frequency
+   *  sketch indexes its first row with the lower bits, which would otherwise be biased.
+   *  The shift depends on the width of size_t, which is only 32 bits on some platforms
+   *  @param key tile index
+   */
+  unsigned int _shard( const TileKey& key ) const {
+    return ( shards.size() == 1 ) ? 0 : ( key.hash() >> ( sizeof(size_t) * 4 ) ) % shards.size();
+  }
+
+
+  /// Return the memory accounted for by an entry
+  /** Use the string::capacity function rather than length() as std::string can
+   *  allocate slightly more than necessary
+   *  @param e entry
+   */
+  unsigned long _size( const Entry& e ) const {
+    // The data of tiles in our content store is accounted for there
+    return ( e.digest ? 0 : e.tile.dataLength ) + e.tile.filename.capacity()*sizeof(char) + tileSize;
+  }
+
+
+  /// Return the size of an entry as seen by our eviction and admission policies
+  /** Unlike _size(), this includes data held in our content store, so that GDSF priorities
+   *  and our admission window are unaffected by deduplication
+   *  @param e entry
+   */
+  unsigned long _weight( const Entry& e ) const {
+    return e.tile.dataLength + e.tile.filename.capacity()*sizeof(char) + tileSize;
+  }
+
+
+  /// Find the buffer in our content store holding the same data as a tile
+  /** The store is only locked while the candidate buffer is looked up. The data is then
+   *  compared without holding any lock, so this must be called before the shard is locked
+   *  @param digest hash of the tile's data
+   *  @param tile tile
+   *  @return buffer with identical data, or an empty pointer if there is none
+   */
+  std::shared_ptr<void> _match( uint64_t digest, const RawTile& tile ) {
+    std::shared_ptr<void> buffer;
+    if( digest == 0 || !tile.data ) return buffer;
+    {
+      std::lock_guard<std::mutex> lock( contentMutex );
+      auto c = contents.find( digest );
+      if( c == contents.end() || c->second.length != tile.dataLength ) return buffer;
+      buffer = c->second.buffer;
+    }
+    // Our reference keeps the buffer alive even if it leaves the store in the meantime
+    if( buffer.get() != tile.data && memcmp( buffer.get(), tile.data, tile.dataLength ) != 0 ) buffer.reset();
+    return buffer;
+  }
+
+
+  /// Place the data of a new entry in our content store
+  /** If the buffer found by _match() for this entry is still in the store, the entry shares
+   *  it. If no buffer with this hash is stored, the entry's buffer is added to the store.
+   *  Otherwise, such as when the hash collides with that of different data, the entry is left
+   *  as is. The shard must be locked
+   *  @param e entry
+   *  @param digest hash of the entry's data
+   *  @param match buffer with identical data returned by _match()
+   */
+  void _deduplicate( Entry& e, uint64_t digest, const std::shared_ptr<void>& match ) {
+    if( digest == 0 || !e.tile.isShared() ) return;
+    std::lock_guard<std::mutex> lock( contentMutex );
+    auto c = contents.find( digest );
+    if( c == contents.end() ){
+      Content& content = contents[digest];
+      content.buffer = e.tile.shared;
+      content.length = e.tile.dataLength;
+      content.references = 1;
+      contentSize += content.length;
+      currentSize += content.length;
+    }
+    else if( match && c->second.buffer == match ){
+      e.tile.shared = c->second.buffer;
+      e.tile.data = e.tile.shared.get();
+      c->second.references++;
+    }
+    else return;
+    e.digest = digest;
+  }
+
+
+  /// Release an entry's reference to our content store
+  /** The shard must be locked
+   *  @param e entry
+   */
+  void _release( const Entry& e ) {
+    std::lock_guard<std::mutex> lock( contentMutex );
+    auto c = contents.find( e.digest );
+    if( c == contents.end() || --c->second.references > 0 ) return;
+    contentSize -= c->second.length;
+    currentSize -= c->second.length;
+    contents.erase( c );
+  }
+
+
+  /// Set the GDSF priority of an entry and queue it for eviction
+  /** The shard must be locked
+   *  @param s shard
+   *  @param e entry
+   */
+  void _prioritize( Shard& s, Entry& e ) {
+    e.priority = s.inflation + (double) e.frequency * (double) e.cost / (double) this->_weight( e );
+    s.queue.insert( std::make_pair( e.priority, e.key ) );
+  }
 
 
   /// Internal touch function
-  /** Touches a key in the Cache and makes it the most recently used
+  /** Touches a key in a shard and either makes it the most recently used, marks
+   *  it as referenced or raises its priority, depending on our policy. The shard
+   *  must be locked
+   *  @param s shard
    *  @param key to be touched
    *  @return a Map_Iter pointing to the key that was touched.
    */
-  TileMap::iterator _touch( const std::string &key ) {
-    TileMap::iterator miter = tileMap.find( key );
-    if( miter == tileMap.end() ) return miter;
+  TileMap::iterator _touch( Shard& s, const TileKey &key ) {
+    TileMap::iterator miter = s.tileMap.find( key );
+    if( miter == s.tileMap.end() ) return miter;
+    Entry& e = *(miter->second);
+    // Pinned tiles need no eviction bookkeeping
+    if( e.pinned ) return miter;
+    // Our admission window is always LRU
+    if( e.windowed ){
+      s.window.splice( s.window.begin(), s.window, miter->second );
+      e.frequency++;
+    }
+    else if( policy == CLOCK ) e.referenced = true;
+    else if( policy == GDSF ){
+      s.queue.erase( std::make_pair( e.priority, e.key ) );
+      e.frequency++;
+      this->_prioritize( s, e );
+    }
     // Move the found node to the head of the list.
-    tileList.splice( tileList.begin(), tileList, miter->second );
+    else s.tileList.splice( s.tileList.begin(), s.tileList, miter->second );
     return miter;
   }
 
 
   /// Interal remove function
-  /**
+  /** The shard must be locked
+   *  @param s shard
    *  @param miter Map_Iter that points to the key to remove
    *  @warning miter is no longer usable after being passed to this function.
    */
-  void _remove( const TileMap::iterator &miter ) {
-    // Reduce our current size counter
-    currentSize -= ( (miter->second->second).dataLength +
-		     ( (miter->second->second).filename.capacity() + (miter->second->first).capacity() )*sizeof(char) +
-		     tileSize );
-    tileList.erase( miter->second );
-    tileMap.erase( miter );
+  void _remove( Shard& s, const TileMap::iterator &miter ) {
+    // Reduce our current size counters
+    Entry& e = *(miter->second);
+    unsigned long size = this->_size( e );
+    s.size -= size;
+    currentSize -= size;
+    if( e.digest ) this->_release( e );
+    if( e.pinned ) s.pinned.erase( miter->second );
+    else if( e.windowed ){
+      s.windowSize -= this->_weight( e );
+      s.window.erase( miter->second );
+    }
+    else{
+      if( policy == GDSF ) s.queue.erase( std::make_pair( e.priority, e.key ) );
+      s.tileList.erase( miter->second );
+    }
+    // Remove from our image index, which purge() may already have done
+    auto i = s.images.find( miter->first.image );
+    if( i != s.images.end() ){
+      i->second.keys.erase( miter->first );
+      if( i->second.keys.empty() ) s.images.erase( i );
+    }
+    s.tileMap.erase( miter );
   }
 
 
-  /// Interal remove function
-  /** @param key to remove */
-  void _remove( const std::string &key ) {
-    TileMap::iterator miter = tileMap.find( key );
-    this->_remove( miter );
+  /// Return the tile of our main list that would be evicted next
+  /** With the CLOCK policy, this passes over and clears the mark of any referenced
+   *  tiles. The shard must be locked
+   *  @param s shard
+   *  @return iterator to the tile or the end of our main list if it is empty
+   */
+  List_Iter _victim( Shard& s ) {
+    if( policy == GDSF ){
+      if( s.queue.empty() ) return s.tileList.end();
+      return s.tileMap.find( s.queue.begin()->second )->second;
+    }
+    while( !s.tileList.empty() ){
+      List_Iter liter = --s.tileList.end();
+      if( policy == CLOCK && liter->referenced ){
+	liter->referenced = false;
+	s.tileList.splice( s.tileList.begin(), s.tileList, liter );
+	continue;
+      }
+      return liter;
+    }
+    return s.tileList.end();
+  }
+
+
+  /// Move a tile from our admission window into our main list
+  /** The shard must be locked
+   *  @param s shard
+   *  @param liter tile
+   */
+  void _promote( Shard& s, List_Iter liter ) {
+    s.windowSize -= this->_weight( *liter );
+    liter->windowed = false;
+    s.tileList.splice( s.tileList.begin(), s.window, liter );
+    if( policy == GDSF ) this->_prioritize( s, *liter );
+  }
+
+
+  /// Keep an evicted tile for our second tier
+  /** Only encoded tiles are worth the disk space and I/O. The shard must be locked
+   *  @param e entry about to be evicted
+   *  @param spill tiles to be passed to our second tier once the shard is unlocked
+   */
+  void _spill( const Entry& e, std::vector<RawTile>& spill ) const {
+    if( secondary && e.tile.compressionType != ImageEncoding::RAW ) spill.push_back( e.tile );
+  }
+
+
+  /// Pass evicted tiles to our second tier
+  /** Must be called without any shard locked
+   *  @param spill tiles
+   */
+  void _flush( std::vector<RawTile>& spill ) {
+    for( unsigned int i=0; i<spill.size(); i++ ) secondary->insert( spill[i] );
+    spill.clear();
+  }
+
+
+  /// Move tiles out of an over-full admission window
+  /** Each tile leaving the window is admitted to our main list if there is room
+   *  or if it has been looked up more often than the tile it would displace.
+   *  Otherwise it is evicted. The shard must be locked
+   *  @param s shard
+   *  @param spill evicted tiles to be passed to our second tier
+   */
+  void _admit( Shard& s, std::vector<RawTile>& spill ) {
+    while( s.windowSize > windowMax && s.window.size() > 1 ){
+      List_Iter candidate = --s.window.end();
+      if( currentSize <= maxSize ){
+	this->_promote( s, candidate );
+	continue;
+      }
+      List_Iter victim = this->_victim( s );
+      if( victim == s.tileList.end() ||
+	  s.sketch.frequency( candidate->key.hash() ) > s.sketch.frequency( victim->key.hash() ) ){
+	if( victim != s.tileList.end() ){
+	  if( policy == GDSF ) s.inflation = victim->priority;
+	  this->_spill( *victim, spill );
+	  this->_remove( s, s.tileMap.find( victim->key ) );
+	}
+	this->_promote( s, candidate );
+      }
+      else{
+	this->_spill( *candidate, spill );
+	this->_remove( s, s.tileMap.find( candidate->key ) );
+      }
+    }
+  }
+
+
+  /// Internal eviction function
+  /** Removes the least recently used tile of a shard, skipping over and clearing
+   *  the mark of any referenced tiles with the CLOCK policy, or the tile with the
+   *  lowest priority with the GDSF policy. The shard must be locked
+   *  @param s shard
+   *  @param spill evicted tiles to be passed to our second tier
+   *  @return false if the shard is empty
+   */
+  bool _evict( Shard& s, std::vector<RawTile>& spill ) {
+    List_Iter liter = this->_victim( s );
+    if( liter != s.tileList.end() ){
+      if( policy == GDSF ) s.inflation = liter->priority;
+    }
+    // Only evict from our admission window once our main list is empty
+    else if( !s.window.empty() ) liter = --s.window.end();
+    else return false;
+    this->_spill( *liter, spill );
+    this->_remove( s, s.tileMap.find( liter->key ) );
+    return true;
+  }
+
+
+  /// Evict tiles until we are within our maximum size
+  /** Tiles are only evicted from shards holding more than their equal share of
+   *  the cache, so that the shards remain balanced. Shards are locked one at a time
+   *  @param first shard from which to start evicting
+   */
+  void _reclaim( unsigned int first ) {
+    unsigned int n = shards.size();
+    // Data in our content store is not part of the size of any shard
+    unsigned long content = contentSize, max = maxSize;
+    unsigned long share = ( content < max ) ? ( max - content ) / n : 0;
+    std::vector<RawTile> spill;
+    for( unsigned int i=0; i<n && currentSize > maxSize; i++ ){
+      Shard& s = *shards[ (first+i) % n ];
+      std::lock_guard<std::mutex> lock( s.mutex );
+      while( currentSize > maxSize && s.size > share && this->_evict( s, spill ) );
+    }
+    if( !spill.empty() ) this->_flush( spill );
+  }
+
+
+  /// Internal insert function
+  /** @param key tile index
+   *  @param r tile to be inserted
+   *  @param cost time taken to generate the tile in microseconds
+   */
+  void _insert( const TileKey& key, const RawTile& r, unsigned long cost ) {
+
+    // Compress RAW tiles before taking our lock
+    RawTile packed;
+    bool compressed = compression && r.compressionType == ImageEncoding::RAW && RawTileCodec::compress( r, packed );
+
+    // Hash the data to be stored and find any identical data already cached before taking our lock
+    uint64_t digest = 0;
+    std::shared_ptr<void> match;
+    if( deduplication ){
+      digest = compressed ? packed.digest() : r.digest();
+      match = this->_match( digest, compressed ? packed : r );
+    }
+
+    unsigned int index = this->_shard( key );
+    Shard& s = *shards[index];
+    std::vector<RawTile> spill;
+
+    {
+      std::lock_guard<std::mutex> lock( s.mutex );
+
+      // Touch the key, if it exists
+      TileMap::iterator miter = this->_touch( s, key );
+
+      // Check whether this tile exists in our cache
+      if( miter != s.tileMap.end() ){
+	// Check the timestamp and delete if necessary
+	if( miter->second->tile.timestamp < r.timestamp ){
+	  this->_remove( s, miter );
+	  if( secondary ) secondary->remove( key );
+	}
+	// If this index already exists and it is up to date, do nothing
+	else return;
+      }
+
+      // Store the key if it doesn't already exist in our cache
+      // Ok, do the actual insert at the head of the list
+      // Tiles of unknown cost are treated as being as cheap as possible. With
+      // admission enabled, new tiles first enter our admission window
+      bool pin = !pinnedImages.empty() && pinnedImages.count( key.image );
+      TileList& list = pin ? s.pinned : ( admission ? s.window : s.tileList );
+      list.push_front( Entry( key, compressed ? packed : r, (cost > 0) ? cost : 1 ) );
+
+      // And store this in our map
+      List_Iter liter = list.begin();
+      s.tileMap[ key ] = liter;
+      ImageIndex& image = s.images[ key.image ];
+      image.keys.insert( key );
+      if( r.timestamp > image.timestamp ) image.timestamp = r.timestamp;
+      if( compressed ) liter->rawLength = r.dataLength;
+      if( deduplication ) this->_deduplicate( *liter, digest, match );
+
+      // Update our size counters
+      unsigned long size = this->_size( *liter );
+      s.size += size;
+      currentSize += size;
+
+      if( pin ) liter->pinned = true;
+      else if( admission ){
+	liter->windowed = true;
+	s.windowSize += this->_weight( *liter );
+	this->_admit( s, spill );
+      }
+      else if( policy == GDSF ) this->_prioritize( s, *liter );
+    }
+
+    if( !spill.empty() ) this->_flush( spill );
+
+    // Check to see if we need to remove elements due to exceeding max_size
+    if( currentSize > maxSize ) this->_reclaim( index );
   }
 
 
@@ -172,81 +734,159 @@ class Cache {
  public:
 
   /// Constructor
-  /** @param max Maximum cache size in MB */
-  Cache( const float max ) {
-    maxSize = (unsigned long)(max*1024000) ; currentSize = 0;
-    // 64 chars added at the end represents an average string length
-    tileSize = sizeof( RawTile ) + sizeof( std::pair<const std::string,RawTile> ) +
-      sizeof( std::pair<const std::string, List_Iter> ) + sizeof(char)*64 + sizeof(List_Iter);
+  /** @param max Maximum cache size in MB
+      @param n number of shards
+      @param p eviction policy
+      @param a whether to filter new tiles with W-TinyLFU admission
+      @param z whether to store RAW tiles compressed, if supported by this build
+      @param d whether tiles with identical data should share a single buffer
+   */
+  Cache( const float max, unsigned int n = 1, Policy p = LRU, bool a = false, bool z = false, bool d = false ) :
+    currentSize( 0 ), policy( p ), admission( a ), compression( z && RawTileCodec::available() ),
+    deduplication( d ), contentSize( 0 ), hits( 0 ), misses( 0 ), hitBytes( 0 ), missBytes( 0 ), secondary( NULL ), secondaryLookups( true ) {
+    maxSize = (unsigned long)(max*1024000);
+    if( n == 0 ) n = 1;
+    // Our admission window holds 1% of each shard and our sketches are sized for
+    // the number of tiles a shard may hold, assuming an average tile size of 16KB
+    windowMax = maxSize / n / 100;
+    unsigned long entries = admission ? maxSize / n / 16384 : 0;
+    for( unsigned int i=0; i<n; i++ ) shards.push_back( std::unique_ptr<Shard>( new Shard( entries ) ) );
+    tileSize = sizeof( Entry ) + sizeof( std::pair<const TileKey, List_Iter> ) + sizeof(List_Iter);
   };
 
 
   /// Destructor
-  ~Cache() {
+  virtual ~Cache() {
     clear();
   }
 
 
   /// Empty the cache
-  void clear() {
-    tileList.clear();
-    tileMap.clear();
-    currentSize = 0;
+  virtual void clear() {
+    for( unsigned int i=0; i<shards.size(); i++ ){
+      Shard& s = *shards[i];
+      std::lock_guard<std::mutex> lock( s.mutex );
+      s.tileList.clear();
+      s.window.clear();
+      s.pinned.clear();
+      s.tileMap.clear();
+      s.images.clear();
+      s.queue.clear();
+      s.inflation = 0;
+      s.sketch.clear();
+      currentSize -= s.size;
+      s.size = 0;
+      s.windowSize = 0;
+    }
+    std::lock_guard<std::mutex> lock( contentMutex );
+    contents.clear();
+    currentSize -= contentSize;
+    contentSize = 0;
   }
 
 
   /// Insert a tile
-  /** @param r Tile to be inserted */
-  void insert( const RawTile& r ) {
+  /** @param r Tile to be inserted
+   *  @param cost time taken to generate the tile in microseconds, used by the GDSF policy
+   */
+  virtual void insert( const RawTile& r, unsigned long cost = 0 ) {
 
     if( maxSize == 0 ) return;
 
-    std::string key = this->getIndex( r.filename, r.resolution, r.tileNum,
-				      r.hSequence, r.vSequence, r.compressionType, r.quality );
+    TileKey key = this->getIndex( r.filename, r.resolution, r.tileNum,
+				  r.hSequence, r.vSequence, r.compressionType, r.quality );
+
+    missBytes += r.dataLength;
+    this->_insert( key, r, cost );
+  }
 
-    // Touch the key, if it exists
-    TileMap::iterator miter = this->_touch( key );
 
-    // Check whether this tile exists in our cache
-    if( miter != tileMap.end() ){
-      // Check the timestamp and delete if necessary
-      if( miter->second->second.timestamp < r.timestamp ){
-	this->_remove( miter );
+  /// Remove all tiles of an image at every resolution, encoding and quality
+  /** Used when an image has been modified and to purge images on request. Tiles are
+   *  also removed from our second tier
+   *  @param f image path
+   *  @return number of tiles removed from this cache
+   */
+  virtual unsigned int purge( const std::string& f ) {
+    uint32_t image = TileKey::lookup( f );
+    if( image == 0 ) return 0;
+
+    unsigned int n = 0;
+    for( unsigned int i=0; i<shards.size(); i++ ){
+      Shard& s = *shards[i];
+      std::lock_guard<std::mutex> lock( s.mutex );
+      auto images = s.images.find( image );
+      if( images == s.images.end() ) continue;
+      std::set<TileKey> keys;
+      keys.swap( images->second.keys );
+      s.images.erase( images );
+      for( std::set<TileKey>::const_iterator k = keys.begin(); k != keys.end(); ++k ){
+	this->_remove( s, s.tileMap.find( *k ) );
+	n++;
       }
-      // If this index already exists and it is up to date, do nothing
-      else return;
     }
 
-    // Store the key if it doesn't already exist in our cache
-    // Ok, do the actual insert at the head of the list
-    tileList.push_front( std::make_pair(key,r) );
-
-    // And store this in our map
-    List_Iter liter = tileList.begin();
-    tileMap[ key ] = liter;
-
-    // Update our total current size variable. Use the string::capacity function
-    // rather than length() as std::string can allocate slightly more than necessary
-    // The +1 is for the terminating null byte
-    currentSize += (r.dataLength + (r.filename.capacity()+key.capacity())*sizeof(char) + tileSize);
-
-    // Check to see if we need to remove an element due to exceeding max_size
-    while( currentSize > maxSize ) {
-      // Remove the last element
-      liter = tileList.end();
-      --liter;
-      this->_remove( liter->first );
+    if( secondary ) secondary->purge( image );
+    return n;
+  }
+
+
+  /// Remove all tiles of an image if they belong to a different version of it
+  /** Compares the timestamp of a newly opened image with that recorded for its tiles in
+   *  our image index, so that stale tiles are purged even when the image's metadata is no
+   *  longer cached. Tiles are also removed from our second tier
+   *  @param f image path
+   *  @param timestamp modification timestamp of the image
+   *  @return number of tiles removed from this cache
+   */
+  virtual unsigned int expire( const std::string& f, time_t timestamp ) {
+    uint32_t image = TileKey::lookup( f );
+    if( image == 0 ) return 0;
+
+    bool stale = false;
+    for( unsigned int i=0; i<shards.size() && !stale; i++ ){
+      Shard& s = *shards[i];
+      std::lock_guard<std::mutex> lock( s.mutex );
+      auto images = s.images.find( image );
+      if( images != s.images.end() && images->second.timestamp != timestamp ) stale = true;
     }
 
+    return stale ? this->purge( f ) : 0;
   }
 
 
   /// Return the number of tiles in the cache
-  unsigned int getNumElements() const { return tileList.size(); }
+  virtual unsigned int getNumElements() const {
+    unsigned int n = 0;
+    for( unsigned int i=0; i<shards.size(); i++ ){
+      std::lock_guard<std::mutex> lock( shards[i]->mutex );
+      n += shards[i]->tileList.size() + shards[i]->window.size() + shards[i]->pinned.size();
+    }
+    return n;
+  }
 
 
   /// Return the number of MB stored
-  float getMemorySize() const { return (float) ( currentSize / 1024000.0 ); }
+  virtual float getMemorySize() const {
+    return (float) ( currentSize / 1024000.0 );
+  }
+
+
+  /// Return the maximum size of the cache in MB
+  virtual float getMaxSize() const {
+    return (float) ( maxSize / 1024000.0 );
+  }
+
+
+  /// Change the maximum size of the cache while it is in use
+  /** Tiles are evicted immediately if the cache is now too large. Used to shrink
+   *  the cache when memory is short and to grow it again afterwards
+   *  @param max new maximum cache size in MB
+   */
+  virtual void resize( const float max ) {
+    maxSize = (unsigned long)(max*1024000);
+    if( currentSize > maxSize ) this->_reclaim( 0 );
+  }
 
 
   /// Get a tile from the cache
@@ -258,19 +898,195 @@ class Cache {
    *  @param v vertical sequence number
    *  @param c compression type
    *  @param q compression quality
-   *  @return pointer to data or NULL on error
+   *  @param tile RawTile set to a copy of the cached tile, which shares its data with the cache
+   *         unless the tile was stored compressed
+   *  @return whether the tile was found in the cache
+   */
+  virtual bool getTile( const std::string& f, int r, int t, int h, int v, ImageEncoding c, int q, RawTile& tile ) {
+
+    if( maxSize == 0 ) return false;
+
+    TileKey key = this->getIndex( f, r, t, h, v, c, q );
+    bool found = false;
+    uint32_t rawLength = 0;
+
+    {
+      Shard& s = *shards[ this->_shard( key ) ];
+      std::lock_guard<std::mutex> lock( s.mutex );
+
+      if( admission ) s.sketch.increment( key.hash() );
+
+      TileMap::iterator miter = this->_touch( s, key );
+      if( miter != s.tileMap.end() ){
+	// Share the cached data while we still hold the lock
+	tile = miter->second->tile;
+	rawLength = miter->second->rawLength;
+	found = true;
+      }
+    }
+
+    // Decompress outside our lock into a private copy for the caller
+    if( found && rawLength > 0 ){
+      RawTile packed = std::move( tile );
+      found = RawTileCodec::decompress( packed, rawLength, tile );
+    }
+
+    // On a miss, fall back to our second tier and return any tile found there to memory
+    if( !found && secondary && secondaryLookups && secondary->getTile( key, tile ) ){
+      tile.share();
+      this->_insert( key, tile, 0 );
+      found = true;
+    }
+
+    if( !found ){
+      misses++;
+      return false;
+    }
+
+    hits++;
+    hitBytes += tile.dataLength;
+    return true;
+  }
+
+
+  /// Pin an image so that its tiles are never evicted
+  /** This must be called before the cache is used
+   *  @param f image path
    */
-  RawTile* getTile( const std::string& f, int r, int t, int h, int v, ImageEncoding c, int q ) {
+  virtual void pin( const std::string& f ) {
+    pinnedImages.insert( TileKey::intern( f, true ) );
+  }
 
-    if( maxSize == 0 ) return NULL;
 
-    std::string key = this->getIndex( f, r, t, h, v, c, q );
+  /// Place a second tier behind this cache
+  /** @param s second tier or NULL to remove it. This must be set before the cache is used
+   *  @param lookup whether our lookups fall back to the second tier. If not, evicted tiles
+   *         are still passed to it, but it is up to a containing cache to look tiles up there
+   */
+  virtual void setSecondary( SecondaryCache* s, bool lookup = true ) {
+    secondary = s;
+    secondaryLookups = lookup;
+  }
 
-    TileMap::iterator miter = tileMap.find( key );
-    if( miter == tileMap.end() ) return NULL;
-    this->_touch( key );
 
-    return &(miter->second->second);
+  /// Insert a tile found in a second tier by a containing cache
+  /** Unlike insert(), this is not counted as a miss
+   *  @param tile tile, which is shared with this cache
+   */
+  void promote( RawTile& tile ) {
+    if( maxSize == 0 ) return;
+    TileKey key = this->getIndex( tile.filename, tile.resolution, tile.tileNum,
+				  tile.hSequence, tile.vSequence, tile.compressionType, tile.quality );
+    tile.share();
+    this->_insert( key, tile, 0 );
+  }
+
+
+  /// Return our hit and miss counters
+  /** Every call to getTile() counts as a lookup, including those served by our second tier */
+  virtual Statistics getStatistics() const {
+    Statistics stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.hitBytes = hitBytes;
+    stats.missBytes = missBytes;
+    return stats;
+  }
+
+
+  /// Visit every tile in the cache from the least to the most recently used
+  /** Used to save snapshots of our cache once our workers have stopped. The shards are
+   *  visited in an interleaved order, which approximates the overall order of use
+   *  @param f function called with each tile
+   *  @return false if the cache could not be visited
+   */
+  virtual bool visit( const std::function<void(const RawTile&)>& f ) {
+    // Lock all our shards in a fixed order
+    std::vector< std::unique_lock<std::mutex> > locks;
+    for( unsigned int n=0; n<shards.size(); n++ ) locks.push_back( std::unique_lock<std::mutex>( shards[n]->mutex ) );
+
+    // Our pinned tiles, our main lists and then our more recently inserted admission windows
+    for( int w=0; w<3; w++ ){
+      std::vector<TileList*> lists;
+      std::vector<TileList::reverse_iterator> iters;
+      for( unsigned int n=0; n<shards.size(); n++ ){
+	lists.push_back( (w == 0) ? &shards[n]->pinned : (w == 1) ? &shards[n]->tileList : &shards[n]->window );
+	iters.push_back( lists[n]->rbegin() );
+      }
+
+      bool more = true;
+      while( more ){
+	more = false;
+	for( unsigned int n=0; n<shards.size(); n++ ){
+	  if( iters[n] == lists[n]->rend() ) continue;
+	  if( iters[n]->rawLength > 0 ){
+	    RawTile tile;
+	    if( RawTileCodec::decompress( iters[n]->tile, iters[n]->rawLength, tile ) ) f( tile );
+	  }
+	  else f( iters[n]->tile );
+	  ++iters[n];
+	  more = true;
+	}
+      }
+    }
+    return true;
+  }
+
+
+  /// Register a tile decode
+  /** Should be called on a cache miss before decoding a tile
+   *  @param key tile index as returned by getIndex()
+   *  @return true if the caller should decode the tile and publish it with endDecode(),
+   *          false if another thread is already decoding it, in which case waitDecode()
+   *          should be used to obtain the result
+   */
+  bool beginDecode( const TileKey& key ) {
+    std::lock_guard<std::mutex> lock( flightMutex );
+    if( flights.find( key ) != flights.end() ) return false;
+    flights[key] = std::make_shared<Flight>();
+    return true;
+  }
+
+
+  /// Wait for a decode in progress in another thread
+  /** @param key tile index
+   *  @param tile RawTile into which the decoded tile is placed. Its data is shared with
+   *         the decoding thread if that tile was shared with share()
+   *  @return true if the tile was decoded, false if the decode failed or is unknown,
+   *          in which case the caller must decode the tile itself
+   */
+  bool waitDecode( const TileKey& key, RawTile& tile ) {
+    std::unique_lock<std::mutex> lock( flightMutex );
+    auto f = flights.find( key );
+    if( f == flights.end() ) return false;
+    std::shared_ptr<Flight> flight = f->second;
+    flight->waiters++;
+    flightCondition.wait( lock, [&flight]{ return flight->done; } );
+    if( !flight->ok ) return false;
+    tile = flight->tile;
+    return true;
+  }
+
+
+  /// Publish the result of a decode registered with beginDecode()
+  /** The tile is only copied if other threads are waiting for it. Share the tile
+   *  with share() beforehand so that waiters reference rather than copy its data
+   *  @param key tile index
+   *  @param tile decoded tile or NULL if the decode failed
+   */
+  void endDecode( const TileKey& key, const RawTile* tile ) {
+    {
+      std::lock_guard<std::mutex> lock( flightMutex );
+      auto f = flights.find( key );
+      if( f == flights.end() ) return;
+      if( tile ){
+	if( f->second->waiters > 0 ) f->second->tile = *tile;
+	f->second->ok = true;
+      }
+      f->second->done = true;
+      flights.erase( f );
+    }
+    flightCondition.notify_all();
   }
 
 
@@ -283,12 +1099,10 @@ class Cache {
    *  @param v vertical sequence number
    *  @param c ImageEncoding type
    *  @param q compression quality
-   *  @return string
+   *  @return key
    */
-  std::string getIndex( const std::string& f, int r, int t, int h, int v, ImageEncoding c, int q ) const {
-    char tmp[1024];
-    snprintf( tmp, 1024, "%s:%d:%d:%d:%d:%d:%d", f.c_str(), r, t, h, v, (int)c, q );
-    return std::string( tmp );
+  TileKey getIndex( const std::string& f, int r, int t, int h, int v, ImageEncoding c, int q ) const {
+    return TileKey( f, r, t, h, v, c, q );
   }
 
 
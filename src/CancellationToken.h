@@ -0,0 +1,83 @@
+// Request Cancellation Token Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef _CANCELLATIONTOKEN_H
+#define _CANCELLATIONTOKEN_H
+
+
+#include <string>
+#include <atomic>
+#include <stdexcept>
+
+
+
+/// Exception thrown when a request has been cancelled
+class request_cancelled : public std::runtime_error {
+ public:
+  /** @param s error message */
+  request_cancelled(const std::string& s) : std::runtime_error(s) { }
+};
+
+
+
+/// Token allowing long running decoding and encoding to be abandoned once a client has gone away
+/** A token is cancelled when writing to the client fails. It can also watch a flag
+    set elsewhere when the peer closes its connection, such as by our event-driven
+    front ends. Decode, processing and encode loops should poll the token with
+    isCancelled() or check(), which throws request_cancelled.
+ */
+class CancellationToken {
+
+ private:
+
+  /// Whether we have been cancelled
+  std::atomic<bool> cancelled;
+
+  /// Optional flag set when the peer closes its connection
+  const std::atomic<bool>* peer;
+
+
+ public:
+
+  /// Constructor
+  CancellationToken() : cancelled( false ), peer( NULL ) {};
+
+  /// Cancel our request
+  void cancel(){ cancelled = true; };
+
+  /// Watch an external flag, which is set when the peer closes its connection
+  /** @param p flag */
+  void watch( const std::atomic<bool>* p ){ peer = p; };
+
+  /// Whether our request has been cancelled
+  bool isCancelled() const { return cancelled || ( peer && *peer ); };
+
+  /// Throw a request_cancelled exception if our request has been cancelled
+  /** @param where description of the operation being abandoned */
+  void check( const char* where ) const {
+    if( isCancelled() ) throw request_cancelled( std::string( where ) + " :: request cancelled by client" );
+  };
+
+};
+
+
+#endif
@@ -24,6 +24,7 @@
 
 
 #include "RawTile.h"
+#include "CancellationToken.h"
 #include <map>
 
 
@@ -74,6 +75,12 @@ class Compressor {
   /// Whether EXIF metadata should be embedded
   bool embedEXIF;
 
+  /// Cancellation token for the current request or NULL
+  const CancellationToken* cancellation;
+
+  /// Whether compression should be abandoned
+  bool cancelled() const { return cancellation && cancellation->isCancelled(); };
+
   /// Write metadata
   virtual void writeMetadata() {};
 
@@ -104,7 +111,8 @@ class Compressor {
     dpi_y( 0 ),
     embedICC( false ),
     embedXMP( false ),
-    embedEXIF( false ) {};
+    embedEXIF( false ),
+    cancellation( NULL ) {};
 
 
   virtual ~Compressor() {};
@@ -128,6 +136,11 @@ class Compressor {
   inline bool defaultQuality() const { return default_quality; }
 
 
+  /// Set a cancellation token allowing compression to be abandoned
+  /** @param c cancellation token */
+  inline void setCancellationToken( const CancellationToken* c ){ cancellation = c; };
+
+
   /// Set the physical output resolution
   inline void setResolution( float x, float y, int units ){ dpi_x = x; dpi_y = y; dpi_units = units; };
 
@@ -181,6 +194,34 @@ class Compressor {
   virtual void setQuality( int quality ) {};
 
 
+  /// Reset our state so that this compressor can be re-used for a new request
+  /** Restores the default quality level and clears any header, resolution, metadata
+      and cancellation token left over from a previous request. Codec contexts are kept
+      @param quality default quality level for this request
+   */
+  virtual void reset( int quality )
+  {
+    Q = quality;
+    default_quality = true;
+    if( header ){
+      delete[] header;
+      header = NULL;
+    }
+    header_size = 0;
+    dpi_units = 0;
+    dpi_x = 0;
+    dpi_y = 0;
+    metadata.clear();
+    icc.clear();
+    xmp.clear();
+    exif.clear();
+    embedICC = false;
+    embedXMP = false;
+    embedEXIF = false;
+    cancellation = NULL;
+  };
+
+
   /// Initialise strip based compression
   /** If we are doing a strip based encoding, we need to first initialise
       with InitCompression, then compress a single strip at a time using
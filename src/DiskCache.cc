@@ -0,0 +1,379 @@
+// Disk-Based Second Tier Tile Cache Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+
+#include "DiskCache.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+
+using namespace std;
+
+
+// Prefix and suffix of our segment file names
+#define SEGMENT_PREFIX "iipsrv-"
+#define SEGMENT_SUFFIX ".seg"
+
+// Number of segments into which our cache is divided. Compaction frees one segment at a time
+#define SEGMENTS 16
+
+// Maximum bytes of tile data waiting to be written before we start dropping tiles
+#define MAX_QUEUED 64*1024*1024
+
+
+
+/// Read or write a whole buffer at an offset, retrying after short transfers
+static bool transfer( bool out, int fd, void* buffer, size_t length, off_t offset )
+{
+  char* p = (char*) buffer;
+  while( length > 0 ){
+    ssize_t n = out ? pwrite( fd, p, length, offset ) : pread( fd, p, length, offset );
+    if( n < 0 && errno == EINTR ) continue;
+    if( n <= 0 ) return false;
+    p += n;
+    length -= n;
+    offset += n;
+  }
+  return true;
+}
+
+
+
+DiskCache::Segment::~Segment()
+{
+  if( fd >= 0 ) close( fd );
+}
+
+
+
+DiskCache::DiskCache( const string& dir, float max ) :
+  directory( dir ),
+  currentSize( 0 ),
+  nextSegment( 0 ),
+  cancelled( false ),
+  queued( 0 ),
+  stopping( false ),
+  hits( 0 ),
+  misses( 0 ),
+  dropped( 0 )
+{
+  maxSize = (unsigned long)(max*1024000);
+  segmentSize = maxSize / SEGMENTS;
+  if( segmentSize == 0 ) segmentSize = 1;
+
+  if( mkdir( directory.c_str(), 0755 ) != 0 && errno != EEXIST ){
+    throw string( "DiskCache :: Unable to create directory " + directory + ": " + strerror( errno ) );
+  }
+
+  // Remove segments left behind by a previous instance, which we cannot trust
+  DIR* d = opendir( directory.c_str() );
+  if( !d ) throw string( "DiskCache :: Unable to open directory " + directory + ": " + strerror( errno ) );
+  struct dirent* entry;
+  while( (entry = readdir( d )) ){
+    string name = entry->d_name;
+    if( name.compare( 0, strlen(SEGMENT_PREFIX), SEGMENT_PREFIX ) == 0 &&
+	name.size() > strlen(SEGMENT_SUFFIX) &&
+	name.compare( name.size() - strlen(SEGMENT_SUFFIX), string::npos, SEGMENT_SUFFIX ) == 0 ){
+      unlink( (directory + "/" + name).c_str() );
+    }
+  }
+  closedir( d );
+
+  {
+    lock_guard<std::mutex> lock( mutex );
+    if( !this->_open() ){
+      throw string( "DiskCache :: Unable to create segment in " + directory + ": " + strerror( errno ) );
+    }
+  }
+
+  writer = thread( &DiskCache::run, this );
+}
+
+
+
+DiskCache::~DiskCache()
+{
+  {
+    lock_guard<std::mutex> lock( queueMutex );
+    stopping = true;
+  }
+  queueCondition.notify_all();
+  if( writer.joinable() ) writer.join();
+
+  lock_guard<std::mutex> lock( mutex );
+  index.clear();
+  for( unsigned int i=0; i<segments.size(); i++ ) unlink( segments[i]->path.c_str() );
+  segments.clear();
+}
+
+
+
+bool DiskCache::_open()
+{
+  stringstream path;
+  path << directory << "/" << SEGMENT_PREFIX << nextSegment++ << SEGMENT_SUFFIX;
+
+  shared_ptr<Segment> segment = make_shared<Segment>();
+  segment->path = path.str();
+  segment->fd = open( segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+  if( segment->fd < 0 ) return false;
+
+  segments.push_back( segment );
+  return true;
+}
+
+
+
+void DiskCache::insert( const RawTile& tile )
+{
+  {
+    lock_guard<std::mutex> lock( queueMutex );
+    if( stopping || queued + tile.dataLength > MAX_QUEUED ){
+      dropped++;
+      return;
+    }
+    queue.push_back( tile );
+    queued += tile.dataLength;
+  }
+  queueCondition.notify_one();
+}
+
+
+
+void DiskCache::run()
+{
+  while( true ){
+
+    RawTile tile;
+    {
+      unique_lock<std::mutex> lock( queueMutex );
+      queueCondition.wait( lock, [this]{ return stopping || !queue.empty(); } );
+      if( stopping ) return;
+      tile = std::move( queue.front() );
+      queue.pop_front();
+      queued -= tile.dataLength;
+    }
+
+    this->write( tile );
+
+    // Free our oldest segments once we exceed our maximum size
+    while( currentSize > maxSize && segments.size() > 1 ) this->compact();
+  }
+}
+
+
+
+void DiskCache::write( const RawTile& tile )
+{
+  TileKey key( tile.filename, tile.resolution, tile.tileNum, tile.hSequence,
+	       tile.vSequence, tile.compressionType, tile.quality );
+
+  // A record consists of the image path followed by the tile data
+  unsigned long length = tile.filename.size() + tile.dataLength;
+  shared_ptr<Segment> segment;
+  unsigned long offset;
+
+  // Reserve space in our current segment
+  {
+    lock_guard<std::mutex> lock( mutex );
+
+    // Skip tiles we already hold
+    auto i = index.find( key );
+    if( i != index.end() && i->second.timestamp >= tile.timestamp ) return;
+
+    if( segments.back()->size > 0 && segments.back()->size + length > segmentSize ){
+      if( !this->_open() ){
+	dropped++;
+	return;
+      }
+    }
+    segment = segments.back();
+    offset = segment->size;
+    segment->size += length;
+    currentSize += length;
+
+    // Note the tile we are writing, so that any removal or purge during the write is not undone
+    writing = key;
+    cancelled = false;
+  }
+
+  // Write without holding our lock, so that lookups can proceed
+  if( !transfer( true, segment->fd, (void*) tile.filename.data(), tile.filename.size(), offset ) ||
+      !transfer( true, segment->fd, tile.data, tile.dataLength, offset + tile.filename.size() ) ){
+    // The space remains reserved until the segment is compacted
+    dropped++;
+    return;
+  }
+
+  Location l;
+  l.segment = segment;
+  l.offset = offset;
+  l.filenameLength = tile.filename.size();
+  l.dataLength = tile.dataLength;
+  l.width = tile.width;
+  l.height = tile.height;
+  l.channels = tile.channels;
+  l.bpc = tile.bpc;
+  l.sampleType = tile.sampleType;
+  l.timestamp = tile.timestamp;
+  l.referenced = false;
+
+  lock_guard<std::mutex> lock( mutex );
+  // As for a failed write, the space of a tile removed during its write remains reserved
+  if( cancelled ) return;
+  index[key] = l;
+  segment->keys.push_back( key );
+}
+
+
+
+void DiskCache::compact()
+{
+  shared_ptr<Segment> oldest;
+  vector< pair<TileKey,Location> > live;
+
+  {
+    lock_guard<std::mutex> lock( mutex );
+    oldest = segments.front();
+    segments.pop_front();
+    currentSize -= oldest->size;
+
+    // Remove the tiles of this segment from our index, keeping those that have been read
+    for( unsigned int n=0; n<oldest->keys.size(); n++ ){
+      auto i = index.find( oldest->keys[n] );
+      if( i == index.end() || i->second.segment != oldest ) continue;
+      if( i->second.referenced ) live.push_back( *i );
+      index.erase( i );
+    }
+  }
+
+  // Our file descriptor remains valid for any lookup still reading from the segment
+  unlink( oldest->path.c_str() );
+
+  // Give tiles that have been used a second chance in our current segment
+  for( unsigned int n=0; n<live.size(); n++ ){
+    RawTile tile;
+    if( this->read( live[n].first, live[n].second, tile ) ) this->write( tile );
+  }
+}
+
+
+
+bool DiskCache::read( const TileKey& key, const Location& l, RawTile& tile )
+{
+  // Release any data the tile already holds
+  tile = RawTile();
+
+  tile.filename.resize( l.filenameLength );
+  if( l.filenameLength > 0 &&
+      !transfer( false, l.segment->fd, &tile.filename[0], l.filenameLength, l.offset ) ) return false;
+
+  tile.tileNum = key.tile;
+  tile.resolution = key.resolution;
+  tile.hSequence = key.hSequence;
+  tile.vSequence = key.vSequence;
+  tile.compressionType = (ImageEncoding) key.encoding;
+  tile.quality = key.quality;
+  tile.timestamp = l.timestamp;
+  tile.width = l.width;
+  tile.height = l.height;
+  tile.channels = l.channels;
+  tile.bpc = l.bpc;
+  tile.sampleType = l.sampleType;
+
+  tile.allocate( l.dataLength );
+  tile.dataLength = l.dataLength;
+  return transfer( false, l.segment->fd, tile.data, l.dataLength, l.offset + l.filenameLength );
+}
+
+
+
+bool DiskCache::getTile( const TileKey& key, RawTile& tile )
+{
+  Location l;
+  {
+    lock_guard<std::mutex> lock( mutex );
+    auto i = index.find( key );
+    if( i == index.end() ){
+      misses++;
+      return false;
+    }
+    i->second.referenced = true;
+    l = i->second;
+  }
+
+  // Read outside our lock. Our copy of the location keeps the segment open
+  if( !this->read( key, l, tile ) ){
+    misses++;
+    return false;
+  }
+  hits++;
+  return true;
+}
+
+
+
+void DiskCache::remove( const TileKey& key )
+{
+  lock_guard<std::mutex> lock( mutex );
+  index.erase( key );
+  if( key == writing ) cancelled = true;
+}
+
+
+
+unsigned int DiskCache::purge( uint32_t image )
+{
+  lock_guard<std::mutex> lock( mutex );
+  if( writing.image == image ) cancelled = true;
+  unsigned int n = 0;
+  for( auto i = index.begin(); i != index.end(); ){
+    if( i->first.image == image ){
+      i = index.erase( i );
+      n++;
+    }
+    else ++i;
+  }
+  return n;
+}
+
+
+
+unsigned int DiskCache::getNumElements()
+{
+  lock_guard<std::mutex> lock( mutex );
+  return index.size();
+}
+
+
+
+float DiskCache::getDiskSize()
+{
+  lock_guard<std::mutex> lock( mutex );
+  return (float) ( currentSize / 1024000.0 );
+}
@@ -0,0 +1,218 @@
+// Disk-Based Second Tier Tile Cache Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+
+#ifndef _DISKCACHE_H
+#define _DISKCACHE_H
+
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <ctime>
+#include "Cache.h"
+
+
+
+/// Second tier tile cache held in log-structured segment files on local disk
+/** Encoded tiles evicted from our in-memory Cache are appended by a background
+    thread to the current segment file in a cache directory, which should be on
+    fast local storage such as an SSD. An in-memory index records where each tile
+    is stored, and tiles are read back with a single positioned read per lookup.
+    Tiles are never overwritten in place: a newer version of a tile is appended
+    and the index updated, leaving the old copy as garbage. Once the segments
+    exceed our maximum size, the oldest segment is compacted: tiles in it that
+    have been read since they were written are rewritten to the current segment
+    and the segment file is deleted. Tiles that have not been read are dropped.
+
+    Tiles carry the modification timestamp of their image, so that tiles from an
+    image that has since been modified are superseded by newer versions inserted
+    into our in-memory cache. The cache is transient and its files are removed at
+    startup and shutdown.
+ */
+class DiskCache : public SecondaryCache {
+
+ private:
+
+  /// A segment file
+  struct Segment {
+    int fd;                     ///< File descriptor, which remains open after the file is unlinked
+    std::string path;           ///< File path
+    unsigned long size;         ///< Number of bytes written
+    std::vector<TileKey> keys;  ///< Tiles written to this segment, some of which may since have been superseded
+    Segment() : fd( -1 ), size( 0 ) {};
+    ~Segment();
+  };
+
+  /// Location and metadata of a stored tile
+  struct Location {
+    std::shared_ptr<Segment> segment;  ///< Segment holding the tile
+    unsigned long offset;       ///< Offset of the tile within the segment
+    unsigned int filenameLength;  ///< Length of the image path stored before the tile data
+    unsigned int dataLength;    ///< Length of the tile data
+    unsigned int width;         ///< Tile width
+    unsigned int height;        ///< Tile height
+    unsigned char channels;     ///< Number of channels
+    unsigned char bpc;          ///< Bits per channel
+    SampleType sampleType;      ///< Sample type
+    time_t timestamp;           ///< Image modification timestamp
+    bool referenced;            ///< Whether the tile has been read since it was written
+  };
+
+  /// Cache directory
+  std::string directory;
+
+  /// Maximum total size of our segments in bytes
+  unsigned long maxSize;
+
+  /// Size at which a segment is closed and a new one started
+  unsigned long segmentSize;
+
+  /// Segments from the oldest to the current
+  std::deque< std::shared_ptr<Segment> > segments;
+
+  /// Total size of our segments in bytes
+  unsigned long currentSize;
+
+  /// Number used to name our next segment
+  unsigned int nextSegment;
+
+  /// Index of stored tiles
+  HASHMAP < TileKey, Location > index;
+
+  /// Mutex protecting our index and segments
+  std::mutex mutex;
+
+  /// Tile being written by our writer thread outside our lock
+  TileKey writing;
+
+  /// Whether the tile being written has been removed or purged since its space was reserved
+  bool cancelled;
+
+  /// Tiles waiting to be written
+  std::deque<RawTile> queue;
+
+  /// Bytes of tile data waiting to be written
+  unsigned long queued;
+
+  /// Mutex protecting our queue
+  std::mutex queueMutex;
+
+  /// Condition variable signalling new tiles or shutdown to our writer
+  std::condition_variable queueCondition;
+
+  /// Whether our writer should stop
+  bool stopping;
+
+  /// Background writer thread
+  std::thread writer;
+
+  /// Lookup counters
+  std::atomic<unsigned long> hits, misses, dropped;
+
+
+  /// Open a new segment, making it our current segment
+  /** Our mutex must be locked
+   *  @return false if the segment file could not be created
+   */
+  bool _open();
+
+  /// Write a tile to our current segment
+  /** Only called by our writer thread
+   *  @param tile tile
+   */
+  void write( const RawTile& tile );
+
+  /// Compact our oldest segment
+  /** Only called by our writer thread */
+  void compact();
+
+  /// Read a stored tile
+  /** @param key tile index
+   *  @param l tile location
+   *  @param tile RawTile into which the tile is read
+   *  @return whether the tile could be read
+   */
+  bool read( const TileKey& key, const Location& l, RawTile& tile );
+
+  /// Writer thread loop
+  void run();
+
+
+ public:
+
+  /// Constructor
+  /** Creates the cache directory if necessary and removes any segment files left
+   *  there by a previous instance. Throws a string on error
+   *  @param dir cache directory
+   *  @param max maximum size in MB
+   */
+  DiskCache( const std::string& dir, float max );
+
+  /// Destructor - stops our writer and removes our segment files
+  ~DiskCache();
+
+  /// Queue a tile to be written by our writer thread
+  /** If too much data is already waiting to be written, the tile is dropped
+   *  @param tile tile
+   */
+  void insert( const RawTile& tile );
+
+  /// Look up and read a tile
+  /** Parameters as for SecondaryCache::getTile() */
+  bool getTile( const TileKey& key, RawTile& tile );
+
+  /// Remove a superseded tile from our index
+  /** @param key tile index */
+  void remove( const TileKey& key );
+
+  /// Remove all tiles of an image from our index
+  /** This scans our whole index, but is only needed when an image is modified or purged
+   *  @param image interned image id
+   *  @return number of tiles removed
+   */
+  unsigned int purge( uint32_t image );
+
+  /// Return the number of tiles stored
+  unsigned int getNumElements();
+
+  /// Return the number of MB used by our segments
+  float getDiskSize();
+
+  /// Return the number of lookups that found a tile
+  unsigned long getHits() const { return hits; };
+
+  /// Return the number of lookups that did not find a tile
+  unsigned long getMisses() const { return misses; };
+
+  /// Return the number of tiles not written because our writer could not keep up
+  unsigned long getDropped() const { return dropped; };
+
+};
+
+
+#endif
@@ -0,0 +1,507 @@
+// Image Affinity Dispatcher Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#include "Dispatcher.h"
+#include "FCGIServer.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <algorithm>
+#include <cctype>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <fastcgi.h>
+
+
+using namespace std;
+
+
+// Maximum number of events to handle per call to epoll_wait
+#define MAX_EVENTS 256
+
+// Maximum amount of data we peek at before routing a connection regardless
+#define PEEK_SIZE 65536
+
+// Time in seconds after which connections that have not sent a request are dropped
+#define PEEK_TIMEOUT 30
+
+// Number of points each worker occupies on our hash ring
+#define VIRTUAL_NODES 160
+
+
+
+// 64 bit FNV-1a hash with a final mixing step to spread similar keys around our ring
+static uint64_t hash64( const string& key )
+{
+  uint64_t h = 14695981039346656037ULL;
+  for( unsigned int i=0; i<key.size(); i++ ){
+    h ^= (unsigned char) key[i];
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+
+
+// Strip a IIIF request path down to its identifier
+static string iiifIdentifier( const string& path )
+{
+  // Info requests end in /info.json
+  const string info = "/info.json";
+  if( path.size() > info.size() && path.compare( path.size() - info.size(), info.size(), info ) == 0 ){
+    return path.substr( 0, path.size() - info.size() );
+  }
+
+  // Image requests end in {region}/{size}/{rotation}/{quality}.{format}
+  size_t slash = path.rfind( '/' );
+  if( slash == string::npos ) return path;
+
+  string quality = path.substr( slash + 1 );
+  quality = quality.substr( 0, quality.find( '.' ) );
+  transform( quality.begin(), quality.end(), quality.begin(), ::tolower );
+  if( quality != "default" && quality != "color" && quality != "gray" && quality != "bitonal" && quality != "native" ){
+    return path;
+  }
+
+  for( int n=0; n<3; n++ ){
+    if( slash == 0 ) return path;
+    slash = path.rfind( '/', slash - 1 );
+    if( slash == string::npos ) return path;
+  }
+
+  return path.substr( 0, slash );
+}
+
+
+
+// Send a file descriptor over a Unix socket
+static bool sendDescriptor( int channel, int fd )
+{
+  char byte = 0;
+  struct iovec iov;
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  memset( &control, 0, sizeof(control) );
+
+  struct msghdr msg;
+  memset( &msg, 0, sizeof(msg) );
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR( &msg );
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN( sizeof(int) );
+  memcpy( CMSG_DATA(cmsg), &fd, sizeof(int) );
+
+  ssize_t n;
+  do n = sendmsg( channel, &msg, MSG_DONTWAIT | MSG_NOSIGNAL );
+  while( n == -1 && errno == EINTR );
+
+  return n == 1;
+}
+
+
+
+Dispatcher::Dispatcher( int socket, unsigned int workers, bool h ) :
+  listenSocket( socket ),
+  http( h ),
+  epollfd( -1 ),
+  counter( 0 )
+{
+  channels.assign( workers, -1 );
+
+  // Place each worker at several points on our ring to even out the share of images each receives
+  for( unsigned int n=0; n<workers; n++ ){
+    for( unsigned int v=0; v<VIRTUAL_NODES; v++ ){
+      stringstream point;
+      point << "worker-" << n << "-" << v;
+      ring[ hash64( point.str() ) ] = n;
+    }
+  }
+
+  int flags = fcntl( listenSocket, F_GETFL, 0 );
+  if( flags == -1 || fcntl( listenSocket, F_SETFL, flags | O_NONBLOCK ) == -1 ){
+    throw string( "Dispatcher :: unable to set listen socket to non-blocking: " ) + strerror( errno );
+  }
+
+  epollfd = epoll_create1( EPOLL_CLOEXEC );
+  if( epollfd == -1 ) throw string( "Dispatcher :: unable to create epoll instance: " ) + strerror( errno );
+
+  struct epoll_event ev;
+  memset( &ev, 0, sizeof(ev) );
+  ev.events = EPOLLIN;
+  ev.data.fd = listenSocket;
+  if( epoll_ctl( epollfd, EPOLL_CTL_ADD, listenSocket, &ev ) == -1 ){
+    ::close( epollfd );
+    throw string( "Dispatcher :: unable to watch listen socket: " ) + strerror( errno );
+  }
+}
+
+
+
+Dispatcher::~Dispatcher()
+{
+  for( map<int,Pending>::iterator i = pending.begin(); i != pending.end(); ++i ) ::close( i->first );
+  for( unsigned int n=0; n<channels.size(); n++ ) if( channels[n] != -1 ) ::close( channels[n] );
+  if( epollfd != -1 ) ::close( epollfd );
+}
+
+
+
+int Dispatcher::open( unsigned int n )
+{
+  this->close( n );
+
+  // Use a sequenced packet socket so that each message carries exactly one descriptor
+  // and so that a worker can detect when we have gone away
+  int sv[2];
+  if( socketpair( AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv ) == -1 ){
+    throw string( "Dispatcher :: unable to create worker channel: " ) + strerror( errno );
+  }
+
+  channels[n] = sv[0];
+  return sv[1];
+}
+
+
+
+void Dispatcher::close( unsigned int n )
+{
+  if( channels[n] != -1 ) ::close( channels[n] );
+  channels[n] = -1;
+}
+
+
+
+void Dispatcher::release()
+{
+  // Our descriptors are inherited across fork() regardless of FD_CLOEXEC. Connections
+  // in particular must be closed, as they would otherwise stay open after being handed on
+  for( map<int,Pending>::iterator i = pending.begin(); i != pending.end(); ++i ) ::close( i->first );
+  pending.clear();
+  for( unsigned int n=0; n<channels.size(); n++ ) if( channels[n] != -1 ) ::close( channels[n] );
+  channels.clear();
+  ::close( epollfd );
+  epollfd = -1;
+  ::close( listenSocket );
+}
+
+
+
+void Dispatcher::poll( int timeout )
+{
+  struct epoll_event events[MAX_EVENTS];
+
+  int n = epoll_wait( epollfd, events, MAX_EVENTS, timeout );
+
+  for( int i=0; i<n; i++ ){
+    int fd = events[i].data.fd;
+    if( fd == listenSocket ){
+      this->accept();
+      continue;
+    }
+    if( pending.find( fd ) == pending.end() ) continue;
+    this->route( fd, events[i].events & (EPOLLRDHUP|EPOLLHUP|EPOLLERR) );
+  }
+
+  // Drop any connections that have not sent us a request in time
+  time_t now = time( NULL );
+  vector<int> expired;
+  for( map<int,Pending>::iterator i = pending.begin(); i != pending.end(); ++i ){
+    if( now - i->second.accepted > PEEK_TIMEOUT ) expired.push_back( i->first );
+  }
+  for( unsigned int i=0; i<expired.size(); i++ ) this->drop( expired[i] );
+}
+
+
+
+void Dispatcher::accept()
+{
+  while( true ){
+
+    int fd = ::accept4( listenSocket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC );
+    if( fd == -1 ) return;
+
+    // We only peek at the data on our connections without reading it, so need to be
+    // edge-triggered in order to be woken only by the arrival of new data
+    struct epoll_event ev;
+    memset( &ev, 0, sizeof(ev) );
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = fd;
+    if( epoll_ctl( epollfd, EPOLL_CTL_ADD, fd, &ev ) == -1 ){
+      ::close( fd );
+      continue;
+    }
+
+    pending[fd] = Pending();
+  }
+}
+
+
+
+bool Dispatcher::route( int fd, bool closed )
+{
+  string data( PEEK_SIZE, '\0' );
+
+  ssize_t n;
+  do n = recv( fd, &data[0], PEEK_SIZE, MSG_PEEK );
+  while( n == -1 && errno == EINTR );
+
+  if( n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) && !closed ) return false;
+
+  // Connections closed or failed before sending anything can simply be dropped
+  if( n <= 0 ){
+    this->drop( fd );
+    return true;
+  }
+
+  data.resize( n );
+
+  string query, uri;
+  bool complete = http ? peekHTTP( data, query, uri ) : peekFCGI( data, query, uri );
+
+  // Wait for more of the request unless there is no more to come
+  if( !complete && n < PEEK_SIZE && !closed ) return false;
+
+  this->handoff( fd, identifier( query, uri ) );
+  return true;
+}
+
+
+
+bool Dispatcher::handoff( int fd, const string& key )
+{
+  bool sent = false;
+  unsigned int size = channels.size();
+
+  // Requests without an identifier are spread evenly. If the chosen worker is
+  // unavailable or too busy to accept more connections, try the next one
+  int first = key.empty() ? -1 : this->lookup( key );
+  if( first == -1 ) first = counter++ % size;
+
+  for( unsigned int i=0; i<size && !sent; i++ ){
+    int n = (first + i) % size;
+    if( channels[n] != -1 ) sent = sendDescriptor( channels[n], fd );
+  }
+
+  // The worker now holds its own copy of our connection
+  this->drop( fd );
+  return sent;
+}
+
+
+
+void Dispatcher::drop( int fd )
+{
+  epoll_ctl( epollfd, EPOLL_CTL_DEL, fd, NULL );
+  ::close( fd );
+  pending.erase( fd );
+}
+
+
+
+int Dispatcher::lookup( const string& key ) const
+{
+  if( ring.empty() ) return -1;
+
+  map<uint64_t,unsigned int>::const_iterator i = ring.lower_bound( hash64( key ) );
+
+  // Walk clockwise around our ring to the first available worker
+  for( unsigned int n=0; n<ring.size(); n++, ++i ){
+    if( i == ring.end() ) i = ring.begin();
+    if( channels[i->second] != -1 ) return i->second;
+  }
+
+  return -1;
+}
+
+
+
+int Dispatcher::receive( int channel )
+{
+  char byte;
+  struct iovec iov;
+  iov.iov_base = &byte;
+  iov.iov_len = 1;
+
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+
+  struct msghdr msg;
+  memset( &msg, 0, sizeof(msg) );
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  ssize_t n;
+  do n = recvmsg( channel, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC );
+  while( n == -1 && errno == EINTR );
+
+  if( n == 0 ){
+    errno = EPIPE;
+    return -1;
+  }
+  if( n == -1 ) return -1;
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR( &msg );
+  if( !cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ){
+    errno = EAGAIN;
+    return -1;
+  }
+
+  int fd;
+  memcpy( &fd, CMSG_DATA(cmsg), sizeof(int) );
+  return fd;
+}
+
+
+
+bool Dispatcher::peekFCGI( const string& data, string& query, string& uri )
+{
+  size_t n = 0;
+  bool started = false;
+  unsigned int request = 0;
+  string params;
+
+  while( data.size() - n >= FCGI_HEADER_LEN ){
+
+    const FCGI_Header* header = (const FCGI_Header*) ( data.data() + n );
+
+    // Leave malformed input for our worker to reject
+    if( header->version != FCGI_VERSION_1 ) return true;
+
+    unsigned int id = (header->requestIdB1 << 8) | header->requestIdB0;
+    size_t length = (header->contentLengthB1 << 8) | header->contentLengthB0;
+    size_t total = FCGI_HEADER_LEN + length + header->paddingLength;
+    if( data.size() - n < total ) return false;
+
+    // We route on the parameters of the first request on the connection
+    if( header->type == FCGI_BEGIN_REQUEST && !started ){
+      started = true;
+      request = id;
+    }
+    else if( header->type == FCGI_PARAMS && started && id == request ){
+      if( length > 0 ) params.append( data, n + FCGI_HEADER_LEN, length );
+      else{
+	// An empty record marks the end of the stream
+	EventRequest r;
+	if( FCGIServer::decodeParams( params, r ) ){
+	  query = r.getParam( "QUERY_STRING" );
+	  uri = r.getParam( "REQUEST_URI" );
+	}
+	return true;
+      }
+    }
+
+    n += total;
+  }
+
+  return false;
+}
+
+
+
+bool Dispatcher::peekHTTP( const string& data, string& query, string& uri )
+{
+  size_t end = data.find( '\n' );
+  if( end == string::npos ) return false;
+
+  // Request lines are of the form: METHOD SP request-target SP HTTP-version
+  string line = data.substr( 0, end );
+  size_t start = line.find( ' ' );
+  if( start == string::npos ) return true;
+  start++;
+  size_t stop = line.find( ' ', start );
+  if( stop == string::npos ) stop = line.size();
+
+  uri = line.substr( start, stop - start );
+  size_t q = uri.find( '?' );
+  if( q != string::npos ) query = uri.substr( q + 1 );
+
+  return true;
+}
+
+
+
+string Dispatcher::identifier( const string& query, const string& uri )
+{
+  size_t start = 0;
+
+  while( start < query.size() ){
+
+    size_t end = query.find( '&', start );
+    if( end == string::npos ) end = query.size();
+    string argument = query.substr( start, end - start );
+    start = end + 1;
+
+    size_t equals = argument.find( '=' );
+    if( equals == string::npos ) continue;
+
+    // Command names are case insensitive
+    string name = argument.substr( 0, equals );
+    transform( name.begin(), name.end(), name.begin(), ::tolower );
+    string value = argument.substr( equals + 1 );
+
+    if( name == "fif" ) return value;
+
+    if( name == "iiif" ) return iiifIdentifier( value );
+
+    if( name == "deepzoom" ){
+      // Either the .dzi descriptor or a tile within the _files directory
+      size_t pos = value.rfind( "_files/" );
+      if( pos != string::npos ) return value.substr( 0, pos );
+      if( value.size() > 4 && value.compare( value.size() - 4, 4, ".dzi" ) == 0 ) return value.substr( 0, value.size() - 4 );
+      return value;
+    }
+
+    if( name == "zoomify" ){
+      // Either the ImageProperties.xml descriptor or a tile within a TileGroup directory
+      size_t pos = value.rfind( "/TileGroup" );
+      if( pos == string::npos ) pos = value.rfind( "/ImageProperties.xml" );
+      return value.substr( 0, pos );
+    }
+  }
+
+  // Requests mapped through URI_MAP carry their identifier in the request path
+  if( !uri.empty() ) return iiifIdentifier( uri.substr( 0, uri.find( '?' ) ) );
+
+  return string();
+}
@@ -0,0 +1,168 @@
+// Image Affinity Dispatcher Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef _DISPATCHER_H
+#define _DISPATCHER_H
+
+
+#include <string>
+#include <vector>
+#include <map>
+#include <ctime>
+#include <cstdint>
+
+
+
+/// Front end routing connections to worker processes by image
+/** Runs within our prefork master process. New connections are accepted and
+    their first request is peeked at (without being consumed) until the image
+    identifier of a FIF, IIIF, DeepZoom or Zoomify request can be extracted.
+    The connection is then passed over a Unix socket to the worker chosen by
+    consistent hashing of this identifier. Each worker therefore sees a
+    disjoint slice of our images and its tile cache holds only that slice.
+    Adding or removing a worker only moves the images of that worker.
+
+    Routing is per connection: all requests on a persistent connection are
+    handled by the same worker.
+ */
+class Dispatcher {
+
+ private:
+
+  /// Connection waiting for enough data to be routed
+  struct Pending {
+    time_t accepted;           ///< Time at which the connection was accepted
+    Pending() : accepted( time( NULL ) ) {};
+  };
+
+  /// Listen socket
+  int listenSocket;
+
+  /// Whether our clients speak HTTP rather than FastCGI
+  bool http;
+
+  /// epoll file descriptor
+  int epollfd;
+
+  /// Our ends of the channels to each worker or -1 if a worker is unavailable
+  std::vector<int> channels;
+
+  /// Hash ring mapping points to worker indices
+  std::map< uint64_t, unsigned int > ring;
+
+  /// Connections waiting to be routed indexed by file descriptor
+  std::map< int, Pending > pending;
+
+  /// Counter used to spread requests without an image identifier
+  unsigned int counter;
+
+
+  /// Accept new connections
+  void accept();
+
+  /// Try to route a connection
+  /** @param fd connection
+      @param closed whether the peer has closed its side of the connection
+      @return false if we need more data before routing
+   */
+  bool route( int fd, bool closed );
+
+  /// Pass a connection to a worker
+  /** @param fd connection
+      @param key image identifier
+      @return whether a worker accepted the connection
+   */
+  bool handoff( int fd, const std::string& key );
+
+  /// Stop watching and close a pending connection
+  /** @param fd connection */
+  void drop( int fd );
+
+  /// Extract the request parameters we route on from peeked FastCGI data
+  /** @param data peeked data
+      @param query set to the QUERY_STRING
+      @param uri set to the REQUEST_URI
+      @return false if the parameters have not yet been fully received
+   */
+  static bool peekFCGI( const std::string& data, std::string& query, std::string& uri );
+
+  /// Extract the request parameters we route on from a peeked HTTP request line
+  /** @param data peeked data
+      @param query set to the query string
+      @param uri set to the request URI
+      @return false if the request line has not yet been fully received
+   */
+  static bool peekHTTP( const std::string& data, std::string& query, std::string& uri );
+
+
+ public:
+
+  /// Constructor. Throws a string on error
+  /** @param socket listen socket
+      @param workers number of worker processes
+      @param h whether our clients speak HTTP rather than FastCGI
+   */
+  Dispatcher( int socket, unsigned int workers, bool h );
+
+  /// Destructor
+  ~Dispatcher();
+
+  /// Create a new channel to a worker, which is about to be forked
+  /** @param n worker index
+      @return worker end of the channel, which the master should close after fork()
+   */
+  int open( unsigned int n );
+
+  /// Close the channel to a worker that has exited
+  /** @param n worker index */
+  void close( unsigned int n );
+
+  /// Wait for and handle network events
+  /** @param timeout maximum time to wait in milliseconds */
+  void poll( int timeout );
+
+  /// Close all inherited descriptors within a newly forked worker
+  void release();
+
+  /// Return the worker that handles a given image
+  /** @param key image identifier
+      @return worker index or -1 if no worker is available
+   */
+  int lookup( const std::string& key ) const;
+
+  /// Receive a connection passed over a channel by a Dispatcher
+  /** @param channel worker end of a channel
+      @return connection or -1 if none is waiting. errno is set to EPIPE if the channel has been closed
+   */
+  static int receive( int channel );
+
+  /// Extract the image identifier from a request
+  /** @param query the QUERY_STRING of the request
+      @param uri the REQUEST_URI of the request, which is used for URI_MAP mapped requests
+      @return identifier or an empty string if none can be found
+   */
+  static std::string identifier( const std::string& query, const std::string& uri );
+
+};
+
+
+#endif
@@ -1,7 +1,7 @@
 /*
     IIP Environment Variable Class
 
-    Copyright (C) 2006-2025 Ruven Pillay
+    Copyright (C) 2006-2026 Ruven Pillay
 
     This program is free software; you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -59,9 +59,32 @@
 #define IIIF_EXTRA_INFO ""
 #define IIIF_EXTENSIONS false
 #define COPYRIGHT ""
+#define WORKER_THREADS 1
+#define WORKER_PROCESSES 0
+#define EVENT_LOOP false
+#define TILE_REQUEST_LIMIT 0
+#define BULK_REQUEST_LIMIT 0
+#define TILE_REQUEST_WEIGHT 4
+#define OVERLOAD_THRESHOLDS ""
+#define IMAGE_AFFINITY false
+#define CPU_AFFINITY 0
+#define REQUEST_THREADS 0
+#define CACHE_SNAPSHOT ""
+#define CACHE_SHARDS 0
+#define CACHE_POLICY 0
+#define CACHE_ADMISSION false
+#define CACHE_COMPRESSION false
+#define CACHE_DEDUPLICATION false
+#define DISK_CACHE ""
+#define CACHE_PURGE false
+#define DISK_CACHE_SIZE 10240.0
+#define CACHE_PARTITIONS ""
+#define CACHE_PINNED ""
+#define CACHE_MEMORY_FRACTION 0.25
 
 
 #include <string>
+#include <thread>
 
 
 /// Class to obtain environment variables
@@ -88,11 +111,13 @@ class Environment {
   }
 
 
+  /// Maximum tile cache size in MB or -1 if our caches are to be sized automatically ("auto")
   static float getMaxImageCacheSize(){
     float max_image_cache_size = MAX_IMAGE_CACHE_SIZE;
     const char* envpara = getenv( "MAX_IMAGE_CACHE_SIZE" );
     if( envpara ){
-      max_image_cache_size = atof( envpara );
+      if( std::string( envpara ) == "auto" ) max_image_cache_size = -1;
+      else max_image_cache_size = atof( envpara );
     }
     return max_image_cache_size;
   }
@@ -455,6 +480,244 @@ class Environment {
     else return COPYRIGHT;
   }
 
+
+  /// Number of worker threads: 0 = one per available processor core
+  static unsigned int getWorkerThreads(){
+    const char* envpara = getenv( "WORKER_THREADS" );
+    int threads;
+    if( envpara ){
+      threads = atoi( envpara );
+      if( threads < 0 ) threads = WORKER_THREADS;
+      else if( threads == 0 ) threads = std::thread::hardware_concurrency();
+      if( threads < 1 ) threads = WORKER_THREADS;
+    }
+    else threads = WORKER_THREADS;
+    return threads;
+  }
+
+
+  /// Whether to use our event-driven FastCGI front end
+  static bool getEventLoop(){
+    const char* envpara = getenv( "EVENT_LOOP" );
+    bool event_loop;
+    if( envpara ) event_loop = atoi( envpara ); // Implicit cast to boolean, all values other than '0' treated as true
+    else event_loop = EVENT_LOOP;
+    return event_loop;
+  }
+
+
+  /// Whether to route requests for each image to the same worker process
+  static bool getImageAffinity(){
+    const char* envpara = getenv( "IMAGE_AFFINITY" );
+    bool affinity;
+    if( envpara ) affinity = atoi( envpara ); // Implicit cast to boolean, all values other than '0' treated as true
+    else affinity = IMAGE_AFFINITY;
+    return affinity;
+  }
+
+
+  /// Placement of worker threads: 0 = none, 1 = bind to NUMA nodes, 2 = bind to individual cores
+  static unsigned int getCPUAffinity(){
+    const char* envpara = getenv( "CPU_AFFINITY" );
+    int affinity = CPU_AFFINITY;
+    if( envpara ){
+      affinity = atoi( envpara );
+      if( affinity < 0 || affinity > 2 ) affinity = CPU_AFFINITY;
+    }
+    return affinity;
+  }
+
+
+  /// Maximum number of threads a single request may use for decoding, processing and encoding: 0 = unlimited
+  static unsigned int getRequestThreads(){
+    const char* envpara = getenv( "REQUEST_THREADS" );
+    int threads = REQUEST_THREADS;
+    if( envpara ){
+      threads = atoi( envpara );
+      if( threads < 0 ) threads = REQUEST_THREADS;
+    }
+    return threads;
+  }
+
+
+  /// Path of the file in which our caches are saved on shutdown and restored on startup
+  static std::string getCacheSnapshot(){
+    const char* envpara = getenv( "CACHE_SNAPSHOT" );
+    if( envpara ) return std::string( envpara );
+    else return CACHE_SNAPSHOT;
+  }
+
+
+  /// Number of independently locked shards into which our tile cache is divided: 0 = one per worker thread
+  static unsigned int getCacheShards(){
+    const char* envpara = getenv( "CACHE_SHARDS" );
+    int shards = CACHE_SHARDS;
+    if( envpara ){
+      shards = atoi( envpara );
+      if( shards < 0 ) shards = CACHE_SHARDS;
+    }
+    return shards;
+  }
+
+
+  /// Tile cache eviction policy: 0 = least recently used, 1 = CLOCK approximation of LRU,
+  /// 2 = GreedyDual-Size-Frequency
+  static unsigned int getCachePolicy(){
+    const char* envpara = getenv( "CACHE_POLICY" );
+    int policy = CACHE_POLICY;
+    if( envpara ){
+      policy = atoi( envpara );
+      if( policy < 0 || policy > 2 ) policy = CACHE_POLICY;
+    }
+    return policy;
+  }
+
+
+  /// Whether new tiles must pass a W-TinyLFU frequency based admission filter to enter our tile cache
+  static bool getCacheAdmission(){
+    const char* envpara = getenv( "CACHE_ADMISSION" );
+    bool admission;
+    if( envpara ) admission = atoi( envpara ); // Implicit cast to boolean, all values other than '0' treated as true
+    else admission = CACHE_ADMISSION;
+    return admission;
+  }
+
+
+  /// Whether to store RAW tiles compressed in our tile cache
+  static bool getCacheCompression(){
+    const char* envpara = getenv( "CACHE_COMPRESSION" );
+    bool compression;
+    if( envpara ) compression = atoi( envpara ); // Implicit cast to boolean, all values other than '0' treated as true
+    else compression = CACHE_COMPRESSION;
+    return compression;
+  }
+
+
+  /// Directory in which to keep a second tier tile cache on local disk: empty = disabled
+  static std::string getDiskCache(){
+    const char* envpara = getenv( "DISK_CACHE" );
+    if( envpara ) return std::string( envpara );
+    else return DISK_CACHE;
+  }
+
+
+  /// Maximum size of our disk tile cache in MB
+  static float getDiskCacheSize(){
+    float disk_cache_size = DISK_CACHE_SIZE;
+    const char* envpara = getenv( "DISK_CACHE_SIZE" );
+    if( envpara ){
+      disk_cache_size = atof( envpara );
+    }
+    return disk_cache_size;
+  }
+
+
+  /// Fraction of our memory limit used for our caches when they are sized automatically
+  static float getCacheMemoryFraction(){
+    float fraction = CACHE_MEMORY_FRACTION;
+    const char* envpara = getenv( "CACHE_MEMORY_FRACTION" );
+    if( envpara ){
+      fraction = atof( envpara );
+      if( fraction <= 0 || fraction > 1 ) fraction = CACHE_MEMORY_FRACTION;
+    }
+    return fraction;
+  }
+
+
+  /// Whether tiles with identical data should share a single buffer in our tile cache
+  static bool getCacheDeduplication(){
+    const char* envpara = getenv( "CACHE_DEDUPLICATION" );
+    bool deduplication;
+    if( envpara ) deduplication = atoi( envpara ); // Implicit cast to boolean, all values other than '0' treated as true
+    else deduplication = CACHE_DEDUPLICATION;
+    return deduplication;
+  }
+
+
+  /// Tile cache partitions as a comma separated list of image path prefixes and their sizes in MB
+  /** For example "archive/=512,public/=2048" */
+  static std::string getCachePartitions(){
+    const char* envpara = getenv( "CACHE_PARTITIONS" );
+    if( envpara ) return std::string( envpara );
+    else return CACHE_PARTITIONS;
+  }
+
+
+  /// Comma separated list of images whose tiles are never evicted from our tile cache
+  static std::string getCachePinned(){
+    const char* envpara = getenv( "CACHE_PINNED" );
+    if( envpara ) return std::string( envpara );
+    else return CACHE_PINNED;
+  }
+
+
+  /// Whether to enable the PRG command, which purges an image from our caches
+  static bool getCachePurge(){
+    const char* envpara = getenv( "CACHE_PURGE" );
+    bool purge;
+    if( envpara ) purge = atoi( envpara ); // Implicit cast to boolean, all values other than '0' treated as true
+    else purge = CACHE_PURGE;
+    return purge;
+  }
+
+
+  /// Number of worker processes to prefork: 0 = disabled
+  static unsigned int getWorkerProcesses(){
+    const char* envpara = getenv( "WORKER_PROCESSES" );
+    int processes = WORKER_PROCESSES;
+    if( envpara ){
+      processes = atoi( envpara );
+      if( processes < 0 ) processes = WORKER_PROCESSES;
+    }
+    return processes;
+  }
+
+
+  /// Maximum number of tile and other interactive requests processed concurrently: 0 = unlimited
+  static unsigned int getTileRequestLimit(){
+    const char* envpara = getenv( "TILE_REQUEST_LIMIT" );
+    int limit = TILE_REQUEST_LIMIT;
+    if( envpara ){
+      limit = atoi( envpara );
+      if( limit < 0 ) limit = TILE_REQUEST_LIMIT;
+    }
+    return limit;
+  }
+
+
+  /// Maximum number of exports and full size requests processed concurrently: 0 = unlimited
+  static unsigned int getBulkRequestLimit(){
+    const char* envpara = getenv( "BULK_REQUEST_LIMIT" );
+    int limit = BULK_REQUEST_LIMIT;
+    if( envpara ){
+      limit = atoi( envpara );
+      if( limit < 0 ) limit = BULK_REQUEST_LIMIT;
+    }
+    return limit;
+  }
+
+
+  /// Scheduling weight of interactive requests relative to bulk requests
+  static unsigned int getTileRequestWeight(){
+    const char* envpara = getenv( "TILE_REQUEST_WEIGHT" );
+    int weight = TILE_REQUEST_WEIGHT;
+    if( envpara ){
+      weight = atoi( envpara );
+      if( weight < 1 ) weight = TILE_REQUEST_WEIGHT;
+    }
+    return weight;
+  }
+
+
+  /// Comma separated list of queue delay thresholds in milliseconds beyond which our output is degraded
+  static std::string getOverloadThresholds(){
+    const char* envpara = getenv( "OVERLOAD_THRESHOLDS" );
+    std::string thresholds;
+    if( envpara ) thresholds = std::string( envpara );
+    else thresholds = OVERLOAD_THRESHOLDS;
+    return thresholds;
+  }
+
 };
 
 
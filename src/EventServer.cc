@@ -0,0 +1,511 @@
+// Event-driven Network Front End Base Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#include "EventServer.h"
+#include "Dispatcher.h"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+
+using namespace std;
+
+
+// Maximum number of events to handle per call to epoll_wait
+#define MAX_EVENTS 256
+
+// Size of our read buffer
+#define READ_SIZE 16384
+
+// Maximum number of output segments gathered into each write
+#define MAX_IOVECS 64
+
+// Queued output in bytes above which we stop reading and parsing new requests from a connection
+#define MAX_OUTPUT 4194304
+
+
+
+// Set a file descriptor to non-blocking mode
+static bool setNonBlocking( int fd )
+{
+  int flags = fcntl( fd, F_GETFL, 0 );
+  if( flags == -1 ) return false;
+  return fcntl( fd, F_SETFL, flags | O_NONBLOCK ) != -1;
+}
+
+
+
+EventServer::EventServer( int socket, unsigned int max ) :
+  maxConnections( max ),
+  listenSocket( socket ),
+  epollfd( -1 ),
+  running( false ),
+  connectionCount( 0 ),
+  scheduler( NULL ),
+  dispatched( false )
+{
+  wakeup[0] = wakeup[1] = -1;
+}
+
+
+
+EventServer::~EventServer()
+{
+  stop();
+
+  for( map<uint64_t,Connection*>::iterator i = connections.begin(); i != connections.end(); ++i ){
+    ::close( i->second->fd );
+    delete i->second;
+  }
+  connections.clear();
+  descriptors.clear();
+
+  if( epollfd != -1 ) ::close( epollfd );
+  if( wakeup[0] != -1 ) ::close( wakeup[0] );
+  if( wakeup[1] != -1 ) ::close( wakeup[1] );
+}
+
+
+
+void EventServer::start()
+{
+  if( running ) return;
+
+  epollfd = epoll_create1( EPOLL_CLOEXEC );
+  if( epollfd == -1 ) throw string( "EventServer :: unable to create epoll instance: " ) + strerror( errno );
+
+  if( pipe( wakeup ) == -1 ) throw string( "EventServer :: unable to create wakeup pipe: " ) + strerror( errno );
+  setNonBlocking( wakeup[0] );
+  setNonBlocking( wakeup[1] );
+
+  // Our listen socket may be shared with other processes, so must be non-blocking
+  if( !setNonBlocking( listenSocket ) ){
+    throw string( "EventServer :: unable to set listen socket to non-blocking: " ) + strerror( errno );
+  }
+
+  struct epoll_event ev;
+  memset( &ev, 0, sizeof(ev) );
+  ev.events = EPOLLIN;
+  ev.data.fd = listenSocket;
+  if( epoll_ctl( epollfd, EPOLL_CTL_ADD, listenSocket, &ev ) == -1 ){
+    throw string( "EventServer :: unable to watch listen socket: " ) + strerror( errno );
+  }
+
+  ev.data.fd = wakeup[0];
+  epoll_ctl( epollfd, EPOLL_CTL_ADD, wakeup[0], &ev );
+
+  running = true;
+  thread = std::thread( &EventServer::run, this );
+}
+
+
+
+void EventServer::stop()
+{
+  // Our network thread may already have stopped itself after an error, but must still be joined
+  if( !running && !thread.joinable() ) return;
+
+  {
+    lock_guard<std::mutex> lock( mutex );
+    running = false;
+  }
+  available.notify_all();
+
+  // Wake up our network thread
+  char c = 0;
+  if( ::write( wakeup[1], &c, 1 ) < 0 ){}
+  if( thread.joinable() ) thread.join();
+}
+
+
+
+shared_ptr<EventRequest> EventServer::next()
+{
+  unique_lock<std::mutex> lock( mutex );
+  shared_ptr<EventRequest> r;
+  available.wait( lock, [this,&r]{
+    if( !running ) return true;
+    r = this->take();
+    return (bool) r;
+  });
+  if( !running ) return shared_ptr<EventRequest>();
+  return r;
+}
+
+
+
+shared_ptr<EventRequest> EventServer::take()
+{
+  int c = Scheduler::INTERACTIVE;
+
+  // Let our scheduler choose among the classes that have a free slot
+  if( scheduler ){
+    bool pending[Scheduler::NUM_CLASSES];
+    for( int n=0; n<Scheduler::NUM_CLASSES; n++ ) pending[n] = !jobs[n].empty();
+    c = scheduler->tryAcquire( pending );
+    if( c == -1 ) return shared_ptr<EventRequest>();
+  }
+  else if( jobs[c].empty() ) return shared_ptr<EventRequest>();
+
+  shared_ptr<EventRequest> r = jobs[c].front();
+  jobs[c].pop_front();
+  r->scheduled = ( scheduler != NULL );
+  return r;
+}
+
+
+
+void EventServer::dispatch( const shared_ptr<EventRequest>& r )
+{
+  r->dispatched = true;
+  r->finalize();
+  r->queued.start();
+  if( scheduler ) r->priority = Scheduler::classify( r->getParam( "QUERY_STRING" ), r->getParam( "REQUEST_URI" ) );
+  {
+    lock_guard<std::mutex> lock( mutex );
+    jobs[r->priority].push_back( r );
+  }
+  available.notify_one();
+}
+
+
+
+void EventServer::send( const shared_ptr<EventRequest>& r, OutputQueue& data, bool end )
+{
+  // Allow our output to be framed without copying it again
+  data.share();
+
+  bool wake;
+  {
+    lock_guard<std::mutex> lock( mutex );
+    wake = outbox.empty();
+    Output o;
+    o.request = r;
+    o.data.swap( data );
+    o.end = end;
+    outbox.push_back( std::move(o) );
+  }
+  data.clear();
+
+  // Release our scheduler slot, which may allow a waiting worker to take a queued request.
+  // This is done under our lock so that the release cannot be missed by a worker in next()
+  if( end && r->scheduled ){
+    r->scheduled = false;
+    {
+      lock_guard<std::mutex> lock( mutex );
+      scheduler->release( r->priority );
+    }
+    available.notify_all();
+  }
+
+  // Only wake our network thread if it is not already due to process the outbox
+  if( wake ){
+    char c = 0;
+    if( ::write( wakeup[1], &c, 1 ) < 0 ){}
+  }
+}
+
+
+
+void EventServer::run()
+{
+  struct epoll_event events[MAX_EVENTS];
+
+  while( running ){
+
+    int n = epoll_wait( epollfd, events, MAX_EVENTS, -1 );
+    if( n == -1 ){
+      if( errno == EINTR ) continue;
+      // We can no longer serve any connection, so release our workers, which then exit
+      {
+	lock_guard<std::mutex> lock( mutex );
+	error = string( "EventServer :: epoll_wait failed: " ) + strerror( errno );
+	running = false;
+      }
+      available.notify_all();
+      break;
+    }
+
+    for( int i=0; i<n; i++ ){
+
+      int fd = events[i].data.fd;
+
+      if( fd == listenSocket ){
+	this->accept();
+	continue;
+      }
+
+      if( fd == wakeup[0] ){
+	char buf[256];
+	while( ::read( wakeup[0], buf, sizeof(buf) ) > 0 ){}
+	this->flushOutbox();
+	continue;
+      }
+
+      map<int,uint64_t>::iterator d = descriptors.find( fd );
+      if( d == descriptors.end() ) continue;
+      Connection* c = connections[d->second];
+
+      bool ok = true;
+      if( events[i].events & (EPOLLIN|EPOLLHUP|EPOLLERR) ) ok = this->read( *c );
+      // Write any pending output, which may also have been generated directly by our parser
+      if( ok && ( (events[i].events & EPOLLOUT) || !c->output.empty() ) ) ok = this->write( *c );
+      if( !ok ) this->close( c );
+    }
+  }
+}
+
+
+
+void EventServer::accept()
+{
+  while( true ){
+
+    int fd = dispatched ? Dispatcher::receive( listenSocket ) : ::accept( listenSocket, NULL, NULL );
+    if( fd == -1 ){
+      // Stop watching a channel whose dispatcher has gone away
+      if( dispatched && errno == EPIPE ) epoll_ctl( epollfd, EPOLL_CTL_DEL, listenSocket, NULL );
+      return;   // EAGAIN or another process accepted the connection
+    }
+
+    if( connections.size() >= maxConnections || !setNonBlocking( fd ) ){
+      ::close( fd );
+      continue;
+    }
+
+    Connection* c = new Connection;
+    c->fd = fd;
+    c->id = ++connectionCount;
+
+    struct epoll_event ev;
+    memset( &ev, 0, sizeof(ev) );
+    ev.events = c->events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = fd;
+    if( epoll_ctl( epollfd, EPOLL_CTL_ADD, fd, &ev ) == -1 ){
+      ::close( fd );
+      delete c;
+      continue;
+    }
+
+    connections[c->id] = c;
+    descriptors[fd] = c->id;
+  }
+}
+
+
+
+bool EventServer::read( Connection& c )
+{
+  // We only stop watching for input once the client has shut down its side of
+  // the connection, so a further event means the connection has failed
+  if( c.readClosed ) return false;
+
+  char buf[READ_SIZE];
+
+  while( true ){
+    ssize_t n = ::read( c.fd, buf, READ_SIZE );
+    if( n > 0 ){
+      c.input.append( buf, n );
+      continue;
+    }
+    // Client has shut down its side of the connection, but may still be waiting for our responses
+    if( n == 0 ){
+      c.readClosed = true;
+      break;
+    }
+    if( errno == EINTR ) continue;
+    if( errno == EAGAIN || errno == EWOULDBLOCK ) break;
+    return false;
+  }
+
+  if( !this->receive( c ) ) return false;
+
+  // Close immediately if there is nothing left to send
+  if( c.closeAfterWrite && c.requests.empty() && c.output.empty() ) return false;
+  return true;
+}
+
+
+
+bool EventServer::receive( Connection& c )
+{
+  // Leave any further requests unparsed while a slow client has too much output queued
+  c.throttled = ( c.output.size() > MAX_OUTPUT );
+
+  if( !c.throttled ){
+
+    if( !this->parse( c ) ) return false;
+
+    if( c.readClosed ){
+      // Requests still being received can now never complete
+      for( map<unsigned int,shared_ptr<EventRequest> >::iterator i = c.requests.begin(); i != c.requests.end(); ){
+	if( i->second->dispatched ) ++i;
+	else c.requests.erase( i++ );
+      }
+      // Close once the requests already in progress have completed
+      if( c.requests.empty() ) c.closeAfterWrite = true;
+    }
+  }
+
+  this->watch( c );
+  return true;
+}
+
+
+
+bool EventServer::write( Connection& c )
+{
+  while( !c.output.empty() ){
+
+    // Gather our output segments, including any shared tile data, into a single write
+    struct iovec iov[MAX_IOVECS];
+    size_t count = 0;
+    for( ; count < c.output.segments.size() && count < MAX_IOVECS; count++ ){
+      const OutputSegment& s = c.output.segments[count];
+      size_t offset = ( count == 0 ) ? c.written : 0;
+      iov[count].iov_base = (void*)( s.begin() + offset );
+      iov[count].iov_len = s.size() - offset;
+    }
+
+    struct msghdr msg;
+    memset( &msg, 0, sizeof(msg) );
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    ssize_t n = ::sendmsg( c.fd, &msg, MSG_NOSIGNAL );
+    if( n > 0 ){
+      // Release the segments that have been written in full
+      size_t sent = n;
+      while( sent > 0 ){
+	size_t remaining = c.output.segments.front().size() - c.written;
+	if( sent < remaining ){
+	  c.written += sent;
+	  break;
+	}
+	sent -= remaining;
+	c.written = 0;
+	c.output.segments.pop_front();
+      }
+      continue;
+    }
+    if( n == -1 && errno == EINTR ) continue;
+    if( n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) ){
+      // Wait until the socket becomes writable
+      c.writing = true;
+      this->watch( c );
+      return true;
+    }
+    return false;
+  }
+
+  c.output.clear();
+  c.written = 0;
+  c.writing = false;
+
+  // Resume parsing any requests we held back while our output was queued
+  if( c.throttled ){
+    if( !this->receive( c ) ) return false;
+    if( !c.output.empty() ) return this->write( c );
+  }
+  else this->watch( c );
+
+  // A client that has shut down its side of the connection cannot send any further requests
+  if( ( c.closeAfterWrite || c.readClosed ) && c.requests.empty() ) return false;
+  return true;
+}
+
+
+
+void EventServer::watch( Connection& c )
+{
+  // Stop reading once the client has shut down its side of the connection or while we are throttled
+  uint32_t events = ( c.readClosed || c.throttled ) ? 0 : ( EPOLLIN | EPOLLRDHUP );
+  if( c.writing ) events |= (uint32_t) EPOLLOUT;
+  if( events == c.events ) return;
+
+  struct epoll_event ev;
+  memset( &ev, 0, sizeof(ev) );
+  ev.events = events;
+  ev.data.fd = c.fd;
+  epoll_ctl( epollfd, EPOLL_CTL_MOD, c.fd, &ev );
+  c.events = events;
+}
+
+
+
+void EventServer::close( Connection* c )
+{
+  // Abort any requests still being processed so that our workers can stop early
+  for( map<unsigned int,shared_ptr<EventRequest> >::iterator i = c->requests.begin(); i != c->requests.end(); ++i ){
+    i->second->aborted = true;
+  }
+
+  epoll_ctl( epollfd, EPOLL_CTL_DEL, c->fd, NULL );
+  ::close( c->fd );
+  descriptors.erase( c->fd );
+  connections.erase( c->id );
+  delete c;
+}
+
+
+
+void EventServer::flushOutbox()
+{
+  deque<Output> items;
+  {
+    lock_guard<std::mutex> lock( mutex );
+    items.swap( outbox );
+  }
+
+  // Keep track of the connections we need to write to
+  map<uint64_t,Connection*> touched;
+
+  for( deque<Output>::iterator i = items.begin(); i != items.end(); ++i ){
+
+    // Discard output for connections that have since been closed
+    map<uint64_t,Connection*>::iterator ci = connections.find( i->request->connection );
+    if( ci == connections.end() ) continue;
+    Connection* c = ci->second;
+
+    // And for requests that are no longer active
+    map<unsigned int,shared_ptr<EventRequest> >::iterator ri = c->requests.find( i->request->id );
+    if( ri == c->requests.end() || ri->second != i->request ) continue;
+
+    this->frame( *c, *(i->request), i->data, i->end );
+
+    if( i->end ){
+      if( !i->request->keepConnection ) c->closeAfterWrite = true;
+      c->requests.erase( ri );
+      this->completed( *c );
+    }
+
+    touched[c->id] = c;
+  }
+
+  for( map<uint64_t,Connection*>::iterator i = touched.begin(); i != touched.end(); ++i ){
+    if( !this->write( *(i->second) ) ) this->close( i->second );
+  }
+}
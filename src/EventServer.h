@@ -0,0 +1,543 @@
+// Event-driven Network Front End Base Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef _EVENTSERVER_H
+#define _EVENTSERVER_H
+
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+#include "Writer.h"
+#include "Scheduler.h"
+#include "Timer.h"
+
+
+
+/// A single request received by an EventServer
+/** Requests are parsed by the network thread and then handed to a worker thread
+    for processing. Request parameters are stored in CGI "NAME=value" form with
+    a NULL-terminated envp array, so that they can be queried with FCGX_GetParam()
+    exactly as for requests accepted through libfcgi.
+ */
+class EventRequest {
+
+ public:
+
+  /// Identifier of the connection on which this request arrived
+  uint64_t connection;
+
+  /// Protocol level request identifier
+  unsigned int id;
+
+  /// Parameters in "NAME=value" form
+  std::vector<std::string> params;
+
+  /// NULL-terminated array of pointers to our parameters
+  std::vector<char*> envp;
+
+  /// Request body
+  std::string content;
+
+  /// Whether the connection should remain open after this request
+  bool keepConnection;
+
+  /// Set if the client has aborted the request or closed the connection
+  std::atomic<bool> aborted;
+
+  /// Scheduling class of this request
+  Scheduler::Class priority;
+
+  /// Whether this request holds a scheduler slot
+  bool scheduled;
+
+  /// Whether the request has been handed to our workers
+  bool dispatched;
+
+  /// Timer started when the request is queued for our workers
+  Timer queued;
+
+
+  /// Constructor
+  EventRequest() : connection( 0 ), id( 0 ), keepConnection( false ), aborted( false ),
+    priority( Scheduler::INTERACTIVE ), scheduled( false ), dispatched( false ) {};
+
+  /// Add a parameter
+  /** @param name parameter name
+      @param value parameter value
+   */
+  void addParam( const std::string& name, const std::string& value ){
+    params.push_back( name + "=" + value );
+  };
+
+  /// Get the value of a parameter
+  /** @param name parameter name
+      @return value or an empty string if not set
+   */
+  std::string getParam( const std::string& name ) const {
+    for( unsigned int i=0; i<params.size(); i++ ){
+      if( params[i].size() > name.size() && params[i][name.size()] == '=' &&
+	  params[i].compare( 0, name.size(), name ) == 0 ) return params[i].substr( name.size() + 1 );
+    }
+    return std::string();
+  };
+
+  /// Build our envp array. Must be called once all parameters have been added
+  void finalize(){
+    envp.clear();
+    for( unsigned int i=0; i<params.size(); i++ ) envp.push_back( &params[i][0] );
+    envp.push_back( NULL );
+  };
+
+};
+
+
+
+/// A block of output data
+/** Data is either held in our own buffer or is a slice of a buffer shared with
+    another owner, such as a tile held in our tile cache, which is kept alive by
+    owner until the data has been written to the client
+ */
+struct OutputSegment {
+  std::shared_ptr<void> owner;  ///< Owner of shared data or empty if our data is held in buffer
+  const char* data;             ///< Start of shared data
+  size_t length;                ///< Length of shared data
+  std::string buffer;           ///< Our own data
+  OutputSegment() : data( NULL ), length( 0 ) {};
+  /// Return the start of our data
+  const char* begin() const { return owner ? data : buffer.data(); };
+  /// Return the length of our data
+  size_t size() const { return owner ? length : buffer.size(); };
+};
+
+
+
+/// Queue of output data, which is written out with a single gathering write
+/** Small writes are copied and coalesced into buffers of our own, while shared
+    data is referenced in place, so that cached tiles are written to the client
+    directly from the buffer held by our tile cache
+ */
+class OutputQueue {
+
+ public:
+
+  /// Our segments in order
+  std::deque<OutputSegment> segments;
+
+  /// Append a copy of some data
+  /** @param data data
+      @param length length in bytes
+   */
+  void append( const char* data, size_t length ){
+    if( length == 0 ) return;
+    if( segments.empty() || segments.back().owner ) segments.push_back( OutputSegment() );
+    segments.back().buffer.append( data, length );
+  };
+
+  /// Append a copy of a string
+  /** @param s string */
+  void append( const std::string& s ){ append( s.data(), s.size() ); };
+
+  /// Append a reference to shared data
+  /** @param owner owner of data, which is kept alive until written
+      @param data data
+      @param length length in bytes
+   */
+  void append( const std::shared_ptr<void>& owner, const char* data, size_t length ){
+    if( length == 0 ) return;
+    if( !owner ){
+      append( data, length );
+      return;
+    }
+    segments.push_back( OutputSegment() );
+    segments.back().owner = owner;
+    segments.back().data = data;
+    segments.back().length = length;
+  };
+
+  /// Append part of a segment, referencing it if it is shared and copying it otherwise
+  /** @param s segment
+      @param offset offset within segment
+      @param length length in bytes
+   */
+  void append( const OutputSegment& s, size_t offset, size_t length ){
+    if( s.owner ) append( s.owner, s.data + offset, length );
+    else append( s.buffer.data() + offset, length );
+  };
+
+  /// Append all the segments of another queue
+  /** @param q queue */
+  void append( const OutputQueue& q ){
+    for( size_t i=0; i<q.segments.size(); i++ ) append( q.segments[i], 0, q.segments[i].size() );
+  };
+
+  /// Move the data of our own buffers into shared buffers
+  /** Slices of our segments can then be referenced rather than copied when our
+      output is framed. No data is copied */
+  void share(){
+    for( size_t i=0; i<segments.size(); i++ ){
+      OutputSegment& s = segments[i];
+      if( s.owner ) continue;
+      std::shared_ptr<std::string> b = std::make_shared<std::string>();
+      b->swap( s.buffer );
+      s.data = b->data();
+      s.length = b->size();
+      s.owner = b;
+    }
+  };
+
+  /// Return the total length of our data
+  size_t size() const {
+    size_t total = 0;
+    for( size_t i=0; i<segments.size(); i++ ) total += segments[i].size();
+    return total;
+  };
+
+  /// Return whether we hold no data
+  bool empty() const { return segments.empty(); };
+
+  /// Remove all our data
+  void clear(){ segments.clear(); };
+
+  /// Exchange our data with another queue
+  void swap( OutputQueue& q ){ segments.swap( q.segments ); };
+
+};
+
+
+
+/// Base class for event-driven network front ends
+/** A single network thread multiplexes the listen socket and all client
+    connections using epoll with non-blocking sockets. Complete requests are
+    queued for worker threads, which collect them using next(). Output from the
+    workers is passed back to the network thread via send(), buffered per
+    connection and written out as the socket becomes writable. Slow clients
+    therefore never block the worker threads.
+
+    Protocol specific parsing and output framing are implemented by subclasses.
+ */
+class EventServer {
+
+ protected:
+
+  /// Client connection state. Only ever accessed from the network thread
+  struct Connection {
+    int fd;                         ///< Socket file descriptor
+    uint64_t id;                    ///< Unique connection identifier
+    std::string input;              ///< Unparsed input data
+    OutputQueue output;             ///< Output data waiting to be written
+    size_t written;                 ///< Bytes of the first output segment already written
+    bool closeAfterWrite;           ///< Close once all output has been written
+    bool writing;                   ///< Whether we are waiting for the socket to become writable
+    bool readClosed;                ///< Whether the client has shut down its side of the connection
+    bool throttled;                 ///< Whether parsing is suspended until our output queue drains
+    uint32_t events;                ///< Epoll events we are currently waiting for
+    /// Requests being received or processed on this connection
+    std::map< unsigned int, std::shared_ptr<EventRequest> > requests;
+    Connection() : fd( -1 ), id( 0 ), written( 0 ), closeAfterWrite( false ), writing( false ),
+      readClosed( false ), throttled( false ), events( 0 ) {};
+  };
+
+
+  /// Parse the input buffer of a connection
+  /** Subclasses should consume complete protocol units from c.input and call
+      dispatch() for each complete request
+      @param c connection
+      @return false on a protocol error, in which case the connection is closed
+   */
+  virtual bool parse( Connection& c ) = 0;
+
+  /// Frame worker output for transmission
+  /** Subclasses should append the framed data to c.output, referencing rather
+      than copying the shared segments of our output data
+      @param c connection
+      @param r request to which the output belongs
+      @param data output data, all of whose segments are shared
+      @param end whether this is the end of the response
+   */
+  virtual void frame( Connection& c, EventRequest& r, const OutputQueue& data, bool end ) = 0;
+
+  /// Called after a request has completed and been removed from its connection
+  /** @param c connection */
+  virtual void completed( Connection& c ){ (void) c; };
+
+  /// Parse any input received on a connection unless its output queue is too long
+  /** Reading is suspended while a slow client leaves too much output queued and
+      resumes once it has been written out
+      @param c connection
+      @return false on a protocol error, in which case the connection is closed
+   */
+  bool receive( Connection& c );
+
+  /// Queue a complete request for our worker threads
+  /** @param r request */
+  void dispatch( const std::shared_ptr<EventRequest>& r );
+
+  /// Maximum number of simultaneous connections
+  unsigned int maxConnections;
+
+
+ private:
+
+  /// Output posted by a worker thread
+  struct Output {
+    std::shared_ptr<EventRequest> request;
+    OutputQueue data;
+    bool end;
+  };
+
+  /// Listen socket
+  int listenSocket;
+
+  /// epoll file descriptor
+  int epollfd;
+
+  /// Pipe used to wake our network thread
+  int wakeup[2];
+
+  /// Network thread
+  std::thread thread;
+
+  /// Whether we are running
+  std::atomic<bool> running;
+
+  /// Error that stopped our network thread, if any
+  std::string error;
+
+  /// Counter used for connection identifiers
+  uint64_t connectionCount;
+
+  /// Open connections indexed by identifier
+  std::map< uint64_t, Connection* > connections;
+
+  /// Connection identifiers indexed by file descriptor
+  std::map< int, uint64_t > descriptors;
+
+  /// Requests waiting for a worker, queued per scheduling class
+  std::deque< std::shared_ptr<EventRequest> > jobs[Scheduler::NUM_CLASSES];
+
+  /// Optional scheduler controlling the order in which queued requests are processed
+  Scheduler* scheduler;
+
+  /// Whether connections are passed to us by a Dispatcher rather than accepted
+  bool dispatched;
+
+  /// Output waiting for our network thread
+  std::deque< Output > outbox;
+
+  /// Take the next request that may be processed. Must be called with the lock held
+  /** @return request or an empty pointer if none may currently start */
+  std::shared_ptr<EventRequest> take();
+
+  /// Mutex protecting jobs and outbox
+  std::mutex mutex;
+
+  /// Condition variable signalling new jobs
+  std::condition_variable available;
+
+
+  /// Main network loop
+  void run();
+
+  /// Accept new connections
+  void accept();
+
+  /// Read from a connection
+  /** @return false if the connection should be closed */
+  bool read( Connection& c );
+
+  /// Write pending output to a connection
+  /** @return false if the connection should be closed */
+  bool write( Connection& c );
+
+  /// Close a connection and abort any requests still in progress
+  void close( Connection* c );
+
+  /// Process output posted by our workers
+  void flushOutbox();
+
+  /// Update the epoll events we wait for on a connection to match its state
+  void watch( Connection& c );
+
+
+ public:
+
+  /// Constructor
+  /** @param socket listen socket on which to accept connections
+      @param max maximum number of simultaneous connections
+   */
+  EventServer( int socket, unsigned int max = 1024 );
+
+  /// Destructor
+  virtual ~EventServer();
+
+  /// Return a description of the protocol
+  virtual const char* getDescription() const = 0;
+
+  /// Set a scheduler to prioritize our queued requests. Must be called before start()
+  /** @param s scheduler */
+  void setScheduler( Scheduler* s ){ scheduler = s; };
+
+  /// Receive connections from a Dispatcher over our socket rather than accepting them. Must be called before start()
+  /** @param d whether our socket is a Dispatcher channel */
+  void setDispatched( bool d ){ dispatched = d; };
+
+  /// Start our network thread. Throws a string on error
+  void start();
+
+  /// Stop our network thread and release any waiting workers
+  void stop();
+
+  /// Return the error that stopped our network thread
+  /** Only valid once next() has returned an empty pointer
+      @return error or an empty string if we were stopped with stop() */
+  std::string getError() const { return error; };
+
+  /// Get the next request to be processed, blocking until one is available
+  /** If a scheduler has been set, requests are taken from the class queues in the
+      order determined by the scheduler and only when the class has a free slot
+      @return request or an empty pointer if the server has been stopped */
+  std::shared_ptr<EventRequest> next();
+
+  /// Send output for a request
+  /** Can be called from any thread
+      @param r request
+      @param data output data, which is moved out of the queue
+      @param end whether this is the end of the response
+   */
+  void send( const std::shared_ptr<EventRequest>& r, OutputQueue& data, bool end );
+
+};
+
+
+
+/// Writer class for output to an EventServer
+/** Output is accumulated locally and handed to the network thread on each flush.
+    Blocks passed to putV() together with their owner, such as cached tiles, are
+    referenced rather than copied and are written to the client from their own buffer */
+class EventWriter : public Writer {
+
+ private:
+
+  /// Server to which output is sent
+  EventServer *server;
+
+  /// Request to which output belongs
+  std::shared_ptr<EventRequest> request;
+
+  /// Output not yet passed to our server
+  OutputQueue pending;
+
+  /// Whether finish() has been called
+  bool finished;
+
+
+ public:
+
+  /// Constructor
+  /** @param s EventServer
+      @param r request
+   */
+  EventWriter( EventServer *s, const std::shared_ptr<EventRequest>& r ) :
+    server( s ), request( r ), finished( false ) {};
+
+  /// Destructor - makes sure our response is always completed
+  ~EventWriter(){ finish(); };
+
+  /// Set a cancellation token, which is also cancelled if the client aborts the request
+  /** @param t cancellation token */
+  void setCancellationToken( CancellationToken* t ){
+    token = t;
+    if( token ) token->watch( &request->aborted );
+  };
+
+  /// Add the message to our buffer
+  /** @param msg message string
+      @param len message length in bytes
+      @return number of bytes written or -1 if the request has been aborted
+   */
+  int putStr( const char* msg, int len ){
+    if( request->aborted ) return fail();
+    cpy2buf( msg, len );
+    pending.append( msg, len );
+    return len;
+  };
+
+  /// Add several blocks of data to our output, referencing rather than copying those with an owner
+  /** @param blocks array of blocks
+      @param n number of blocks
+      @return total number of bytes written or -1 if the request has been aborted
+   */
+  int putV( const Block* blocks, int n ){
+    if( request->aborted ) return fail();
+    size_t total = 0;
+    for( int i=0; i<n; i++ ){
+      cpy2buf( blocks[i].data, blocks[i].length );
+      pending.append( blocks[i].owner, blocks[i].data, blocks[i].length );
+      total += blocks[i].length;
+    }
+    return (int) total;
+  };
+
+  /// Write out a string using puts()
+  /** @param msg message string
+      @return number of bytes written or -1 if the request has been aborted
+   */
+  int putS( const char* msg ){
+    return putStr( msg, (int) strlen( msg ) );
+  };
+
+  /// Write out a string using printf()
+  /** @param msg message string
+      @return number of bytes written or -1 if the request has been aborted
+   */
+  int printf( const char* msg ){
+    return putStr( msg, (int) strlen( msg ) );
+  };
+
+  /// Flush the output buffer
+  /** @return 0 = success, -1 = request aborted */
+  int flush(){
+    if( request->aborted ) return fail();
+    if( !pending.empty() ) server->send( request, pending, false );
+    return 0;
+  };
+
+  /// Send any remaining output and mark the response as complete
+  void finish(){
+    if( finished ) return;
+    finished = true;
+    server->send( request, pending, true );
+  };
+
+};
+
+
+#endif
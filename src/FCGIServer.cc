@@ -0,0 +1,317 @@
+// Event-driven FastCGI Front End Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#include "FCGIServer.h"
+
+#include <sstream>
+#include <cstring>
+#include <fastcgi.h>
+
+
+using namespace std;
+
+
+// Maximum size of request body we accept via FCGI_STDIN
+#define MAX_CONTENT_LENGTH 16777216
+
+// Maximum content length of a record, kept to a multiple of 8 bytes
+#define MAX_RECORD_LENGTH 65528
+
+
+
+// Padding appended to our records
+static const char PADDING[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+
+
+void FCGIServer::header( Connection& c, unsigned char type, unsigned int id, size_t length )
+{
+  // Pad our records to a multiple of 8 bytes as recommended by the specification
+  unsigned char padding = (unsigned char)( (8 - (length % 8)) % 8 );
+
+  FCGI_Header header;
+  header.version = FCGI_VERSION_1;
+  header.type = type;
+  header.requestIdB1 = (unsigned char)( (id >> 8) & 0xff );
+  header.requestIdB0 = (unsigned char)( id & 0xff );
+  header.contentLengthB1 = (unsigned char)( (length >> 8) & 0xff );
+  header.contentLengthB0 = (unsigned char)( length & 0xff );
+  header.paddingLength = padding;
+  header.reserved = 0;
+
+  c.output.append( (const char*) &header, FCGI_HEADER_LEN );
+}
+
+
+
+void FCGIServer::record( Connection& c, unsigned char type, unsigned int id, const char* data, size_t length )
+{
+  this->header( c, type, id, length );
+  c.output.append( data, length );
+  c.output.append( PADDING, (8 - (length % 8)) % 8 );
+}
+
+
+
+void FCGIServer::endRequest( Connection& c, unsigned int id, unsigned char status )
+{
+  FCGI_EndRequestBody body;
+  memset( &body, 0, sizeof(body) );
+  body.protocolStatus = status;
+  this->record( c, FCGI_END_REQUEST, id, (const char*) &body, sizeof(body) );
+}
+
+
+
+bool FCGIServer::decodeParams( const string& data, EventRequest& r )
+{
+  const unsigned char* p = (const unsigned char*) data.data();
+  size_t n = 0;
+  const size_t len = data.size();
+
+  while( n < len ){
+
+    size_t lengths[2];
+
+    // Name and value lengths are encoded using either 1 or 4 bytes
+    for( int k=0; k<2; k++ ){
+      if( n >= len ) return false;
+      if( p[n] & 0x80 ){
+	if( n+4 > len ) return false;
+	lengths[k] = ((size_t)(p[n] & 0x7f) << 24) | ((size_t)p[n+1] << 16) | ((size_t)p[n+2] << 8) | p[n+3];
+	n += 4;
+      }
+      else lengths[k] = p[n++];
+    }
+
+    if( n + lengths[0] + lengths[1] > len ) return false;
+
+    string name( (const char*) &p[n], lengths[0] );
+    n += lengths[0];
+    string value( (const char*) &p[n], lengths[1] );
+    n += lengths[1];
+
+    r.addParam( name, value );
+  }
+
+  return true;
+}
+
+
+
+void FCGIServer::getValues( Connection& c, const string& data )
+{
+  EventRequest query;
+  if( !this->decodeParams( data, query ) ) return;
+
+  // Encode our replies. All values and names are short, so 1 byte lengths suffice
+  string reply;
+  for( unsigned int i=0; i<query.params.size(); i++ ){
+
+    string name = query.params[i].substr( 0, query.params[i].find( '=' ) );
+    stringstream value;
+
+    if( name == FCGI_MAX_CONNS ) value << maxConnections;
+    else if( name == FCGI_MAX_REQS ) value << maxConnections * maxRequests;
+    else if( name == FCGI_MPXS_CONNS ) value << "1";
+    else continue;
+
+    reply += (char) name.size();
+    reply += (char) value.str().size();
+    reply += name + value.str();
+  }
+
+  this->record( c, FCGI_GET_VALUES_RESULT, FCGI_NULL_REQUEST_ID, reply.data(), reply.size() );
+}
+
+
+
+bool FCGIServer::parse( Connection& c )
+{
+  size_t n = 0;
+
+  // Process all complete records
+  while( c.input.size() - n >= FCGI_HEADER_LEN ){
+
+    const FCGI_Header* header = (const FCGI_Header*) ( c.input.data() + n );
+    if( header->version != FCGI_VERSION_1 ) return false;
+
+    unsigned int id = (header->requestIdB1 << 8) | header->requestIdB0;
+    size_t length = (header->contentLengthB1 << 8) | header->contentLengthB0;
+    size_t total = FCGI_HEADER_LEN + length + header->paddingLength;
+
+    if( c.input.size() - n < total ) break;
+
+    unsigned char type = header->type;
+    string content( c.input.data() + n + FCGI_HEADER_LEN, length );
+    n += total;
+
+
+    // Management records
+    if( id == FCGI_NULL_REQUEST_ID ){
+      if( type == FCGI_GET_VALUES ) this->getValues( c, content );
+      else{
+	FCGI_UnknownTypeBody body;
+	memset( &body, 0, sizeof(body) );
+	body.type = type;
+	this->record( c, FCGI_UNKNOWN_TYPE, FCGI_NULL_REQUEST_ID, (const char*) &body, sizeof(body) );
+      }
+      continue;
+    }
+
+
+    map<unsigned int,shared_ptr<EventRequest> >::iterator ri = c.requests.find( id );
+
+    switch( type ){
+
+      case FCGI_BEGIN_REQUEST:
+      {
+	if( length < sizeof(FCGI_BeginRequestBody) ) return false;
+	const FCGI_BeginRequestBody* body = (const FCGI_BeginRequestBody*) content.data();
+	unsigned int role = (body->roleB1 << 8) | body->roleB0;
+
+	// Ignore duplicate request IDs
+	if( ri != c.requests.end() ) break;
+
+	if( role != FCGI_RESPONDER ){
+	  this->endRequest( c, id, FCGI_UNKNOWN_ROLE );
+	  break;
+	}
+	if( c.requests.size() >= maxRequests ){
+	  this->endRequest( c, id, FCGI_OVERLOADED );
+	  break;
+	}
+
+	shared_ptr<FCGIRequest> r = make_shared<FCGIRequest>();
+	r->connection = c.id;
+	r->id = id;
+	r->keepConnection = body->flags & FCGI_KEEP_CONN;
+	c.requests[id] = r;
+	break;
+      }
+
+      case FCGI_PARAMS:
+      {
+	if( ri == c.requests.end() ) break;
+	FCGIRequest* r = static_cast<FCGIRequest*>( ri->second.get() );
+	if( r->paramsComplete ) break;
+	if( length > 0 ){
+	  r->paramData.append( content );
+	  if( r->paramData.size() > MAX_CONTENT_LENGTH ) return false;
+	}
+	else{
+	  // An empty record marks the end of the stream
+	  r->paramsComplete = true;
+	  bool ok = this->decodeParams( r->paramData, *r );
+	  r->paramData.clear();
+	  if( !ok ) return false;
+	}
+	break;
+      }
+
+      case FCGI_STDIN:
+      {
+	if( ri == c.requests.end() ) break;
+	FCGIRequest* r = static_cast<FCGIRequest*>( ri->second.get() );
+	if( r->dispatched ) break;
+	if( length > 0 ){
+	  r->content.append( content );
+	  if( r->content.size() > MAX_CONTENT_LENGTH ) return false;
+	}
+	else if( r->paramsComplete ){
+	  // The request is complete once both the parameter and input streams have ended
+	  this->dispatch( ri->second );
+	}
+	break;
+      }
+
+      case FCGI_ABORT_REQUEST:
+      {
+	if( ri == c.requests.end() ) break;
+	FCGIRequest* r = static_cast<FCGIRequest*>( ri->second.get() );
+	r->aborted = true;
+	// If the request has not yet been handed to a worker, we can end it immediately.
+	// Otherwise, the worker will stop writing and complete the request itself
+	if( !r->dispatched ){
+	  bool keep = r->keepConnection;
+	  c.requests.erase( ri );
+	  this->endRequest( c, id, FCGI_REQUEST_COMPLETE );
+	  if( !keep ) c.closeAfterWrite = true;
+	}
+	break;
+      }
+
+      case FCGI_DATA:
+	// Only used by the filter role, so can be ignored
+	break;
+
+      default:
+      {
+	FCGI_UnknownTypeBody body;
+	memset( &body, 0, sizeof(body) );
+	body.type = type;
+	this->record( c, FCGI_UNKNOWN_TYPE, FCGI_NULL_REQUEST_ID, (const char*) &body, sizeof(body) );
+      }
+    }
+  }
+
+  // Remove the records we have consumed
+  if( n > 0 ) c.input.erase( 0, n );
+
+  return true;
+}
+
+
+
+void FCGIServer::frame( Connection& c, EventRequest& r, const OutputQueue& data, bool end )
+{
+  // Drop any further output for aborted requests
+  if( !r.aborted ){
+    // Our records reference the slices of our output segments they contain rather than copying them
+    size_t total = data.size();
+    size_t segment = 0, offset = 0;
+    for( size_t n=0; n<total; n+=MAX_RECORD_LENGTH ){
+      size_t len = total - n;
+      if( len > MAX_RECORD_LENGTH ) len = MAX_RECORD_LENGTH;
+      this->header( c, FCGI_STDOUT, r.id, len );
+      for( size_t remaining = len; remaining > 0; ){
+	const OutputSegment& s = data.segments[segment];
+	size_t l = s.size() - offset;
+	if( l > remaining ) l = remaining;
+	c.output.append( s, offset, l );
+	remaining -= l;
+	offset += l;
+	if( offset == s.size() ){
+	  segment++;
+	  offset = 0;
+	}
+      }
+      c.output.append( PADDING, (8 - (len % 8)) % 8 );
+    }
+  }
+
+  if( end ){
+    // Close our output stream and end the request
+    this->record( c, FCGI_STDOUT, r.id, NULL, 0 );
+    this->endRequest( c, r.id, FCGI_REQUEST_COMPLETE );
+  }
+}
@@ -0,0 +1,115 @@
+// Event-driven FastCGI Front End Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef _FCGISERVER_H
+#define _FCGISERVER_H
+
+
+#include "EventServer.h"
+
+
+
+/// Event-driven implementation of the FastCGI responder protocol
+/** Implements the FastCGI record layer directly on top of EventServer rather
+    than through libfcgi. Multiple requests may be multiplexed over a single
+    connection (FCGI_MPXS_CONNS) and are processed concurrently by our worker
+    threads. Connections are kept open between requests if the web server sets
+    the FCGI_KEEP_CONN flag.
+ */
+class FCGIServer : public EventServer {
+
+ private:
+
+  /// FastCGI request state while records are still being received
+  class FCGIRequest : public EventRequest {
+  public:
+    std::string paramData;      ///< Raw name-value pair data
+    bool paramsComplete;        ///< Whether the FCGI_PARAMS stream has ended
+    FCGIRequest() : paramsComplete( false ) {};
+  };
+
+  /// Maximum number of requests that may be in progress per connection
+  unsigned int maxRequests;
+
+
+  /// Append a FastCGI record header to a connection's output
+  /** The record content and its padding must then be appended
+      @param c connection
+      @param type record type
+      @param id request ID
+      @param length content length (max 65535 bytes)
+   */
+  void header( Connection& c, unsigned char type, unsigned int id, size_t length );
+
+  /// Append a FastCGI record to a connection's output
+  /** @param c connection
+      @param type record type
+      @param id request ID
+      @param data record content
+      @param length content length (max 65535 bytes)
+   */
+  void record( Connection& c, unsigned char type, unsigned int id, const char* data, size_t length );
+
+  /// Send an FCGI_END_REQUEST record
+  /** @param c connection
+      @param id request ID
+      @param status protocol status
+   */
+  void endRequest( Connection& c, unsigned int id, unsigned char status );
+
+  /// Handle an FCGI_GET_VALUES management record
+  void getValues( Connection& c, const std::string& data );
+
+
+ protected:
+
+  /// Parse FastCGI records
+  bool parse( Connection& c );
+
+  /// Frame output as FCGI_STDOUT records
+  void frame( Connection& c, EventRequest& r, const OutputQueue& data, bool end );
+
+
+ public:
+
+  /// Constructor
+  /** @param socket listen socket
+      @param max maximum number of simultaneous connections
+      @param requests maximum number of requests in progress per connection
+   */
+  FCGIServer( int socket, unsigned int max = 1024, unsigned int requests = 256 ) :
+    EventServer( socket, max ), maxRequests( requests ) {};
+
+  /// Return a description of the protocol
+  const char* getDescription() const { return "FastCGI"; };
+
+  /// Decode a block of FastCGI name-value pairs into a request
+  /** @param data raw name-value pair data
+      @param r request into which parameters are added
+      @return false if the data is malformed
+   */
+  static bool decodeParams( const std::string& data, EventRequest& r );
+
+};
+
+
+#endif
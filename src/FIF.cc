@@ -1,7 +1,7 @@
 /*
     IIP FIF Command Handler Class Member Function
 
-    Copyright (C) 2006-2023 Ruven Pillay.
+    Copyright (C) 2006-2026 Ruven Pillay.
 
     This program is free software; you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -92,8 +92,7 @@ void FIF::run( Session* session, const string& src ){
     else{
 
       // Cache Hit
-      if( session->imageCache->find(argument) != session->imageCache->end() ){
-	test = (*session->imageCache)[ argument ];
+      if( session->imageCache->get( argument, test ) ){
 	timestamp = test.timestamp;       // Record timestamp if we have a cached image
 	if( session->loglevel >= 2 ){
 	  *(session->logfile) << "FIF :: Image metadata cache hit" << endl;
@@ -112,14 +111,6 @@ void FIF::run( Session* session, const string& src ){
 	test.setFileSystemPrefix( FIF::filesystem_prefix );
 	test.setFileSystemSuffix( FIF::filesystem_suffix );
 	test.Initialise();
-
-	// Delete items if our metadata cache becomes too large - unless we have set cache size to -1 (unlimited)
-	if( FIF::max_metadata_cache_size > 0 ){
-	  while( session->imageCache->size() >= (unsigned long) FIF::max_metadata_cache_size ){
-	    session->imageCache->erase( session->imageCache->begin() );
-	  }
-	}
-
       }
     }
 
@@ -156,6 +147,10 @@ void FIF::run( Session* session, const string& src ){
     else throw string( "Unsupported image type: " + argument );
 
 
+    // Allow decoding to be abandoned if our client goes away
+    (*session->image)->setCancellationToken( session->cancellation );
+
+
     // Open image and update timestamp
     Timer function_timer;
     if( session->loglevel >= 3 ) function_timer.start();
@@ -174,6 +169,16 @@ void FIF::run( Session* session, const string& src ){
       (*session->image)->loadImageInfo( (*session->image)->currentX, (*session->image)->currentY );
     }
 
+    // Drop all tiles of a previous version of this image at once rather than leaving them to be
+    // found to be stale one by one. Tiles can only be stale without our knowing if the metadata
+    // was not cached, in which case we compare with the timestamp recorded by the tile cache
+    unsigned int purged = 0;
+    if( timestamp == -1 ) purged = session->tileCache->purge( argument );
+    else if( timestamp == 0 ) purged = session->tileCache->expire( argument, (*session->image)->timestamp );
+    if( purged > 0 && session->loglevel >= 2 ){
+      *(session->logfile) << "FIF :: Purged " << purged << " stale tiles from cache" << endl;
+    }
+
 
     // Set copyright from global startup parameter if none exists within image itself
     map<const string, const string> :: const_iterator mit = (*session->image)->metadata.find( "rights" );
@@ -183,8 +188,9 @@ void FIF::run( Session* session, const string& src ){
     }
 
 
-    // Add this image to our cache, overwriting previous version if it exists
-    (*session->imageCache)[argument] = *(*session->image);
+    // Add this image to our cache, overwriting previous version if it exists. Delete items if our
+    // metadata cache becomes too large - unless we have set cache size to -1 (unlimited)
+    session->imageCache->insert( argument, *(*session->image), FIF::max_metadata_cache_size );
 
     if( session->loglevel >= 3 ){
       *(session->logfile) << "FIF :: Created image" << endl;
@@ -0,0 +1,95 @@
+// Frequency Sketch Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#include "FrequencySketch.h"
+
+#include <algorithm>
+
+
+using namespace std;
+
+
+// Number of rows in our sketch
+#define ROWS 4
+
+// Minimum number of counters per row
+#define MIN_WIDTH 64
+
+// Number of counters per row for each expected entry
+#define COUNTERS_PER_ENTRY 4
+
+// Number of keys recorded per counter in a row before all counters are halved
+#define SAMPLE_FACTOR 10
+
+
+
+FrequencySketch::FrequencySketch( unsigned long entries ) :
+  additions( 0 )
+{
+  // Use a power of two number of counters per row, so that we can mask rather than divide.
+  // Allow several counters per entry to limit collisions with keys that are not cached
+  uint32_t width = MIN_WIDTH;
+  while( width < entries * COUNTERS_PER_ENTRY && width < (1U << 24) ) width <<= 1;
+
+  mask = width - 1;
+  sampleSize = (unsigned long) width * SAMPLE_FACTOR / COUNTERS_PER_ENTRY;
+  table.assign( (size_t) width * ROWS, 0 );
+}
+
+
+
+void FrequencySketch::increment( uint64_t hash )
+{
+  for( unsigned int row=0; row<ROWS; row++ ){
+    uint8_t& counter = table[ index( hash, row ) ];
+    if( counter < MAX_COUNT ) counter++;
+  }
+
+  if( ++additions >= sampleSize ) this->age();
+}
+
+
+
+unsigned int FrequencySketch::frequency( uint64_t hash ) const
+{
+  unsigned int f = MAX_COUNT;
+  for( unsigned int row=0; row<ROWS; row++ ){
+    f = min( f, (unsigned int) table[ index( hash, row ) ] );
+  }
+  return f;
+}
+
+
+
+void FrequencySketch::age()
+{
+  for( size_t i=0; i<table.size(); i++ ) table[i] >>= 1;
+  additions /= 2;
+}
+
+
+
+void FrequencySketch::clear()
+{
+  fill( table.begin(), table.end(), 0 );
+  additions = 0;
+}
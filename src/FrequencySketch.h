@@ -0,0 +1,96 @@
+// Frequency Sketch Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef _FREQUENCYSKETCH_H
+#define _FREQUENCYSKETCH_H
+
+
+#include <vector>
+#include <cstdint>
+
+
+
+/// Approximate count of how often keys have recently been seen
+/** A Count-Min sketch with four rows of small saturating counters. The estimated
+    frequency of a key is the minimum of its counters, which can overestimate but
+    never underestimate the true count. So that the sketch reflects recent rather
+    than all-time popularity, all counters are halved once a number of keys
+    proportional to the size of the sketch have been recorded. Used by our tile
+    cache to decide whether a new tile is worth admitting in place of an existing
+    one. Not thread safe.
+ */
+class FrequencySketch {
+
+ private:
+
+  /// Counters, stored as one row after another
+  std::vector<uint8_t> table;
+
+  /// Mask giving the index of a counter within a row
+  uint32_t mask;
+
+  /// Number of keys recorded since the counters were last halved
+  unsigned long additions;
+
+  /// Number of keys after which the counters are halved
+  unsigned long sampleSize;
+
+
+  /// Return the index within our table of the counter for a key in a given row
+  /** @param hash hash of the key
+      @param row row number
+   */
+  uint32_t index( uint64_t hash, unsigned int row ) const {
+    uint32_t h1 = (uint32_t) hash;
+    uint32_t h2 = (uint32_t)( hash >> 32 ) | 1;
+    return row * ( mask + 1 ) + ( ( h1 + row * h2 ) & mask );
+  };
+
+  /// Halve all counters
+  void age();
+
+
+ public:
+
+  /// Maximum value of a counter
+  static const uint8_t MAX_COUNT = 15;
+
+  /// Constructor
+  /** @param entries expected number of distinct keys of interest
+   */
+  FrequencySketch( unsigned long entries = 0 );
+
+  /// Record an occurrence of a key
+  /** @param hash hash of the key */
+  void increment( uint64_t hash );
+
+  /// Return the estimated number of recent occurrences of a key
+  /** @param hash hash of the key */
+  unsigned int frequency( uint64_t hash ) const;
+
+  /// Reset all counters to zero
+  void clear();
+
+};
+
+
+#endif
@@ -0,0 +1,293 @@
+// Built-in HTTP/1.1 Front End Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#include "HTTPServer.h"
+
+#include <sstream>
+#include <cstdlib>
+#include <cctype>
+
+
+using namespace std;
+
+
+// Maximum size of request line and headers
+#define MAX_HEADER_SIZE 16384
+
+// Maximum size of request body
+#define MAX_CONTENT_LENGTH 16777216
+
+
+
+// Remove leading and trailing whitespace
+static string trim( const string& s )
+{
+  size_t start = s.find_first_not_of( " \t" );
+  if( start == string::npos ) return string();
+  size_t end = s.find_last_not_of( " \t" );
+  return s.substr( start, end - start + 1 );
+}
+
+
+// Convert to upper case
+static string upper( const string& s )
+{
+  string u( s );
+  for( size_t i=0; i<u.size(); i++ ) u[i] = toupper( (unsigned char) u[i] );
+  return u;
+}
+
+
+
+void HTTPServer::error( Connection& c, const string& status )
+{
+  c.output.append( "HTTP/1.1 " + status + "\r\nServer: iipsrv\r\nContent-Length: 0\r\nConnection: close\r\n\r\n" );
+  c.input.clear();
+  c.closeAfterWrite = true;
+}
+
+
+
+bool HTTPServer::parse( Connection& c )
+{
+  // Handle one request at a time, so that pipelined responses are returned in order
+  while( c.requests.empty() && !c.closeAfterWrite ){
+
+    size_t end = c.input.find( "\r\n\r\n" );
+    if( end == string::npos ){
+      if( c.input.size() > MAX_HEADER_SIZE ) this->error( c, "431 Request Header Fields Too Large" );
+      return true;
+    }
+    if( end > MAX_HEADER_SIZE ){
+      this->error( c, "431 Request Header Fields Too Large" );
+      return true;
+    }
+
+    // Parse our request line
+    size_t eol = c.input.find( "\r\n" );
+    istringstream line( c.input.substr( 0, eol ) );
+    string method, target, version;
+    line >> method >> target >> version;
+
+    if( method.empty() || target.empty() || version.empty() ){
+      this->error( c, "400 Bad Request" );
+      return true;
+    }
+    if( version.compare( 0, 7, "HTTP/1." ) != 0 ){
+      this->error( c, "505 HTTP Version Not Supported" );
+      return true;
+    }
+
+    shared_ptr<HTTPRequest> r = make_shared<HTTPRequest>();
+    r->connection = c.id;
+    r->id = 1;
+    r->http10 = ( version == "HTTP/1.0" );
+
+    // HEAD requests are processed as GET requests with the body dropped
+    if( method == "HEAD" ){
+      r->head = true;
+      method = "GET";
+    }
+
+    // Parse our headers and convert them to CGI parameters
+    size_t contentLength = 0;
+    string connection;
+    size_t pos = eol + 2;
+
+    while( pos < end + 2 ){
+
+      size_t next = c.input.find( "\r\n", pos );
+      string header = c.input.substr( pos, next - pos );
+      pos = next + 2;
+
+      size_t colon = header.find( ':' );
+      if( colon == string::npos || colon == 0 ){
+	this->error( c, "400 Bad Request" );
+	return true;
+      }
+
+      string name = upper( trim( header.substr( 0, colon ) ) );
+      string value = trim( header.substr( colon + 1 ) );
+      for( size_t i=0; i<name.size(); i++ ) if( name[i] == '-' ) name[i] = '_';
+
+      if( name == "CONTENT_LENGTH" ){
+	contentLength = strtoul( value.c_str(), NULL, 10 );
+	r->addParam( name, value );
+      }
+      else if( name == "CONTENT_TYPE" ) r->addParam( name, value );
+      else if( name == "TRANSFER_ENCODING" ){
+	// We do not support chunked request bodies
+	this->error( c, "411 Length Required" );
+	return true;
+      }
+      else{
+	if( name == "CONNECTION" ) connection = upper( value );
+	r->addParam( "HTTP_" + name, value );
+      }
+    }
+
+    if( contentLength > MAX_CONTENT_LENGTH ){
+      this->error( c, "413 Content Too Large" );
+      return true;
+    }
+
+    // Wait for the full request body
+    if( c.input.size() < end + 4 + contentLength ) return true;
+
+    r->content = c.input.substr( end + 4, contentLength );
+    c.input.erase( 0, end + 4 + contentLength );
+
+    // Set up our CGI parameters
+    size_t q = target.find( '?' );
+    r->addParam( "REQUEST_METHOD", method );
+    r->addParam( "REQUEST_URI", target );
+    r->addParam( "QUERY_STRING", (q == string::npos) ? "" : target.substr( q + 1 ) );
+    r->addParam( "SERVER_PROTOCOL", version );
+
+    // HTTP/1.1 connections are persistent by default, whereas HTTP/1.0 connections must request it
+    if( r->http10 ) r->keepConnection = ( connection.find( "KEEP-ALIVE" ) != string::npos );
+    else r->keepConnection = ( connection.find( "CLOSE" ) == string::npos );
+
+    c.requests[r->id] = r;
+    this->dispatch( r );
+  }
+
+  return true;
+}
+
+
+
+void HTTPServer::sendHeader( Connection& c, HTTPRequest& r, bool end, size_t length )
+{
+  string status = "200 OK";
+  string headers;
+  bool hasLength = false;
+
+  // Convert our CGI header lines, extracting any Status line
+  size_t pos = 0;
+  while( pos < r.header.size() ){
+    size_t next = r.header.find( "\r\n", pos );
+    if( next == string::npos ) next = r.header.size();
+    string line = r.header.substr( pos, next - pos );
+    pos = next + 2;
+    if( line.empty() ) continue;
+
+    size_t colon = line.find( ':' );
+    string name = upper( line.substr( 0, colon ) );
+    if( name == "STATUS" ) status = trim( line.substr( colon + 1 ) );
+    else if( name != "CONNECTION" ){
+      if( name == "CONTENT-LENGTH" ) hasLength = true;
+      headers += line + "\r\n";
+    }
+  }
+
+  int code = atoi( status.c_str() );
+  r.noBody = r.head || code == 204 || code == 304 || (code >= 100 && code < 200);
+
+  // Delimit our response body
+  if( !r.noBody && !hasLength ){
+    if( end ){
+      stringstream len;
+      len << "Content-Length: " << length << "\r\n";
+      headers += len.str();
+    }
+    else if( !r.http10 ){
+      r.chunked = true;
+      headers += "Transfer-Encoding: chunked\r\n";
+    }
+    // HTTP/1.0 clients without a content length can only use the connection close
+    else r.keepConnection = false;
+  }
+
+  if( !r.keepConnection ) headers += "Connection: close\r\n";
+  else if( r.http10 ) headers += "Connection: keep-alive\r\n";
+
+  c.output.append( ( r.http10 ? "HTTP/1.0 " : "HTTP/1.1 " ) + status + "\r\n" + headers + "\r\n" );
+  r.headerSent = true;
+  r.header.clear();
+}
+
+
+
+void HTTPServer::frame( Connection& c, EventRequest& req, const OutputQueue& data, bool end )
+{
+  HTTPRequest& r = static_cast<HTTPRequest&>( req );
+  OutputQueue body;
+  size_t segment = 0, offset = 0;
+
+  if( !r.headerSent ){
+
+    // Accumulate output until we have our full CGI header, which is normally
+    // in a segment of its own, ahead of any tile data
+    size_t e = string::npos;
+    for( ; segment < data.segments.size(); segment++ ){
+      const OutputSegment& s = data.segments[segment];
+      size_t start = r.header.size();
+      r.header.append( s.begin(), s.size() );
+      e = r.header.find( "\r\n\r\n", (start > 3) ? start - 3 : 0 );
+      if( e != string::npos ){
+	// Our body starts within this segment
+	offset = e + 4 - start;
+	break;
+      }
+    }
+
+    if( e == string::npos ){
+      if( !end ) return;
+      // We have no valid header at all
+      r.keepConnection = false;
+      this->error( c, "500 Internal Server Error" );
+      return;
+    }
+
+    r.header.erase( e + 4 );
+  }
+
+  // Our body references the remainder of our output
+  for( ; segment < data.segments.size(); segment++, offset = 0 ){
+    const OutputSegment& s = data.segments[segment];
+    body.append( s, offset, s.size() - offset );
+  }
+
+  if( !r.headerSent ) this->sendHeader( c, r, end, body.size() );
+
+  if( !r.noBody && !body.empty() ){
+    if( r.chunked ){
+      stringstream size;
+      size << hex << body.size() << "\r\n";
+      c.output.append( size.str() );
+      c.output.append( body );
+      c.output.append( "\r\n", 2 );
+    }
+    else c.output.append( body );
+  }
+
+  if( end && r.chunked ) c.output.append( "0\r\n\r\n", 5 );
+}
+
+
+
+void HTTPServer::completed( Connection& c )
+{
+  // Handle any pipelined requests we have already received
+  this->receive( c );
+}
@@ -0,0 +1,97 @@
+// Built-in HTTP/1.1 Front End Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef _HTTPSERVER_H
+#define _HTTPSERVER_H
+
+
+#include "EventServer.h"
+
+
+
+/// Minimal HTTP/1.1 server for running iipsrv without a separate web server
+/** Parses HTTP requests into the same CGI parameters (REQUEST_METHOD, REQUEST_URI,
+    QUERY_STRING, HTTP_HOST etc) that a web server would pass via FastCGI, so that
+    requests are handled identically, including URI_MAP mappings. The CGI style
+    "Status:" response headers produced by iipsrv are converted into an HTTP status
+    line. Persistent connections and pipelined requests are supported: requests on
+    a connection are processed one at a time and responses are returned in order.
+    Responses without a Content-Length are sent using chunked transfer encoding.
+ */
+class HTTPServer : public EventServer {
+
+ private:
+
+  /// HTTP request and response state
+  class HTTPRequest : public EventRequest {
+  public:
+    bool http10;                ///< Whether this is an HTTP/1.0 request
+    bool head;                  ///< Whether this is a HEAD request
+    bool headerSent;            ///< Whether the response header has been sent
+    bool chunked;               ///< Whether we are using chunked transfer encoding
+    bool noBody;                ///< Whether the response must not include a body
+    std::string header;         ///< CGI response header received so far
+    HTTPRequest() : http10( false ), head( false ), headerSent( false ), chunked( false ), noBody( false ) {};
+  };
+
+  /// Send a simple error response and close the connection
+  /** @param c connection
+      @param status HTTP status
+   */
+  void error( Connection& c, const std::string& status );
+
+  /// Convert our CGI response header into an HTTP response header
+  /** @param c connection
+      @param r request
+      @param end whether the full response is already available
+      @param length length of body if end is set
+   */
+  void sendHeader( Connection& c, HTTPRequest& r, bool end, size_t length );
+
+
+ protected:
+
+  /// Parse an HTTP request
+  bool parse( Connection& c );
+
+  /// Frame our response
+  void frame( Connection& c, EventRequest& r, const OutputQueue& data, bool end );
+
+  /// Parse any pipelined requests once the current request has completed
+  void completed( Connection& c );
+
+
+ public:
+
+  /// Constructor
+  /** @param socket listen socket
+      @param max maximum number of simultaneous connections
+   */
+  HTTPServer( int socket, unsigned int max = 1024 ) : EventServer( socket, max ) {};
+
+  /// Return a description of the protocol
+  const char* getDescription() const { return "HTTP/1.1"; };
+
+};
+
+
+#endif
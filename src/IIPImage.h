@@ -38,6 +38,7 @@
 #include <stdexcept>
 
 #include "RawTile.h"
+#include "CancellationToken.h"
 
 
 /// Define our own derived exception class for file errors
@@ -179,6 +180,9 @@ class IIPImage {
   /// Image modification timestamp
   time_t timestamp;
 
+  /// Cancellation token for the current request or NULL. Not copied with the image
+  const CancellationToken* cancellation;
+
   /// Our logging stream - declared statically
   static bool logging;
 
@@ -206,7 +210,8 @@ class IIPImage {
     isSet( false ),
     currentX( 0 ),
     currentY( 90 ),
-    timestamp( 0 ) {};
+    timestamp( 0 ),
+    cancellation( NULL ) {};
 
   /// Constructer taking the image path as parameter
   /** @param s image path
@@ -229,7 +234,8 @@ class IIPImage {
     isSet( false ),
     currentX( 0 ),
     currentY( 90 ),
-    timestamp( 0 ) {};
+    timestamp( 0 ),
+    cancellation( NULL ) {};
 
   /// Copy Constructor taking reference to another IIPImage object
   /** @param image IIPImage object
@@ -269,7 +275,8 @@ class IIPImage {
     currentY( image.currentY ),
     histogram( image.histogram ),
     metadata( image.metadata ),
-    timestamp( image.timestamp ) {};
+    timestamp( image.timestamp ),
+    cancellation( NULL ) {};
 
   /// Virtual Destructor
   virtual ~IIPImage() {};
@@ -312,6 +319,13 @@ class IIPImage {
   /// Check whether this object has been initialised
   bool set() const { return isSet; };
 
+  /// Set a cancellation token allowing decoding to be abandoned
+  /** @param c cancellation token */
+  void setCancellationToken( const CancellationToken* c ){ cancellation = c; };
+
+  /// Return our cancellation token or NULL if none has been set
+  const CancellationToken* getCancellationToken() const { return cancellation; };
+
   /// Set a file system prefix for added security
   void setFileSystemPrefix( const std::string& prefix ) { fileSystemPrefix = prefix; };
 
@@ -477,6 +491,9 @@ class IIPImage {
   /// Comparison non-equality operator
   friend int operator != ( const IIPImage&, const IIPImage& );
 
+  /// Allow our metadata to be saved to and restored from cache snapshots
+  friend class Snapshot;
+
 };
 
 
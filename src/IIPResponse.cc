@@ -29,17 +29,26 @@ using namespace std;
 
 IIPResponse::IIPResponse(){
 
-  responseBody = "";
-  error = "";
-  protocol = "";
   server = "Server: iipsrv/" + string(VERSION);
   powered = "X-Powered-By: IIPImage";
-  modified = "";
-  mimeType = "Content-Type: application/vnd.netfpx";
   allow = "Allow: GET POST OPTIONS";
-  cors = "";
-  contentDisposition = "";
   eof = "\r\n";
+  reset();
+}
+
+
+void IIPResponse::reset(){
+
+  // Clear rather than re-assign our strings so that their storage is re-used
+  responseBody.clear();
+  error.clear();
+  protocol.clear();
+  modified.clear();
+  cacheControl.clear();
+  mimeType = "Content-Type: application/vnd.netfpx";
+  cors.clear();
+  contentDisposition.clear();
+  status.clear();
   _sent = false;
   _cachable = true;
 }
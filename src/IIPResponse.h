@@ -65,6 +65,11 @@ class IIPResponse{
   IIPResponse();
 
 
+  /// Reset our response so that it can be re-used for a new request
+  /** CORS and cache control settings must be set again after a reset */
+  void reset();
+
+
   /// Set the IIP protocol version
   /** @param p IIP protocol version */
   void setProtocol( const std::string& p ) { protocol = p; };
@@ -0,0 +1,163 @@
+// Image Metadata Cache Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef _IMAGECACHE_H
+#define _IMAGECACHE_H
+
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <functional>
+
+#include "Cache.h"
+#include "IIPImage.h"
+
+
+
+#ifdef HAVE_EXT_POOL_ALLOCATOR
+#include <ext/pool_allocator.h>
+typedef HASHMAP < std::string, IIPImage,
+			      __gnu_cxx::hash< const std::string >,
+			      std::equal_to< const std::string >,
+			      __gnu_cxx::__pool_alloc< std::pair<const std::string,IIPImage> >
+			      > imageCacheMapType;
+#else
+typedef HASHMAP <std::string,IIPImage> imageCacheMapType;
+#endif
+
+
+
+/// Cache to store image metadata
+/** Stores the IIPImage objects created by FIF so that image headers do not need
+    to be re-read for every request. All access is protected by an internal mutex,
+    so that the cache can be shared between worker threads.
+ */
+class ImageCache {
+
+ private:
+
+  /// Main storage map
+  imageCacheMapType imageMap;
+
+  /// Mutex protecting our map
+  mutable std::mutex mutex;
+
+
+ public:
+
+  /// Get a copy of a cached image
+  /** @param key image path
+      @param image IIPImage object into which cached image is copied
+      @return whether image was found in the cache
+   */
+  bool get( const std::string& key, IIPImage& image ){
+    std::lock_guard<std::mutex> lock( mutex );
+    imageCacheMapType::iterator i = imageMap.find( key );
+    if( i == imageMap.end() ) return false;
+    image = i->second;
+    return true;
+  }
+
+
+  /// Insert or update an image
+  /** @param key image path
+      @param image IIPImage object
+      @param max maximum number of images to hold (0 or -1 for no limit)
+   */
+  void insert( const std::string& key, const IIPImage& image, long max ){
+    std::lock_guard<std::mutex> lock( mutex );
+    // Delete items if our metadata cache becomes too large
+    if( max > 0 && imageMap.find( key ) == imageMap.end() ){
+      while( imageMap.size() >= (unsigned long) max ) imageMap.erase( imageMap.begin() );
+    }
+    imageMap[key] = image;
+  }
+
+
+  /// Remove images until no more than a given number remain
+  /** Used to free memory when it is short
+      @param max maximum number of images to keep
+   */
+  void shrink( size_t max ){
+    std::lock_guard<std::mutex> lock( mutex );
+    while( imageMap.size() > max ) imageMap.erase( imageMap.begin() );
+  }
+
+
+  /// Update the histogram of a cached image
+  /** @param key image path
+      @param histogram image histogram
+   */
+  void setHistogram( const std::string& key, const std::vector<unsigned int>& histogram ){
+    std::lock_guard<std::mutex> lock( mutex );
+    imageCacheMapType::iterator i = imageMap.find( key );
+    if( i != imageMap.end() ) (i->second).histogram = histogram;
+  }
+
+
+  /// Remove an image
+  /** @param key image path
+      @return whether the image was cached
+   */
+  bool erase( const std::string& key ){
+    std::lock_guard<std::mutex> lock( mutex );
+    return imageMap.erase( key ) > 0;
+  }
+
+
+  /// Visit every image in the cache
+  /** Used to save snapshots of our cache once our workers have stopped
+      @param f function called with the key and image of each entry
+      @return false if the cache could not be visited
+   */
+  bool visit( const std::function<void(const std::string&, const IIPImage&)>& f ){
+    std::lock_guard<std::mutex> lock( mutex );
+    for( imageCacheMapType::const_iterator i = imageMap.begin(); i != imageMap.end(); ++i ) f( i->first, i->second );
+    return true;
+  }
+
+
+  /// Return the number of images in the cache
+  size_t size() const {
+    std::lock_guard<std::mutex> lock( mutex );
+    return imageMap.size();
+  }
+
+
+  /// Return whether the cache is empty
+  bool empty() const {
+    std::lock_guard<std::mutex> lock( mutex );
+    return imageMap.empty();
+  }
+
+
+  /// Empty the cache
+  void clear(){
+    std::lock_guard<std::mutex> lock( mutex );
+    imageMap.clear();
+  }
+
+};
+
+
+#endif
@@ -70,8 +70,9 @@ METHODDEF(void) iip_error_exit( j_common_ptr cinfo )
   // Create the message
   (*cinfo->err->format_message) ( cinfo, buffer );
 
-  // Let the memory manager delete any temp files before we die
-  jpeg_destroy( cinfo );
+  // Let the memory manager delete any temp files and return our compression object
+  // to its idle state so that it can be re-used
+  jpeg_abort( cinfo );
 
   // Throw an exception rather than print out a message and exit
   throw string( buffer );
@@ -150,6 +151,42 @@ void iip_term_destination( j_compress_ptr cinfo )
 
 
 
+JPEGCompressor::JPEGCompressor( int quality ) : Compressor(quality), dest(NULL)
+{
+  dest = &dest_mgr;
+
+  // We set up the normal JPEG error routines, then override error_exit. Must be done before calling jpeg_create_compress()
+  cinfo.err = jpeg_std_error( &jerr );
+
+  // Override the error_exit function with our own.
+  setup_error_functions( &cinfo );
+
+  // Create our compression object, which is kept for the lifetime of this compressor
+  jpeg_create_compress( &cinfo );
+
+  // Assign our destination manager to the cinfo object
+  cinfo.dest = (jpeg_destination_mgr*) dest;
+}
+
+
+
+JPEGCompressor::~JPEGCompressor()
+{
+  jpeg_destroy_compress( &cinfo );
+}
+
+
+
+void JPEGCompressor::reset( int quality )
+{
+  Compressor::reset( quality );
+
+  // Return our compression object to its idle state in case a previous compression was abandoned
+  jpeg_abort_compress( &cinfo );
+}
+
+
+
 void JPEGCompressor::InitCompression( const RawTile& rawtile, unsigned int strip_height )
 {
   // Make sure we only try to compress images with 1 or 3 channels
@@ -167,17 +204,8 @@ void JPEGCompressor::InitCompression( const RawTile& rawtile, unsigned int strip
   dest->pub.term_destination = iip_term_destination;
   dest->strip_height = strip_height;
 
-  // We set up the normal JPEG error routines, then override error_exit. Must be done before calling jpeg_create_compress()
-  cinfo.err = jpeg_std_error( &jerr );
-
-  // Override the error_exit function with our own.
-  setup_error_functions( &cinfo );
-
-  // Create compression object
-  jpeg_create_compress( &cinfo );
-
-  // Assign our destination manager to the cinfo object
-  cinfo.dest = (jpeg_destination_mgr*) dest;
+  // Abandon any previous unfinished compression
+  jpeg_abort_compress( &cinfo );
 
 
   // Set up the correct width and height for this particular tile
@@ -191,8 +219,9 @@ void JPEGCompressor::InitCompression( const RawTile& rawtile, unsigned int strip
     (xmp.size()>0 ? (xmp.size()+XMP_PREFIX_SIZE) : 0) +
     (exif.size()>0 ? (exif.size()+EXIF_PREFIX_SIZE) : 0);
 
-  // Allocate enough memory for our header and metadata
+  // Allocate enough memory for our header and metadata, freeing any header left over from a previous image
   unsigned long output_size = metadata_size + MX;
+  if( header ) delete[] header;
   header = new unsigned char[output_size];
   dest->source = header;
   dest->source_size = output_size;
@@ -292,12 +321,9 @@ unsigned int JPEGCompressor::Finish( unsigned char* output )
   // Terminate the compression
   jpeg_finish_compress( &cinfo );
 
-  // Calculate size of final data to be written before destroying our compression structures
+  // Calculate size of final data to be written
   unsigned long dataLength = dest->source_size - dest->pub.free_in_buffer;
 
-  // Destroy our compression structure
-  jpeg_destroy_compress( &cinfo );
-
   // Return number of bytes written
   return ( dataLength );
 }
@@ -322,17 +348,8 @@ unsigned int JPEGCompressor::Compress( RawTile& rawtile )
   dest->pub.term_destination = iip_term_destination;
   dest->strip_height = 0;
 
-  // We set up the normal JPEG error routines, then override error_exit. Must be done before calling jpeg_create_compress()
-  cinfo.err = jpeg_std_error( &jerr );
-
-  // Override the error_exit function with our own.
-  setup_error_functions( &cinfo );
-
-  // Create compression object
-  jpeg_create_compress( &cinfo );
-
-  // Assign our destination manager to the cinfo object
-  cinfo.dest = (jpeg_destination_mgr*) dest;
+  // Abandon any previous unfinished compression
+  jpeg_abort_compress( &cinfo );
 
 
   // Set up the correct width and height for this particular tile
@@ -390,6 +407,12 @@ unsigned int JPEGCompressor::Compress( RawTile& rawtile )
   unsigned char* data = (unsigned char*) rawtile.data;
   int row_stride = width * channels;
   while( cinfo.next_scanline < cinfo.image_height ){
+    // Periodically check whether our client has gone away
+    if( (cinfo.next_scanline % 64 == 0) && cancelled() ){
+      jpeg_abort_compress( &cinfo );
+      delete[] dest->source;
+      throw request_cancelled( "JPEGCompressor :: request cancelled by client" );
+    }
     row[0] = &data[ cinfo.next_scanline * row_stride ];
     jpeg_write_scanlines( &cinfo, row, 1 );
   }
@@ -411,7 +434,6 @@ unsigned int JPEGCompressor::Compress( RawTile& rawtile )
   // Copy memory back to the tile
   memcpy( rawtile.data, dest->source, dataLength );
   delete[] dest->source;
-  jpeg_destroy_compress( &cinfo );
 
 
   // Set the tile compression parameters
@@ -555,9 +577,6 @@ void JPEGCompressor::injectMetadata( RawTile& rawtile )
   // Abort the compression as we only needed it for writing the header
   jpeg_abort_compress( &cinfo );
 
-  // Destroy our compression structure
-  jpeg_destroy_compress( &cinfo );
-
   // Skip final 2 bytes from header
   unsigned int len = getHeaderSize() - 2;
 
@@ -85,10 +85,19 @@ class JPEGCompressor: public Compressor{
  public:
 
   /// Constructor
-  /** @param quality JPEG Quality factor (0-100) */
-  JPEGCompressor( int quality ) : Compressor(quality), dest(NULL) {
-    dest = &dest_mgr;
-  };
+  /** The libjpeg compression object is created once here and re-used for
+      every image we compress
+      @param quality JPEG Quality factor (0-100)
+   */
+  JPEGCompressor( int quality );
+
+  /// Destructor
+  ~JPEGCompressor();
+
+
+  /// Reset our state for a new request
+  /** @param quality default quality factor (0-100) */
+  void reset( int quality );
 
 
   /// Set the compression quality
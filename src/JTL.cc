@@ -90,7 +90,7 @@ void JTL::send( Session* session, int resolution, int tile ){
   else compressor = session->jpeg;
 
 
-  TileManager tilemanager( session->tileCache, *session->image, compressor, session->logfile, session->loglevel );
+  TileManager tilemanager( session->tileCache, *session->image, compressor, session->logfile, session->loglevel, session->degradation );
 
 
   // First calculate histogram if we have asked for either binarization,
@@ -113,9 +113,7 @@ void JTL::send( Session* session, int resolution, int tile ){
     }
 
     // Insert the histogram into our image cache
-    const string key = (*session->image)->getImagePath();
-    imageCacheMapType::iterator i = session->imageCache->find(key);
-    if( i != session->imageCache->end() ) (i->second).histogram = (*session->image)->histogram;
+    session->imageCache->setHistogram( (*session->image)->getImagePath(), (*session->image)->histogram );
   }
 
 
@@ -471,21 +469,23 @@ void JTL::send( Session* session, int resolution, int tile ){
   }
 
 
+  // Send our HTTP header and tile data together, writing the tile directly from its own buffer
+  string header;
 #ifndef DEBUG
-
-  // Send HTTP header
-  stringstream header;
-  header << session->response->createHTTPHeader( compressor->getMimeType(), (*session->image)->getTimestamp(), len );
-  if( session->out->putStr( header.str().c_str(), (int) header.tellp() ) == -1 ){
-    if( session->loglevel >= 1 ){
-      *(session->logfile) << "JTL :: Error writing HTTP header" << endl;
-    }
-  }
-
+  header = session->response->createHTTPHeader( compressor->getMimeType(), (*session->image)->getTimestamp(), len );
 #endif
 
+  // Hold our tile data in a shared buffer, as cached tiles already are, so that writers that
+  // send their output asynchronously can reference it rather than copy it. Our own data is
+  // moved rather than copied into this buffer
+  if( rawtile.memoryManaged ) rawtile.share();
+
+  const Writer::Block blocks[2] = {
+    { header.c_str(), header.size(), std::shared_ptr<void>() },
+    { static_cast<const char*>(rawtile.data), (size_t) len, rawtile.isShared() ? rawtile.shared : std::shared_ptr<void>() }
+  };
 
-  if( session->out->putStr( static_cast<const char*>(rawtile.data), len ) != len ){
+  if( session->out->putV( blocks, 2 ) != (int)( header.size() + len ) ){
    if( session->loglevel >= 1 ){
      *(session->logfile) << "JTL :: Error writing tile" << endl;
    }
@@ -70,6 +70,8 @@ static unsigned int get_concurrency(){ return 0; }
 
 
 #include "Timer.h"
+#include "Topology.h"
+#include "ThreadBudget.h"
 
 
 using namespace std;
@@ -599,8 +601,15 @@ void KakaduImage::process( unsigned int res, int layers, int xoffset, int yoffse
   codestream.map_region( 0, canvas_dims, image_dims, true );
 
 
-  // Create some worker threads
-  int num_threads = get_concurrency();
+  // Create some worker threads, but no more than our request's thread budget or the number
+  // of cores to which we are bound. Our own thread also counts towards this total
+  int num_threads = ThreadBudget::threads();
+  if( num_threads > 0 ) num_threads--;
+  else{
+    num_threads = get_concurrency();
+    int allowed = Topology::getAllowedCPUs();
+    if( allowed > 0 && allowed < num_threads ) num_threads = allowed;
+  }
 
   kdu_thread_env env, *env_ref = NULL;
   if( num_threads > 0 ){
@@ -625,6 +634,20 @@ void KakaduImage::process( unsigned int res, int layers, int xoffset, int yoffse
   void *stripe_buffer = NULL;
   int *stripe_heights = NULL;
 
+  // Shut down our decompressor, delete our buffers, destroy our threads and codestream on error
+  auto abort_decode = [&](){
+#if defined(KDU_MAJOR_VERSION) && (KDU_MAJOR_VERSION >= 8 || ((KDU_MAJOR_VERSION >= 7) && (KDU_MINOR_VERSION >= 5)))
+    // Note that from Kakadu 7.5 onwards, we need to use reset() rather than finish() in case of an exception
+    decompressor.reset( true );
+#else
+    decompressor.finish();
+#endif
+    if( env.exists() ) env.destroy();
+    delete_buffer( stripe_buffer );
+    delete_buffer( buffer );
+    if( stripe_heights ) delete[] stripe_heights;
+  };
+
   try{
 
     // Note that we set max channels rather than leave the default to strip off alpha channels
@@ -683,6 +706,11 @@ void KakaduImage::process( unsigned int res, int layers, int xoffset, int yoffse
 
     while( continues ){
 
+      // Abandon decoding if our client has gone away
+      if( cancellation && cancellation->isCancelled() ){
+	throw request_cancelled( "Kakadu :: request cancelled by client" );
+      }
+
 
       decompressor.get_recommended_stripe_heights( comp_dims.size.y,
 						   1024, stripe_heights, NULL );
@@ -812,19 +840,13 @@ void KakaduImage::process( unsigned int res, int layers, int xoffset, int yoffse
 #endif
 
 
+  }
+  catch( const request_cancelled& ){
+    abort_decode();
+    throw;
   }
   catch (...){
-    // Shut down our decompressor, delete our buffers, destroy our threads and codestream before rethrowing the exception
-#if defined(KDU_MAJOR_VERSION) && (KDU_MAJOR_VERSION >= 8 || ((KDU_MAJOR_VERSION >= 7) && (KDU_MINOR_VERSION >= 5)))
-    // Note that from Kakadu 7.5 onwards, we need to use reset() rather than finish() in case of an exception
-    decompressor.reset( true );
-#else
-    decompressor.finish();
-#endif
-    if( env.exists() ) env.destroy();
-    delete_buffer( stripe_buffer );
-    delete_buffer( buffer );
-    if( stripe_heights ) delete[] stripe_heights;
+    abort_decode();
     throw file_error( "Kakadu :: Core Exception Caught"); // Rethrow the exception
   }
 
@@ -1,7 +1,7 @@
 /*
     Basic Header-Only Logging Class
 
-    Copyright (C) 2019-2023 Ruven Pillay
+    Copyright (C) 2019-2026 Ruven Pillay
 
     This program is free software; you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -26,6 +26,7 @@
 #include <fstream>
 #include <streambuf>
 #include <string>
+#include <mutex>
 
 
 
@@ -75,6 +76,68 @@ class SyslogStream : public std::streambuf {
 #endif
 
 
+/// Thread-safe stream buffer
+/** Output is accumulated in a per-thread buffer and only written to the
+    underlying stream buffer in a single locked operation when the stream
+    is flushed (for example via std::endl). This prevents output from
+    concurrent worker threads from being interleaved or corrupted.
+ */
+class ThreadSafeStream : public std::streambuf {
+
+ private:
+  std::streambuf* _sink;
+  std::mutex _mutex;
+
+  /// Return our per-thread line buffer
+  static std::string& buffer(){
+    static thread_local std::string _buf;
+    return _buf;
+  }
+
+
+ public:
+
+  /// Constructor
+  ThreadSafeStream() : _sink( NULL ) {};
+
+  /// Set the stream buffer to which our output is written
+  /** @param sink stream buffer */
+  void setSink( std::streambuf* sink ){
+    std::lock_guard<std::mutex> lock( _mutex );
+    _sink = sink;
+  }
+
+  /// Override streambuf sync() function
+  int sync(){
+    std::string& buf = buffer();
+    if( buf.size() ){
+      std::lock_guard<std::mutex> lock( _mutex );
+      if( _sink ){
+	_sink->sputn( buf.data(), buf.size() );
+	_sink->pubsync();
+      }
+      buf.clear();
+    }
+    return 0;
+  }
+
+  /// Override streambuf overflow() function
+  int_type overflow( int_type c ){
+    if( c == traits_type::eof() ) sync();
+    else buffer() += static_cast<char>(c);
+    return c;
+  }
+
+  /// Override streambuf xsputn() function
+  std::streamsize xsputn( const char* s, std::streamsize n ){
+    buffer().append( s, n );
+    return n;
+  }
+
+};
+
+
+
 /// Logger class - handles ofstreams and syslog
 class Logger : public std::ostream {
 
@@ -88,6 +151,9 @@ class Logger : public std::ostream {
   /// File stream
   std::ofstream _fstream;
 
+  /// Thread-safe wrapper around our syslog or file stream buffer
+  ThreadSafeStream _threadStream;
+
   /// Supported output types
   enum Type {
 #ifdef HAVE_SYSLOG_H
@@ -117,7 +183,8 @@ class Logger : public std::ostream {
     // Open a syslog connection - assign syslog stream to our stream buffer
     if( file == "syslog" ){
       _type = SYSLOG;
-      this->rdbuf( &_syslogStream );
+      _threadStream.setSink( &_syslogStream );
+      this->rdbuf( &_threadStream );
       _syslogStream.open();
     }
     // Create an output file stream and assign it to our stream buffer
@@ -125,8 +192,8 @@ class Logger : public std::ostream {
 #endif
       _type = FILE;
       _fstream.open( file.c_str(), ios_base::app );
-      std::streambuf *buffer = _fstream.rdbuf();
-      this->rdbuf( buffer );
+      _threadStream.setSink( _fstream.rdbuf() );
+      this->rdbuf( &_threadStream );
 #ifdef HAVE_SYSLOG_H
     }
 #endif
@@ -135,6 +202,7 @@ class Logger : public std::ostream {
 
   /// Close depending on type
   void close(){
+    this->flush();
     switch( _type ){
 #ifdef HAVE_SYSLOG_H
       case SYSLOG:
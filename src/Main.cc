@@ -1,7 +1,7 @@
 /*
     IIP FCGI server module - Main loop.
 
-    Copyright (C) 2000-2025 Ruven Pillay
+    Copyright (C) 2000-2026 Ruven Pillay
 
     This program is free software; you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -25,10 +25,15 @@
 
 #include <ctime>
 #include <csignal>
+#include <cstring>
 #include <string>
 #include <utility>
 #include <map>
+#include <vector>
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #ifdef DEBUG
 #include <iostream>
 #endif
@@ -63,10 +68,43 @@
 #include "DSOImage.h"
 #endif
 
+#include "Scheduler.h"
+#include "OverloadController.h"
+#include "Topology.h"
+#include "NUMACache.h"
+#include "PartitionedCache.h"
+#include "MemoryMonitor.h"
+#include "ThreadBudget.h"
+#include "Snapshot.h"
+
+#ifdef HAVE_EPOLL
+#include "FCGIServer.h"
+#include "HTTPServer.h"
+#include "Dispatcher.h"
+#else
+// Forward declaration for use in our worker function
+class EventServer;
+#endif
+
+#ifdef HAVE_SHARED_CACHE
+#include "SharedCache.h"
+#include <cerrno>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#ifdef HAVE_DISK_CACHE
+#include "DiskCache.h"
+#endif
+
 #ifdef _OPENMP
 #include <omp.h>
 #endif
 
+#ifndef WIN32
+#include <pthread.h>
+#endif
+
 // If necessary, define missing setenv and unsetenv functions
 #ifndef HAVE_SETENV
 static void setenv(char *n, char *v, int x) {
@@ -99,60 +137,86 @@ using namespace std;
 */
 int loglevel;
 Logger logfile;
-unsigned long IIPcount;
+atomic<unsigned long> IIPcount;
 
 
 
-// Create pointers to our cache structures for use in our signal handler function
-imageCacheMapType* ic = NULL;
-Cache* tc = NULL;
+// Flag set by our signal handler to request that our caches be emptied. Our worker
+// threads check this before each request, as the caches cannot be safely locked
+// from within a signal handler. The first thread to see the signal claims it, so that
+// our caches are emptied once. This must be lock-free to be set from a signal handler
+static_assert( ATOMIC_INT_LOCK_FREE == 2, "std::atomic<int> must be lock-free" );
+atomic<int> reload_cache( 0 );
 
 
 void IIPReloadCache( int signal )
 {
-  if( ic ) ic->clear();
-  if( tc ) tc->clear();
+  reload_cache = signal;
+}
 
-  if( loglevel >= 1 ){
-    // No strsignal on Windows
-#ifdef WIN32
-    int sigstr = signal;
-#else
-    const char *sigstr = strsignal( signal );
+
+
+#ifdef HAVE_SHARED_CACHE
+// Process IDs of our worker processes when running in prefork mode. This is only
+// ever filled within the master process
+vector<pid_t> worker_pids;
 #endif
-    logfile << "Caught " << sigstr << " signal. Emptying internal caches" << endl << endl;
-  }
-}
 
 
+// Cache snapshot saved on termination and the caches it holds. These are only set
+// within the process that owns each cache
+string snapshot_file;
+Cache *snapshot_tiles = NULL;
+ImageCache *snapshot_images = NULL;
 
-/* Handle a termination signal - print out some stats and exit
+
+
+// Termination signal received, if any. Nothing our shutdown involves, such as saving
+// our caches, is async-signal-safe, so our signal handler only sets this flag. Our
+// main thread then stops our workers, saves our caches and exits normally
+volatile sig_atomic_t terminate_signal = 0;
+
+
+/* Handle a termination signal
  */
 void IIPSignalHandler( int signal )
 {
-  if( loglevel >= 1 ){
+  terminate_signal = signal;
+
+  // Make libfcgi return from, rather than restart, any accept() that is interrupted
+  FCGX_ShutdownPending();
+}
 
-    time_t current_time = time( NULL );
-    char *date = ctime( &current_time );
 
-    // Remove trailing newline
-    date[strcspn(date, "\n")] = '\0';
 
-    // No strsignal on Windows
-#ifdef WIN32
-    int sigstr = signal;
-#else
-    const char *sigstr = strsignal( signal );
+#ifndef WIN32
+/* Interrupt a worker thread blocked in accept(). This is installed without SA_RESTART,
+   so that accept() fails with EINTR, after which libfcgi returns as shutdown is pending
+ */
+void IIPWakeHandler( int )
+{
+}
 #endif
 
-    logfile << endl << "Caught " << sigstr << " signal. "
-	    << "Terminating after " << IIPcount << " accesses" << endl
-	    << date << endl
-	    << "<----------------------------------->" << endl << endl;
-    logfile.close();
-  }
 
-  exit( 0 );
+
+/* Save our caches so that they can be restored when we are restarted. Only called
+   once all the worker threads using our caches have stopped
+*/
+void IIPSaveSnapshot()
+{
+  if( snapshot_file.empty() ) return;
+  try{
+    Snapshot snapshot( snapshot_file );
+    snapshot.save( snapshot_tiles, snapshot_images );
+    if( loglevel >= 1 ){
+      logfile << "Saved " << snapshot.getTiles() << " tiles and " << snapshot.getImages()
+	      << " images to cache snapshot " << snapshot_file << endl;
+    }
+  }
+  catch( const string& error ){
+    if( loglevel >= 1 ) logfile << error << endl;
+  }
 }
 
 
@@ -163,7 +227,6 @@ int main( int argc, char *argv[] )
 {
 
   IIPcount = 0;
-  int i;
 
 
   // Define ourselves a version
@@ -214,17 +277,25 @@ int main( int argc, char *argv[] )
 
   // Set up our FCGI connnection
 
-  FCGX_Request request;
   int listen_socket = 0;
   bool standalone = false;
+  bool http_mode = false;
 
 
   // Initialize FCGI library
   if( FCGX_Init() ) return( 1 );
 
 
-  // Check if we're running directly from the command line
-  if( argv[1] && (string(argv[1]) == "--bind") ){
+  // Check if we're running directly from the command line, either as a FastCGI server
+  // or using our built-in HTTP server
+  if( argv[1] && (string(argv[1]) == "--bind" || string(argv[1]) == "--http") ){
+    http_mode = ( string(argv[1]) == "--http" );
+#ifndef HAVE_EPOLL
+    if( http_mode ){
+      if( loglevel >= 1 ) logfile << "Built-in HTTP server not supported on this platform" << endl << endl;
+      exit(1);
+    }
+#endif
     string socket = argv[2];
     if( !socket.length() ){
       if( loglevel >= 1 ) logfile << "No socket specified" << endl << endl;
@@ -241,14 +312,11 @@ int main( int argc, char *argv[] )
       exit(1);
     }
     standalone = true;
-    if( loglevel >= 1 ) logfile << "Running in standalone mode on socket: " << socket << " with backlog: " << backlog << endl << endl;
+    if( loglevel >= 1 ) logfile << "Running in standalone " << (http_mode ? "HTTP" : "FCGI") << " mode on socket: "
+			    << socket << " with backlog: " << backlog << endl << endl;
   }
 
 
-  // Initialize FCGI request
-  if( FCGX_InitRequest( &request, listen_socket, 0 ) ) return( 1 );
-
-
   // Check whether we really are in FCGI mode - only if we are not in standalone mode
   if( FCGX_IsCGI() ){
     if( !standalone ){
@@ -269,8 +337,11 @@ int main( int argc, char *argv[] )
 
   // Get our maximum metadata cache size
   FIF::max_metadata_cache_size = Environment::getMaxMetadataCacheSize();
-  imageCacheMapType imageCache;
-  ic = &imageCache;
+  ImageCache imageCache;
+
+
+  // Whether clients may purge images from our caches
+  PRG::enabled = Environment::getCachePurge();
 
 
   // Get our image pattern variable
@@ -373,6 +444,55 @@ int main( int argc, char *argv[] )
   string copyright = Environment::getCopyright();
 
 
+  // Get the number of worker threads and worker processes
+  unsigned int worker_threads = Environment::getWorkerThreads();
+  unsigned int worker_processes = Environment::getWorkerProcesses();
+#ifdef DEBUG
+  // Debug mode reads requests from the command line, so only a single worker makes sense
+  worker_threads = 1;
+  worker_processes = 0;
+#endif
+#ifndef HAVE_SHARED_CACHE
+  // Prefork mode requires fork() and POSIX shared memory
+  worker_processes = 0;
+#endif
+
+  // Whether to use our event-driven FastCGI front end rather than libfcgi
+  bool event_loop = Environment::getEventLoop();
+#if defined(DEBUG) || !defined(HAVE_EPOLL)
+  event_loop = false;
+#endif
+
+  // Whether our prefork master should route requests for each image to the same worker process
+  bool image_affinity = Environment::getImageAffinity() && ( worker_processes > 0 );
+#if defined(DEBUG) || !defined(HAVE_EPOLL)
+  image_affinity = false;
+#endif
+
+#if defined(HAVE_EPOLL) && !defined(DEBUG)
+  // Set within worker processes that receive their connections from our dispatcher
+  bool dispatched = false;
+#endif
+
+  // Index of our worker process in prefork mode
+  unsigned int worker_index = 0;
+
+  // Concurrency limits and weighting for our request scheduler
+  unsigned int tile_request_limit = Environment::getTileRequestLimit();
+  unsigned int bulk_request_limit = Environment::getBulkRequestLimit();
+  unsigned int tile_request_weight = Environment::getTileRequestWeight();
+
+  // Queue delay thresholds beyond which we degrade our output
+  OverloadController overload( Environment::getOverloadThresholds() );
+
+  // Placement of our workers on NUMA nodes or individual cores
+  Topology topology;
+  Topology::Placement placement = (Topology::Placement) Environment::getCPUAffinity();
+
+  // Maximum number of threads for the decoding, processing and encoding of each request
+  unsigned int request_threads = Environment::getRequestThreads();
+
+
   // Create our image processing engine
   Transform processor;
 
@@ -391,6 +511,27 @@ int main( int argc, char *argv[] )
 
 
 
+  // Size our caches automatically from the memory limit of our container or host. Our
+  // metadata cache is limited by number of images, so we allow it a sixteenth of our
+  // budget, assuming around 16KB per image. In prefork mode, each worker process has
+  // its own metadata cache and also its own tile cache unless our tile cache is shared
+  MemoryMonitor memoryMonitor;
+  bool auto_cache_size = ( max_image_cache_size < 0 );
+  if( auto_cache_size ){
+    float budget = memoryMonitor.getLimit() * Environment::getCacheMemoryFraction();
+    unsigned int processes = ( worker_processes > 0 ) ? worker_processes : 1;
+    long images = (long)( budget * 1024000 / 16 / 16384 / processes );
+    max_image_cache_size = budget - budget / 16;
+    if( FIF::max_metadata_cache_size == -1 || FIF::max_metadata_cache_size > images ){
+      FIF::max_metadata_cache_size = ( images > 0 ) ? images : 1;
+    }
+    if( loglevel >= 1 ){
+      logfile << "Sizing caches automatically from " << ( memoryMonitor.hasCgroupLimit() ? "cgroup" : "physical" )
+	      << " memory limit of " << memoryMonitor.getLimit() << " MB" << endl;
+    }
+  }
+
+
   // Print out some information
   if( loglevel >= 1 ){
     logfile << "Setting maximum image tile data cache size to " << max_image_cache_size << "MB" << endl;
@@ -423,6 +564,7 @@ int main( int argc, char *argv[] )
     logfile << "Setting 3D file sequence name pattern to '" << FIF::filename_pattern << "'" << endl;
     logfile << "Setting default IIIF Image API version to " << IIIF::version << endl;
     logfile << "Setting IIIF image processing API extension support to " << (IIIF::extensions ? "true" : "false") << endl;
+    if( PRG::enabled ) logfile << "Enabling PRG cache purge command" << endl;
     if( IIIF::delimiter.size() ){
       logfile << "Setting default IIIF multi-page delimiter to '" << IIIF::delimiter << "'" << endl;
     }
@@ -448,6 +590,28 @@ int main( int argc, char *argv[] )
     logfile << "Setting up JPEG2000 support via OpenJPEG " << OpenJPEGImage::getCodecVersion() << endl;
 #endif
     logfile << "Setting image processing engine to " << processor.getDescription() << endl;
+    if( worker_threads > 1 ) logfile << "Setting number of worker threads to " << worker_threads << endl;
+    if( worker_processes > 0 ) logfile << "Setting number of worker processes to " << worker_processes << endl;
+    if( event_loop ) logfile << "Enabling event-driven FastCGI front end" << endl;
+    if( image_affinity ) logfile << "Enabling image affinity routing across worker processes" << endl;
+    if( placement != Topology::NONE ){
+      logfile << "Binding workers to " << ( (placement == Topology::CORE) ? "individual cores" : "NUMA nodes" )
+	      << " with " << topology.getNumNodes() << " NUMA node(s) detected" << endl;
+    }
+    if( request_threads > 0 ) logfile << "Limiting each request to " << request_threads << " threads" << endl;
+    if( tile_request_limit > 0 || bulk_request_limit > 0 ){
+      logfile << "Setting request scheduler limits to " << tile_request_limit << " interactive and "
+	      << bulk_request_limit << " bulk requests with weight " << tile_request_weight << endl;
+    }
+    if( overload.enabled() ){
+      logfile << "Setting overload queue delay thresholds to " << Environment::getOverloadThresholds() << " ms" << endl;
+      // With libfcgi, requests queue unseen in the listen backlog. Without scheduler limits, the only
+      // delay we can then measure is that reported by a front end web server in an X-Request-Start header
+      if( !event_loop && !http_mode && !image_affinity && tile_request_limit == 0 && bulk_request_limit == 0 ){
+	logfile << "Warning: queue delay with libfcgi is only known from X-Request-Start headers. "
+		<< "Use EVENT_LOOP or request limits for overload control without them" << endl;
+      }
+    }
 #ifdef _OPENMP
     int num_threads = 0;
 #pragma omp parallel
@@ -516,9 +680,10 @@ int main( int argc, char *argv[] )
   string memcached_servers = Environment::getMemcachedServers();
   unsigned int memcached_timeout = Environment::getMemcachedTimeout();
 
-  // Create our memcached object
-  Memcache memcached( memcached_servers, memcached_timeout );
+  // Check our memcached connection. Memcached objects cannot be shared between threads,
+  // so each worker creates its own connection
   if( loglevel >= 1 ){
+    Memcache memcached( memcached_servers, memcached_timeout );
     if( memcached.connected() ){
       logfile << "Memcached support enabled. Connected to servers: '" << memcached_servers
 	      << "' with timeout " << memcached_timeout << endl;
@@ -589,6 +754,13 @@ int main( int argc, char *argv[] )
 #ifndef WIN32
   signal( SIGUSR1, IIPSignalHandler );
   signal( SIGHUP, IIPReloadCache );
+
+  // SIGUSR2 is used internally to wake worker threads blocked in accept() once we are terminating
+  struct sigaction wake;
+  memset( &wake, 0, sizeof(wake) );
+  wake.sa_handler = IIPWakeHandler;
+  sigemptyset( &wake.sa_mask );
+  sigaction( SIGUSR2, &wake, NULL );
 #endif
 
   signal( SIGTERM, IIPSignalHandler );
@@ -603,50 +775,207 @@ int main( int argc, char *argv[] )
   }
 
 
-  // Set up our request timers and seed our random number generator with the millisecond count from it
-  Timer request_timer;
-  srand( request_timer.getTime() );
+  // Seed our random number generator with the millisecond count from a timer
+  Timer seed_timer;
+  srand( seed_timer.getTime() );
 
-  // Create our tile cache
-  Cache tileCache( max_image_cache_size );
-  tc = &tileCache;
+  // Create our tile cache - this is shared by all our worker threads. In prefork mode, this
+  // is held in shared memory and is also shared between all our worker processes, unless
+  // each worker only handles its own slice of our images
+  Cache *tileCache = NULL;
+  bool shared_cache = false;
+#ifdef HAVE_SHARED_CACHE
+  if( worker_processes > 0 && !image_affinity && max_image_cache_size > 0 ){
+    try{
+      tileCache = new SharedCache( max_image_cache_size );
+      shared_cache = true;
+      if( loglevel >= 1 ) logfile << "Created shared memory tile cache of " << max_image_cache_size << " MB" << endl;
+    }
+    catch( const string& error ){
+      if( loglevel >= 1 ) logfile << error << ". Using per-process tile cache" << endl;
+    }
+  }
+#endif
+  // Without a shared tile cache, each worker process has its own, so an automatically sized
+  // budget must be split between them
+  if( auto_cache_size && worker_processes > 0 && !shared_cache ){
+    max_image_cache_size /= worker_processes;
+    if( loglevel >= 1 ) logfile << "Limiting tile cache of each worker process to " << max_image_cache_size << " MB" << endl;
+  }
+  // Partition our cache by NUMA node if our worker threads are spread across several nodes
+  // Otherwise divide our cache into independently locked shards, by default one per worker thread
+  unsigned int cache_shards = Environment::getCacheShards();
+  if( cache_shards == 0 ) cache_shards = worker_threads;
+  Cache::Policy cache_policy = (Cache::Policy) Environment::getCachePolicy();
+  bool cache_admission = Environment::getCacheAdmission();
+  bool cache_compression = Environment::getCacheCompression();
+  if( cache_compression && !RawTileCodec::available() ){
+    if( loglevel >= 1 ) logfile << "RAW tile compression is not supported by this build" << endl;
+    cache_compression = false;
+  }
+  bool cache_deduplication = Environment::getCacheDeduplication();
+  string cache_partitions = Environment::getCachePartitions();
+  if( !tileCache && !cache_partitions.empty() ){
+    PartitionedCache *partitioned = new PartitionedCache( max_image_cache_size, cache_partitions, cache_shards, cache_policy,
+							  cache_admission, cache_compression, cache_deduplication );
+    tileCache = partitioned;
+    if( loglevel >= 1 ) logfile << "Partitioning tile cache into " << partitioned->getNumPartitions()
+				<< " partition(s) by image path: " << cache_partitions << endl;
+  }
+  if( !tileCache && placement != Topology::NONE && worker_processes == 0 && topology.getNumNodes() > 1 ){
+    tileCache = new NUMACache( max_image_cache_size, topology, cache_shards, cache_policy, cache_admission,
+			      cache_compression, cache_deduplication );
+    if( loglevel >= 1 ) logfile << "Partitioning tile cache across " << topology.getNumNodes() << " NUMA nodes" << endl;
+  }
+  if( !tileCache ){
+    tileCache = new Cache( max_image_cache_size, cache_shards, cache_policy, cache_admission,
+			   cache_compression, cache_deduplication );
+    if( loglevel >= 1 && (cache_shards > 1 || cache_policy != Cache::LRU || cache_admission) ){
+      logfile << "Dividing tile cache into " << cache_shards << " shard(s) with "
+	      << ( (cache_policy == Cache::GDSF) ? "GDSF" : (cache_policy == Cache::CLOCK) ? "CLOCK" : "LRU" )
+	      << " eviction" << ( cache_admission ? " and W-TinyLFU admission" : "" ) << endl;
+    }
+  }
+  if( cache_compression && !shared_cache && loglevel >= 1 ) logfile << "Storing RAW tiles compressed in tile cache" << endl;
+  if( cache_deduplication && !shared_cache && loglevel >= 1 ) logfile << "Deduplicating identical tiles in tile cache" << endl;
 
-  // Declare our task object and request string
-  Task* task = NULL;
-  string request_string;
+  // Pin our designated images so that their tiles are never evicted
+  string cache_pinned = Environment::getCachePinned();
+  if( !cache_pinned.empty() ){
+    try{
+      Tokenizer izer( cache_pinned, "," );
+      while( izer.hasMoreTokens() ){
+	string image = izer.nextToken();
+	if( image.empty() ) continue;
+	tileCache->pin( image );
+	if( loglevel >= 1 ) logfile << "Pinning tiles of " << image << " in tile cache" << endl;
+      }
+    }
+    catch( const string& error ){
+      if( loglevel >= 1 ) logfile << error << endl;
+    }
+  }
 
 
-  /********************
-    Main Request Loop
-  ********************/
-
-#ifdef DEBUG
+  // Place a second tier on local disk behind our tile cache. Each worker process has its own,
+  // which is opened after the fork. Our shared memory tile cache cannot take a second tier, so
+  // in that case we drop the disk cache here rather than have every worker create and discard one
+  string disk_cache = Environment::getDiskCache();
+  SecondaryCache *diskCache = NULL;
+#ifdef HAVE_DISK_CACHE
+  auto open_disk_cache = [&]( const string& path ){
+    try{
+      diskCache = new DiskCache( path, Environment::getDiskCacheSize() );
+      tileCache->setSecondary( diskCache );
+      if( loglevel >= 1 ) logfile << "Created disk tile cache of " << Environment::getDiskCacheSize() << " MB in " << path << endl;
+    }
+    catch( const string& error ){
+      if( loglevel >= 1 ) logfile << error << endl;
+      delete diskCache;
+      diskCache = NULL;
+    }
+  };
+  if( !disk_cache.empty() ){
+    if( worker_processes == 0 ) open_disk_cache( disk_cache );
+    else if( shared_cache ){
+      if( loglevel >= 1 ) logfile << "Disk tile cache is not supported with a shared memory tile cache" << endl;
+      disk_cache.clear();
+    }
+  }
+#else
+  if( !disk_cache.empty() && loglevel >= 1 ) logfile << "Disk tile cache is not supported on this platform" << endl;
+#endif
 
-  // When in debug mode, listen for requests on standard in and output to a file
-  while( getline( cin, request_string ) ){
 
-    FILE *f = fopen( "iipsrv.debug", "w" );
-    if( f == NULL ) exit( 1 );
-    FileWriter writer( f );
+  // Restore our caches from the snapshot saved when we were last stopped and save them
+  // to it again when we are next stopped
+  string cache_snapshot = Environment::getCacheSnapshot();
+  ImageCache *metadataCache = ( FIF::max_metadata_cache_size != 0 ) ? &imageCache : NULL;
+  auto restore = [&]( const string& path, Cache* tiles, ImageCache* images ){
+    snapshot_file = path;
+    snapshot_tiles = tiles;
+    snapshot_images = images;
+    try{
+      Timer snapshot_timer;
+      snapshot_timer.start();
+      Snapshot snapshot( path );
+      if( snapshot.load( tiles, images, FIF::max_metadata_cache_size ) && loglevel >= 1 ){
+	logfile << "Restored " << snapshot.getTiles() << " tiles and " << snapshot.getImages()
+		<< " images from cache snapshot " << path << " in " << snapshot_timer.getTime()/1000 << " ms" << endl;
+      }
+    }
+    catch( const string& error ){
+      if( loglevel >= 1 ) logfile << error << endl;
+    }
+  };
 
-#else
+  // In prefork mode, our master process only holds a shared memory tile cache, while each worker
+  // process keeps its own snapshot of its image metadata cache and any tile cache of its own
+  if( !cache_snapshot.empty() ){
+    if( worker_processes == 0 ) restore( cache_snapshot, tileCache, metadataCache );
+    else if( shared_cache ) restore( cache_snapshot, tileCache, NULL );
+  }
 
-  // In FCGI mode, listen for FCGI requests
-  while( FCGX_Accept_r( &request ) >= 0 ){
+  // Create our request scheduler if either class of request is limited
+  Scheduler *scheduler = NULL;
+#ifndef DEBUG
+  if( tile_request_limit > 0 || bulk_request_limit > 0 ){
+    scheduler = new Scheduler( tile_request_limit, bulk_request_limit, tile_request_weight );
+    // With libfcgi, each request waiting for a bulk slot holds a worker thread. Allow only as many
+    // to wait as leaves one thread free to accept tile requests and refuse any others with a 503.
+    // Our event-driven front ends instead queue waiting requests without holding a thread
+    if( bulk_request_limit > 0 ){
+      int spare = (int) worker_threads - (int) bulk_request_limit - 1;
+      scheduler->setMaxWaiting( Scheduler::BULK, (spare > 0) ? spare : 0 );
+      if( bulk_request_limit >= worker_threads && !event_loop && !http_mode && loglevel >= 1 ){
+	logfile << "Warning: BULK_REQUEST_LIMIT is not below WORKER_THREADS, so bulk requests may occupy "
+		<< "every worker thread with libfcgi" << endl;
+      }
+    }
+  }
 
-    FCGIWriter writer( request.out );
-    request_string.clear();
+  // Some platforms require calls to accept() to be serialized between threads
+  mutex accept_mutex;
+#endif
 
+#ifndef WIN32
+  // Threads currently blocked in accept(), which are signalled to stop them once we are terminating
+  mutex accepting_mutex;
+  vector<pthread_t> accepting;
 #endif
 
+  // Share the cores available to us between the helper threads of our concurrent requests.
+  // In prefork mode, each worker process receives an equal share
+  unsigned int cores = Topology::getAllowedCPUs();
+  if( cores == 0 ) cores = thread::hardware_concurrency();
+  if( worker_processes > 0 ) cores = ( cores > worker_processes ) ? cores / worker_processes : 1;
+  ThreadBudget budget( cores, worker_threads, request_threads );
 
-    // Time each request
-    if( loglevel >= 2 ) request_timer.start();
 
+  /********************
+    Main Request Loop
+  ********************/
+
+  // Each worker thread runs its own request loop using its own request object
+  // while sharing our tile and metadata caches
+  auto worker = [&]( EventServer* server ){
+
+    // Declare our task object, request string and request timer
+    Task* task = NULL;
+    string request_string;
+    Timer request_timer;
+
+#ifdef HAVE_MEMCACHED
+    // Create our memcached object
+    Memcache memcached( memcached_servers, memcached_timeout );
+#endif
+
+    // Cores to which this worker has been bound, which also limit the threads of its requests
+    unsigned int bound_cpus = ( placement != Topology::NONE ) ? Topology::getAllowedCPUs() : 0;
 
-    // Declare our image pointer here outside of the try scope
-    //  so that we can close the image on exceptions
-    IIPImage *image = NULL;
+    // Our output compressors, view and response objects are created once per worker
+    // and reset at the start of each request. This keeps codec contexts such as our
+    // libjpeg compression object alive across requests
     JPEGCompressor jpeg( jpeg_quality );
     TIFFCompressor tiff( tiff_compression, tiff_quality );
 #ifdef HAVE_PNG
@@ -659,460 +988,970 @@ int main( int argc, char *argv[] )
     AVIFCompressor avif( avif_quality );
     avif.setCodec( avif_codec );
 #endif
-
-    // View object for use with the CVT command etc
     View view;
-    if( max_CVT != 0 ) view.setMaxSize( max_CVT );
-    if( max_layers != 0 ) view.setMaxLayers( max_layers );
-    view.setAllowUpscaling( allow_upscaling );
-    view.setMaxICC( max_icc );
+    IIPResponse response;
 
 
-    // Create an IIPResponse object - we use this for the OBJ requests.
-    // As the commands return images etc, they handle their own responses.
-    IIPResponse response;
-    response.setCORS( cors );
-    response.setCacheControl( cache_control );
+    // Process a single request. Request parameters are supplied in CGI envp form and any
+    // body sent via POST in content
+    auto process = [&]( char** envp, const string& content, Writer& writer ){
 
+      // Empty our caches if this has been requested via a signal. A shared memory tile cache
+      // has already been emptied by our prefork master when it passed the signal on to us
+      int signal = reload_cache.exchange( 0 );
+      if( signal ){
+	imageCache.clear();
+	if( !shared_cache ) tileCache->clear();
+	if( loglevel >= 1 ){
+	  // No strsignal on Windows
+#ifdef WIN32
+	  int sigstr = signal;
+#else
+	  const char *sigstr = strsignal( signal );
+#endif
+	  logfile << "Caught " << sigstr << " signal. Emptying internal caches" << endl << endl;
+	}
+      }
 
-    try{
 
-      // Set up our session data object
-      Session session;
-      session.image = &image;
-      session.response = &response;
-      session.view = &view;
-      session.jpeg = &jpeg;
-      session.tiff = &tiff;
+      // Time each request
+      if( loglevel >= 2 ) request_timer.start();
+
+      // Obtain our share of helper threads for this request
+      ThreadGrant grant( &budget, bound_cpus );
+      if( loglevel >= 3 ) logfile << "Using " << ThreadBudget::threads() << " thread(s) for this request" << endl;
+
+
+      // Declare our image pointer here outside of the try scope
+      //  so that we can close the image on exceptions
+      IIPImage *image = NULL;
+
+      // If we are overloaded, lower the cost of our output encoding by reducing the PNG Deflate level.
+      // WebP and AVIF already encode at their lowest effort and are left at the requested quality,
+      // so that the encoding sent to the client and our cache keys are unchanged
+      unsigned int degradation = overload.getLevel();
+      if( degradation > 0 && loglevel >= 2 ){
+	logfile << "Overloaded with queue delay of " << overload.getDelay()
+		<< " ms: applying degradation level " << degradation << endl;
+      }
+
+      jpeg.reset( jpeg_quality );
+      tiff.reset( tiff_compression, tiff_quality );
 #ifdef HAVE_PNG
-      session.png = &png;
+      png.reset( (degradation > 0) ? min( png_quality, (degradation > 1) ? 0 : 1 ) : png_quality );
 #endif
 #ifdef HAVE_WEBP
-      session.webp = &webp;
+      webp.reset( webp_quality );
 #endif
 #ifdef HAVE_AVIF
-      session.avif = &avif;
-#endif
-      session.loglevel = loglevel;
-      session.logfile = &logfile;
-      session.imageCache = &imageCache;
-      session.tileCache = &tileCache;
-      session.out = &writer;
-      session.watermark = &watermark;
-      session.headers.clear();
-      session.processor = &processor;
-#ifdef HAVE_KAKADU
-      session.codecOptions["KAKADU_READMODE"] = kdu_readmode;
+      avif.reset( avif_quality );
+#endif
+
+      // Cancellation token allowing us to abandon work once our client has gone away
+      CancellationToken cancellation;
+      writer.setCancellationToken( &cancellation );
+      jpeg.setCancellationToken( &cancellation );
+      tiff.setCancellationToken( &cancellation );
+#ifdef HAVE_PNG
+      png.setCancellationToken( &cancellation );
+#endif
+#ifdef HAVE_WEBP
+      webp.setCancellationToken( &cancellation );
+#endif
+#ifdef HAVE_AVIF
+      avif.setCancellationToken( &cancellation );
 #endif
 
+      // View object for use with the CVT command etc
+      view.reset();
+      if( max_CVT != 0 ) view.setMaxSize( max_CVT );
+      if( max_layers != 0 ) view.setMaxLayers( max_layers );
+      view.setAllowUpscaling( allow_upscaling );
+      view.setMaxICC( max_icc );
 
-#ifndef DEBUG
 
-      char* header = NULL;
-
-      // If we have a URI prefix mapping, first test for a match between the map prefix string
-      //  and the full REQUEST_URI variable
-      if( !uri_map.empty() ){
-
-	string prefix = uri_map.begin()->first;
-	string command = uri_map.begin()->second;
-
-	header = FCGX_GetParam( "REQUEST_URI", request.envp );
-	const string request_uri = (header!=NULL) ? header : "";
-
-	// Try to find the prefix at the beginning of request URI
-	// Note that the first character will always be "/"
-	size_t len = prefix.length();
-	if( (len==0) || (request_uri.find(prefix)==1) ){
-	  // This is indeed a mapped request, so map our prefix with the appropriate protocol
-	  unsigned int start = (len>0) ? len+2 : 1; // Add 2 to remove both leading and trailing slashes
-	  // Strip out any query string if we are in prefix mode
-	  size_t q = request_uri.find_first_of('?');
-	  unsigned int end = (q==string::npos) ? request_uri.length() : q;
-	  request_string = command + "=" + request_uri.substr( start, end-start );
-	  if( loglevel >= 2 ) logfile << "Request URI mapped to " << request_string << endl;
-	}
+      // Reset our IIPResponse object - we use this for the OBJ requests.
+      // As the commands return images etc, they handle their own responses.
+      response.reset();
+      response.setCORS( cors );
+      response.setCacheControl( cache_control );
+
+      // Degraded responses must never be cached, either by clients, proxies or Memcached
+      if( degradation > 0 ){
+	response.setCacheControl( "no-store" );
+	response.setCachability( false );
       }
 
 
-      // If the request string hasn't been set through a URI map, get it from the QUERY_STRING variable
-      if( request_string.empty() ){
+      try{
 
-	// Get the query into a string
-	header = FCGX_GetParam( "QUERY_STRING", request.envp );
-	request_string = (header!=NULL)? header : "";
+	// Set up our session data object
+	Session session;
+	session.image = &image;
+	session.response = &response;
+	session.view = &view;
+	session.jpeg = &jpeg;
+	session.tiff = &tiff;
+#ifdef HAVE_PNG
+	session.png = &png;
+#endif
+#ifdef HAVE_WEBP
+	session.webp = &webp;
+#endif
+#ifdef HAVE_AVIF
+	session.avif = &avif;
+#endif
+	session.loglevel = loglevel;
+	session.logfile = &logfile;
+	session.imageCache = &imageCache;
+	session.tileCache = tileCache;
+	session.out = &writer;
+	session.degradation = degradation;
+	session.cancellation = &cancellation;
+	session.watermark = &watermark;
+	session.headers.clear();
+	session.processor = &processor;
+#ifdef HAVE_KAKADU
+	session.codecOptions["KAKADU_READMODE"] = kdu_readmode;
+#endif
 
-	header = FCGX_GetParam( "REQUEST_METHOD", request.envp );
-	session.headers["REQUEST_METHOD"] = header;
 
-	// Handle OPTIONS request
-	if( session.headers["REQUEST_METHOD"] == "OPTIONS" ){
-	  if( loglevel >=2 ) logfile << "HTTP OPTIONS request" << endl;
-	  throw( 204 );
-	}
-	else if( session.headers["REQUEST_METHOD"] != "GET" && session.headers["REQUEST_METHOD"] != "POST" ){
-	  if( loglevel >=2 ) logfile << "Unsupported HTTP method " << session.headers["REQUEST_METHOD"] << endl;
-	  throw( 405 );
+#ifndef DEBUG
+
+	char* header = NULL;
+
+	// If we have a URI prefix mapping, first test for a match between the map prefix string
+	//  and the full REQUEST_URI variable
+	if( !uri_map.empty() ){
+
+	  string prefix = uri_map.begin()->first;
+	  string command = uri_map.begin()->second;
+
+	  header = FCGX_GetParam( "REQUEST_URI", envp );
+	  const string request_uri = (header!=NULL) ? header : "";
+
+	  // Try to find the prefix at the beginning of request URI
+	  // Note that the first character will always be "/"
+	  size_t len = prefix.length();
+	  if( (len==0) || (request_uri.find(prefix)==1) ){
+	    // This is indeed a mapped request, so map our prefix with the appropriate protocol
+	    unsigned int start = (len>0) ? len+2 : 1; // Add 2 to remove both leading and trailing slashes
+	    // Strip out any query string if we are in prefix mode
+	    size_t q = request_uri.find_first_of('?');
+	    unsigned int end = (q==string::npos) ? request_uri.length() : q;
+	    request_string = command + "=" + request_uri.substr( start, end-start );
+	    if( loglevel >= 2 ) logfile << "Request URI mapped to " << request_string << endl;
+	  }
 	}
 
-	// Check for requests sent using POST, PUT or other HTTP methods
+
+	// If the request string hasn't been set through a URI map, get it from the QUERY_STRING variable
 	if( request_string.empty() ){
-	  int contentLength = 0;
-	  if( ( header = FCGX_GetParam("CONTENT_LENGTH",request.envp) ) ) contentLength = atoi( header );
-	  if( loglevel >=2 ) logfile << "HTTP " << session.headers["REQUEST_METHOD"] << " request with contentLength " << contentLength << endl;
-	  if( contentLength > 0 ){
-	    char *contentBuffer = new char[contentLength];
-	    FCGX_GetStr( contentBuffer, contentLength, request.in );
-	    request_string = string( contentBuffer, contentLength );
-	    delete[] contentBuffer;
+
+	  // Get the query into a string
+	  header = FCGX_GetParam( "QUERY_STRING", envp );
+	  request_string = (header!=NULL)? header : "";
+
+	  header = FCGX_GetParam( "REQUEST_METHOD", envp );
+	  session.headers["REQUEST_METHOD"] = header;
+
+	  // Handle OPTIONS request
+	  if( session.headers["REQUEST_METHOD"] == "OPTIONS" ){
+	    if( loglevel >=2 ) logfile << "HTTP OPTIONS request" << endl;
+	    throw( 204 );
+	  }
+	  else if( session.headers["REQUEST_METHOD"] != "GET" && session.headers["REQUEST_METHOD"] != "POST" ){
+	    if( loglevel >=2 ) logfile << "Unsupported HTTP method " << session.headers["REQUEST_METHOD"] << endl;
+	    throw( 405 );
+	  }
+
+	  // Check for requests sent using POST, PUT or other HTTP methods
+	  if( request_string.empty() ){
+	    int contentLength = 0;
+	    if( ( header = FCGX_GetParam("CONTENT_LENGTH",envp) ) ) contentLength = atoi( header );
+	    if( loglevel >=2 ) logfile << "HTTP " << session.headers["REQUEST_METHOD"] << " request with contentLength " << contentLength << endl;
+	    if( contentLength > 0 ) request_string = content.substr( 0, contentLength );
+	    else request_string = "";
 	  }
-	  else request_string = "";
 	}
-      }
 
-      // Check that we actually have a request string. If not, just show server home page
-      if( request_string.empty() ){
-	response.setStatus( "200 OK" );
-	throw string( "QUERY_STRING not set" );
-      }
+	// Check that we actually have a request string. If not, just show server home page
+	if( request_string.empty() ){
+	  response.setStatus( "200 OK" );
+	  throw string( "QUERY_STRING not set" );
+	}
 
-      if( loglevel >=2 ){
-	logfile << "Full Request is " << request_string << endl;
-      }
+	if( loglevel >=2 ){
+	  logfile << "Full Request is " << request_string << endl;
+	}
 
 
-      // Get several important HTTP headers
-      if( (header = FCGX_GetParam("SERVER_PROTOCOL", request.envp)) ){
-        session.headers["SERVER_PROTOCOL"] = string(header);
-      }
-      if( (header = FCGX_GetParam("HTTP_HOST", request.envp)) ){
-        session.headers["HTTP_HOST"] = string(header);
-      }
-      if( (header = FCGX_GetParam("REQUEST_URI", request.envp)) ){
-        session.headers["REQUEST_URI"] = string(header);
-      }
-      if( (header = FCGX_GetParam("HTTPS", request.envp)) ) {
-        session.headers["HTTPS"] = string(header);
-      }
-      if( (header = FCGX_GetParam("HTTP_ACCEPT", request.envp)) ){
-	session.headers["HTTP_ACCEPT"] = string(header);
-      }
-      if( (header = FCGX_GetParam("HTTP_X_IIIF_ID", request.envp)) ){
-        session.headers["HTTP_X_IIIF_ID"] = string(header);
-      }
+	// Get several important HTTP headers
+	if( (header = FCGX_GetParam("SERVER_PROTOCOL", envp)) ){
+	  session.headers["SERVER_PROTOCOL"] = string(header);
+	}
+	if( (header = FCGX_GetParam("HTTP_HOST", envp)) ){
+	  session.headers["HTTP_HOST"] = string(header);
+	}
+	if( (header = FCGX_GetParam("REQUEST_URI", envp)) ){
+	  session.headers["REQUEST_URI"] = string(header);
+	}
+	if( (header = FCGX_GetParam("HTTPS", envp)) ) {
+	  session.headers["HTTPS"] = string(header);
+	}
+	if( (header = FCGX_GetParam("HTTP_ACCEPT", envp)) ){
+	  session.headers["HTTP_ACCEPT"] = string(header);
+	}
+	if( (header = FCGX_GetParam("HTTP_X_IIIF_ID", envp)) ){
+	  session.headers["HTTP_X_IIIF_ID"] = string(header);
+	}
 
-      // Check for IF_MODIFIED_SINCE
-      if( (header = FCGX_GetParam("HTTP_IF_MODIFIED_SINCE", request.envp)) ){
-	session.headers["HTTP_IF_MODIFIED_SINCE"] = string(header);
-	if( loglevel >= 2 ){
-	  logfile << "HTTP Header: If-Modified-Since: " << header << endl;
+	// Check for IF_MODIFIED_SINCE
+	if( (header = FCGX_GetParam("HTTP_IF_MODIFIED_SINCE", envp)) ){
+	  session.headers["HTTP_IF_MODIFIED_SINCE"] = string(header);
+	  if( loglevel >= 2 ){
+	    logfile << "HTTP Header: If-Modified-Since: " << header << endl;
+	  }
 	}
-      }
 #endif
 
 
-      // Store some key session information not necessarily found in HTTP headers
-      session.headers["QUERY_STRING"] = request_string;
-      if( !base_url.empty() ) session.headers["BASE_URL"] = base_url;
-      if( !copyright.empty() ) session.headers["COPYRIGHT"] = copyright;
+	// Store some key session information not necessarily found in HTTP headers
+	session.headers["QUERY_STRING"] = request_string;
+	if( !base_url.empty() ) session.headers["BASE_URL"] = base_url;
+	if( !copyright.empty() ) session.headers["COPYRIGHT"] = copyright;
 
 
 #ifdef HAVE_MEMCACHED
 #ifndef DEBUG
-      // Check whether this exists in memcached, but only if we haven't had an if_modified_since
-      // request, which should always be faster to send
-      if( !header || session.headers["HTTP_IF_MODIFIED_SINCE"].empty() ){
-	char* memcached_response = NULL;
-	if( (memcached_response = memcached.retrieve( request_string )) ){
-	  writer.putStr( memcached_response, memcached.length() );
-	  writer.flush();
-	  free( memcached_response );
-	  throw( 100 );
+	// Check whether this exists in memcached, but only if we haven't had an if_modified_since
+	// request, which should always be faster to send
+	if( !header || session.headers["HTTP_IF_MODIFIED_SINCE"].empty() ){
+	  char* memcached_response = NULL;
+	  if( (memcached_response = memcached.retrieve( request_string )) ){
+	    writer.putStr( memcached_response, memcached.length() );
+	    writer.flush();
+	    free( memcached_response );
+	    throw( 100 );
+	  }
 	}
-      }
+
+	// Only keep a copy of our output if we may store it in memcached
+	if( response.cachable() && memcached.connected() ) writer.capture();
 #endif
 #endif
 
 
-      // Parse up the command list
-      list < pair<string,string> > requests;
-      list < pair<string,string> > :: const_iterator commands;
+	// Parse up the command list
+	list < pair<string,string> > requests;
+	list < pair<string,string> > :: const_iterator commands;
 
-      Tokenizer izer( request_string, "&" );
-      while( izer.hasMoreTokens() ){
-	pair <string,string> p;
-	string token = izer.nextToken();
-	int n = token.find_first_of( "=" );
-	p.first = token.substr( 0, n );
-	p.second = token.substr( n+1, token.length() );
-	if( p.first.length() && p.second.length() ) requests.push_back( std::move(p) );
-      }
+	Tokenizer izer( request_string, "&" );
+	while( izer.hasMoreTokens() ){
+	  pair <string,string> p;
+	  string token = izer.nextToken();
+	  int n = token.find_first_of( "=" );
+	  p.first = token.substr( 0, n );
+	  p.second = token.substr( n+1, token.length() );
+	  if( p.first.length() && p.second.length() ) requests.push_back( std::move(p) );
+	}
 
 
-      i = 0;
-      for( commands = requests.begin(); commands != requests.end(); commands++ ){
+	int i = 0;
+	for( commands = requests.begin(); commands != requests.end(); commands++ ){
 
-	string command = (*commands).first;
-	string argument = (*commands).second;
+	  string command = (*commands).first;
+	  string argument = (*commands).second;
 
-	if( loglevel >= 2 ){
-	  logfile << "[" << i+1 << "/" << requests.size() << "]: Command / Argument is " << command << " : " << argument << endl;
-	  i++;
-	}
+	  if( loglevel >= 2 ){
+	    logfile << "[" << i+1 << "/" << requests.size() << "]: Command / Argument is " << command << " : " << argument << endl;
+	    i++;
+	  }
 
-	task = Task::factory( command );
-	if( task ) task->run( &session, argument );
+	  task = Task::factory( command );
+	  if( task ) task->run( &session, argument );
 
-	if( !task ){
-	  if( loglevel >= 1 ) logfile << "Unsupported command: " << command << endl;
-	  // Unsupported command error code is 2 2
-	  response.setError( "2 2", command );
-	}
+	  if( !task ){
+	    if( loglevel >= 1 ) logfile << "Unsupported command: " << command << endl;
+	    // Unsupported command error code is 2 2
+	    response.setError( "2 2", command );
+	  }
 
 
-	// Delete our task
-	if( task ){
-	  delete task;
-	  task = NULL;
-	}
+	  // Delete our task
+	  if( task ){
+	    delete task;
+	    task = NULL;
+	  }
 
-      }
+	}
 
 
 
-      ////////////////////////////////////////////////////////
-      ////////// Send out our Errors if necessary ////////////
-      ////////////////////////////////////////////////////////
+	////////////////////////////////////////////////////////
+	////////// Send out our Errors if necessary ////////////
+	////////////////////////////////////////////////////////
 
-      /* Make sure something has actually been sent to the client
-	 If no response has been sent by now, we must have a malformed command
-       */
-      if( (!response.imageSent()) && (!response.isSet()) ){
-	// Malformed command syntax error code is 2 1
-	response.setError( "2 1", request_string );
-      }
+	/* Make sure something has actually been sent to the client
+	   If no response has been sent by now, we must have a malformed command
+	 */
+	if( (!response.imageSent()) && (!response.isSet()) ){
+	  // Malformed command syntax error code is 2 1
+	  response.setError( "2 1", request_string );
+	}
 
 
-      /* Once we have finished parsing all our OBJ and COMMAND requests
-	 send out our response.
-       */
-      if( response.isSet() ){
-	if( loglevel >= 4 ){
-	  logfile << "---" << endl <<
-	    response.formatResponse() <<
-	    endl << "---" << endl;
-	}
-	if( writer.putS( response.formatResponse().c_str() ) == -1 ){
-	  if( loglevel >= 1 ) logfile << "Error sending IIPResponse" << endl;
+	/* Once we have finished parsing all our OBJ and COMMAND requests
+	   send out our response.
+	 */
+	if( response.isSet() ){
+	  if( loglevel >= 4 ){
+	    logfile << "---" << endl <<
+	      response.formatResponse() <<
+	      endl << "---" << endl;
+	  }
+	  if( writer.putS( response.formatResponse().c_str() ) == -1 ){
+	    if( loglevel >= 1 ) logfile << "Error sending IIPResponse" << endl;
+	  }
 	}
-      }
 
 
-      ////////////////////////////////////////////////////////
-      ////////// Insert the result into Memcached  ///////////
-      ////////// - Note that we never store errors ///////////
-      //////////   or 304 replies                  ///////////
-      ////////////////////////////////////////////////////////
+	////////////////////////////////////////////////////////
+	////////// Insert the result into Memcached  ///////////
+	////////// - Note that we never store errors ///////////
+	//////////   or 304 replies                  ///////////
+	////////////////////////////////////////////////////////
 
 #ifdef HAVE_MEMCACHED
 #ifndef DEBUG
-      if( response.cachable() && memcached.connected() ){
-	Timer memcached_timer;
-	memcached_timer.start();
-	memcached.store( session.headers["QUERY_STRING"], writer.buffer, writer.sz );
-	if( loglevel >= 3 ){
-	  logfile << "Memcached :: stored " << writer.sz << " bytes in "
-		  << memcached_timer.getTime() << " microseconds" << endl;
+	if( response.cachable() && memcached.connected() && writer.buffer ){
+	  Timer memcached_timer;
+	  memcached_timer.start();
+	  memcached.store( session.headers["QUERY_STRING"], writer.buffer, writer.sz );
+	  if( loglevel >= 3 ){
+	    logfile << "Memcached :: stored " << writer.sz << " bytes in "
+		    << memcached_timer.getTime() << " microseconds" << endl;
+	  }
 	}
-      }
 #endif
 #endif
 
 
-      //////////////////////////////////////////////////////
-      //////////////// End of try block ////////////////////
-      //////////////////////////////////////////////////////
-    }
+	//////////////////////////////////////////////////////
+	//////////////// End of try block ////////////////////
+	//////////////////////////////////////////////////////
+      }
 
-    /* Use this for sending various HTTP status codes
-     */
-    catch( const int& code ){
+      /* Use this for sending various HTTP status codes
+       */
+      catch( const int& code ){
+
+	string header;
+
+	switch( code ){
+
+	  case 405:
+	    response.setStatus( "405 Method Not Allowed" );
+	    header = response.getHeaderResponse();
+	    writer.putS( header.c_str() );
+	    writer.flush();
+	    if( loglevel >= 2 ){
+	      logfile << "Sending HTTP 405 Method Not Allowed" << endl;
+	    }
+	    break;
+
+	  case 304:
+	    response.setStatus( "304 Not Modified" );
+	    header = response.getHeaderResponse();
+	    writer.putS( header.c_str() );
+	    writer.flush();
+	    if( loglevel >= 2 ){
+	      logfile << "Sending HTTP 304 Not Modified" << endl;
+	    }
+	    break;
+
+	  case 204:
+	    // Handle HTTP OPTIONS requests
+	    response.setStatus( "204 No Content" );
+	    header = response.getHeaderResponse( true );
+	    writer.putS( header.c_str() );
+	    writer.flush();
+	    if( loglevel >= 2 ){
+	      logfile << "Returning HTTP 204 No Content" << endl;
+	    }
+	    break;
+
+	  case 100:
+	    if( loglevel >= 2 ){
+	      logfile << "Memcached hit" << endl;
+	    }
+	    break;
+
+	  default:
+	    if( loglevel >= 1 ){
+	      logfile << "Unsupported HTTP status code: " << code << endl << endl;
+	    }
+	 }
+      }
 
-      string header;
+      /* Catch any errors
+       */
+      catch( const string& error ){
 
-      switch( code ){
+	if( loglevel >= 1 ){
+	  logfile << endl << error << endl << endl;
+	}
 
-        case 405:
-	  response.setStatus( "405 Method Not Allowed" );
-	  header = response.getHeaderResponse();
-	  writer.putS( header.c_str() );
-	  writer.flush();
-	  if( loglevel >= 2 ){
-	    logfile << "Sending HTTP 405 Method Not Allowed" << endl;
-	  }
-	  break;
-
-        case 304:
-	  response.setStatus( "304 Not Modified" );
-	  header = response.getHeaderResponse();
-	  writer.putS( header.c_str() );
-	  writer.flush();
-          if( loglevel >= 2 ){
-	    logfile << "Sending HTTP 304 Not Modified" << endl;
+	if( response.errorIsSet() ){
+	  if( loglevel >= 4 ){
+	    logfile << "---" << endl <<
+	      response.formatResponse() <<
+	      endl << "---" << endl;
 	  }
-	  break;
-
-        case 204:
-	  // Handle HTTP OPTIONS requests
-	  response.setStatus( "204 No Content" );
-	  header = response.getHeaderResponse( true );
-	  writer.putS( header.c_str() );
-	  writer.flush();
-	  if( loglevel >= 2 ){
-	    logfile << "Returning HTTP 204 No Content" << endl;
+	  if( writer.putS( response.formatResponse().c_str() ) == -1 ){
+	    if( loglevel >= 1 ) logfile << "Error sending IIPResponse" << endl;
 	  }
-	  break;
-
-        case 100:
-	  if( loglevel >= 2 ){
-	    logfile << "Memcached hit" << endl;
+	}
+	else{
+	  // Display our advertising banner ;-)
+	  if( writer.putS( response.getAdvert().c_str() ) == -1 ){
+	    if( loglevel >= 1 ) logfile << "Error sending IIPImage banner" << endl;
 	  }
-	  break;
+	}
 
-        default:
-          if( loglevel >= 1 ){
-	    logfile << "Unsupported HTTP status code: " << code << endl << endl;
-	  }
-       }
-    }
+      }
 
-    /* Catch any errors
-     */
-    catch( const string& error ){
+      // Requests abandoned by the client: there is nobody left to send a response to
+      catch( const request_cancelled& error ){
+	if( loglevel >= 2 ){
+	  logfile << error.what() << endl;
+	}
+      }
 
-      if( loglevel >= 1 ){
-	logfile << endl << error << endl << endl;
+      // Image file errors
+      catch( const file_error& error ){
+	string status = "Status: 404 Not Found\r\nServer: iipsrv/" + version +
+	  "\r\nContent-Type: text/plain; charset=utf-8" +
+	  (response.getCORS().length() ? "\r\n" + response.getCORS() : "") +
+	  "\r\n\r\n" + error.what();
+	writer.putS( status.c_str() );
+	writer.flush();
+	if( loglevel >= 2 ){
+	  logfile << error.what() << endl;
+	  logfile << "Sending HTTP 404 Not Found" << endl;
+	}
       }
 
-      if( response.errorIsSet() ){
-	if( loglevel >= 4 ){
-	  logfile << "---" << endl <<
-	    response.formatResponse() <<
-	    endl << "---" << endl;
+      // Parameter errors
+      catch( const invalid_argument& error ){
+	string status = "Status: 400 Bad Request\r\nServer: iipsrv/" + version +
+	  "\r\nContent-Type: text/plain; charset=utf-8" +
+	  (response.getCORS().length() ? "\r\n" + response.getCORS() : "") +
+	  "\r\n\r\n" + error.what();
+	writer.putS( status.c_str() );
+	writer.flush();
+	if( loglevel >= 2 ){
+	  logfile << error.what() << endl;
+	  logfile << "Sending HTTP 400 Bad Request" << endl;
 	}
-	if( writer.putS( response.formatResponse().c_str() ) == -1 ){
-	  if( loglevel >= 1 ) logfile << "Error sending IIPResponse" << endl;
+      }
+
+      // Memory allocation errors through std::bad_alloc
+      catch( const bad_alloc& error ){
+	string message = "Unable to allocate memory";
+	string status = "Status: 500 Internal Server Error\r\nServer: iipsrv/" + version +
+	  "\r\nContent-Type: text/plain; charset=utf-8" +
+	  (response.getCORS().length() ? "\r\n" + response.getCORS() : "") +
+	  "\r\n\r\n" + message;
+	writer.putS( status.c_str() );
+	writer.flush();
+	if( loglevel >= 1 ){
+	  logfile << "Error: " << message << endl;
+	  logfile << "Sending HTTP 500 Internal Server Error" << endl;
 	}
       }
-      else{
-	// Display our advertising banner ;-)
-	if( writer.putS( response.getAdvert().c_str() ) == -1 ){
-	  if( loglevel >= 1 ) logfile << "Error sending IIPImage banner" << endl;
+
+      /* Default catch
+       */
+      catch( ... ){
+
+	if( loglevel >= 1 ){
+	  logfile << "Error: Default Catch: " << endl << endl;
 	}
+
+	/* Display our advertising banner ;-)
+	 */
+	writer.putS( response.getAdvert().c_str() );
+
       }
 
-    }
 
-    // Image file errors
-    catch( const file_error& error ){
-      string status = "Status: 404 Not Found\r\nServer: iipsrv/" + version +
-	"\r\nContent-Type: text/plain; charset=utf-8" +
-	(response.getCORS().length() ? "\r\n" + response.getCORS() : "") +
-	"\r\n\r\n" + error.what();
-      writer.putS( status.c_str() );
-      writer.flush();
-      if( loglevel >= 2 ){
-	logfile << error.what() << endl;
-	logfile << "Sending HTTP 404 Not Found" << endl;
+      /* Do some cleaning up etc. here after all the potential exceptions
+	 have been handled
+       */
+      if( task ){
+	delete task;
+	task = NULL;
       }
-    }
+      delete image;
+      image = NULL;
+      IIPcount ++;
+
 
-    // Parameter errors
-    catch( const invalid_argument& error ){
-      string status = "Status: 400 Bad Request\r\nServer: iipsrv/" + version +
-	"\r\nContent-Type: text/plain; charset=utf-8" +
-	(response.getCORS().length() ? "\r\n" + response.getCORS() : "") +
-	"\r\n\r\n" + error.what();
-      writer.putS( status.c_str() );
-      writer.flush();
+      // How long did this request take?
       if( loglevel >= 2 ){
-	logfile << error.what() << endl;
-	logfile << "Sending HTTP 400 Bad Request" << endl;
+	logfile << "Total Request Time: " << request_timer.getTime() << " microseconds" << endl
+		<< "Image closed and deleted" << endl
+		<< "Server count: " << IIPcount << endl << endl;
       }
+
+    };
+
+
+#ifdef DEBUG
+
+    // When in debug mode, listen for requests on standard in and output to a file
+    while( getline( cin, request_string ) ){
+      FILE *f = fopen( "iipsrv.debug", "w" );
+      if( f == NULL ) exit( 1 );
+      FileWriter writer( f );
+      process( NULL, "", writer );
+      fclose( f );
     }
 
-    // Memory allocation errors through std::bad_alloc
-    catch( const bad_alloc& error ){
-      string message = "Unable to allocate memory";
-      string status = "Status: 500 Internal Server Error\r\nServer: iipsrv/" + version +
-	"\r\nContent-Type: text/plain; charset=utf-8" +
-	(response.getCORS().length() ? "\r\n" + response.getCORS() : "") +
-	"\r\n\r\n" + message;
-      writer.putS( status.c_str() );
-      writer.flush();
-      if( loglevel >= 1 ){
-	logfile << "Error: " << message << endl;
-	logfile << "Sending HTTP 500 Internal Server Error" << endl;
+    (void) server;
+
+#else
+
+#ifdef HAVE_EPOLL
+    // Process requests received through our event-driven front end
+    if( server ){
+      shared_ptr<EventRequest> r;
+      while( (r = server->next()) ){
+	if( overload.enabled() ){
+	  double delay = r->queued.getTime() / 1000.0;
+	  delay += OverloadController::requestStartDelay( FCGX_GetParam( "HTTP_X_REQUEST_START", &(r->envp[0]) ) );
+	  overload.update( delay );
+	}
+	EventWriter writer( server, r );
+	request_string.clear();
+	process( &(r->envp[0]), r->content, writer );
+	writer.finish();
       }
+      return;
+    }
+#endif
+
+    // Otherwise, accept requests via libfcgi. Initialize our FCGI request
+    FCGX_Request request;
+    if( FCGX_InitRequest( &request, listen_socket, 0 ) ){
+      if( loglevel >= 1 ) logfile << "Unable to initialize FCGI request" << endl;
+      return;
     }
 
-    /* Default catch
-     */
-    catch( ... ){
+    // In FCGI mode, listen for FCGI requests
+    while( true ){
 
-      if( loglevel >= 1 ){
-	logfile << "Error: Default Catch: " << endl << endl;
+      {
+	lock_guard<mutex> lock( accept_mutex );
+	// Register ourselves only while in accept(), so that our watcher never interrupts
+	// the reading or writing of a request, which libfcgi treats as a stream error
+#ifndef WIN32
+	{
+	  lock_guard<mutex> registration( accepting_mutex );
+	  accepting.push_back( pthread_self() );
+	}
+#endif
+	int status = FCGX_Accept_r( &request );
+#ifndef WIN32
+	{
+	  lock_guard<mutex> registration( accepting_mutex );
+	  for( unsigned int i=0; i<accepting.size(); i++ ){
+	    if( pthread_equal( accepting[i], pthread_self() ) ){
+	      accepting.erase( accepting.begin() + i );
+	      break;
+	    }
+	  }
+	}
+#endif
+	if( status < 0 ) break;
       }
 
-      /* Display our advertising banner ;-)
-       */
-      writer.putS( response.getAdvert().c_str() );
+      // Our queue delay is the time from accepting the request until it is dispatched, which includes
+      // any wait for a scheduler slot, plus any time spent queued by a front end web server that sets
+      // an X-Request-Start header
+      Timer queue_timer;
+      queue_timer.start();
+
+      // Read any request body sent via POST
+      string content;
+      const char* length = FCGX_GetParam( "CONTENT_LENGTH", request.envp );
+      if( length && atoi( length ) > 0 ){
+	content.resize( atoi( length ) );
+	content.resize( FCGX_GetStr( &content[0], (int) content.size(), request.in ) );
+      }
+
+      // Wait for a scheduler slot for this class of request
+      Scheduler::Class priority = Scheduler::INTERACTIVE;
+      if( scheduler ){
+	const char* query = FCGX_GetParam( "QUERY_STRING", request.envp );
+	const char* uri = FCGX_GetParam( "REQUEST_URI", request.envp );
+	priority = Scheduler::classify( query ? query : "", uri ? uri : "" );
+	if( loglevel >= 3 ) logfile << "Scheduling " << Scheduler::name( priority ) << " request" << endl;
+      }
+      SchedulerSlot slot( scheduler, priority );
+
+      // Too many requests of this class are already waiting: ask the client to retry later rather
+      // than hold another worker thread
+      if( !slot.isAcquired() ){
+	FCGIWriter writer( request.out );
+	string status = "Status: 503 Service Unavailable\r\nServer: iipsrv/" + version +
+	  "\r\nRetry-After: 1\r\nContent-Type: text/plain; charset=utf-8" +
+	  (cors.length() ? "\r\nAccess-Control-Allow-Origin: " + cors : "") +
+	  "\r\n\r\nServer busy";
+	writer.putS( status.c_str() );
+	writer.flush();
+	if( loglevel >= 2 ) logfile << "Too many " << Scheduler::name( priority ) << " requests waiting: sending HTTP 503 Service Unavailable" << endl;
+	continue;
+      }
+
+      if( overload.enabled() ){
+	double delay = queue_timer.getTime() / 1000.0;
+	delay += OverloadController::requestStartDelay( FCGX_GetParam( "HTTP_X_REQUEST_START", request.envp ) );
+	overload.update( delay );
+      }
 
+      FCGIWriter writer( request.out );
+      request_string.clear();
+      process( request.envp, content, writer );
     }
 
+    // Close our FCGI connection
+    FCGX_Finish_r( &request );
 
-    /* Do some cleaning up etc. here after all the potential exceptions
-       have been handled
-     */
-    if( task ){
-      delete task;
-      task = NULL;
+#endif
+
+  };
+
+
+  // Start our additional worker threads. The calling thread also acts as a worker
+  auto run_workers = [&](){
+
+    // Start our event-driven front end if requested. This must be done after any
+    // fork() as the network thread is not inherited by child processes
+    EventServer* server = NULL;
+#if defined(HAVE_EPOLL) && !defined(DEBUG)
+    if( http_mode ) server = new HTTPServer( listen_socket );
+    else if( event_loop || dispatched ) server = new FCGIServer( listen_socket );
+    if( server ){
+      try{
+	server->setScheduler( scheduler );
+	server->setDispatched( dispatched );
+	server->start();
+	if( loglevel >= 1 ) logfile << "Started event-driven " << server->getDescription() << " front end" << endl;
+      }
+      catch( const string& error ){
+	delete server;
+	server = NULL;
+	// We cannot fall back to libfcgi for HTTP or for connections passed by our dispatcher
+	if( http_mode || dispatched ){
+	  if( loglevel >= 1 ) logfile << error << endl;
+	  exit( 1 );
+	}
+	if( loglevel >= 1 ) logfile << error << ". Using libfcgi" << endl;
+      }
     }
-    delete image;
-    image = NULL;
-    IIPcount ++;
+#endif
 
+    // Bind each worker thread before it starts any OpenMP or Kakadu helper threads, which
+    // inherit its binding. In prefork mode, all threads of a process share the same node
+    auto place = [&]( unsigned int n ){
+      if( placement == Topology::NONE ) return;
+      unsigned int node = (worker_processes > 0) ? worker_index : n;
+      unsigned int index = (worker_processes > 0) ? n : n / topology.getNumNodes();
+      unsigned int cpus = topology.bind( placement, node, index );
+#ifdef _OPENMP
+      // Size our OpenMP thread team to the cores we may now use
+      if( cpus > 0 ) omp_set_num_threads( cpus );
+#else
+      (void) cpus;
+#endif
+    };
+
+    // Shrink our caches when memory is under pressure rather than waiting for the kernel to
+    // kill us, and grow them back gradually once the pressure has been relieved. This must
+    // also be done after any fork(). Our shared memory tile cache cannot be resized
+    float cache_target = max_image_cache_size;
+    unsigned int calm = 0;
+    if( auto_cache_size && !shared_cache && cache_target > 0 ){
+      memoryMonitor.start( [&]( bool pressure ){
+	float size = tileCache->getMaxSize();
+	if( pressure ){
+	  calm = 0;
+	  if( metadataCache ) metadataCache->shrink( metadataCache->size() / 2 );
+	  if( size <= cache_target / 8 ) return;
+	  size = std::max( size * 3 / 4, cache_target / 8 );
+	}
+	// Wait for 30 checks without pressure before each step back up
+	else if( size < cache_target && ++calm >= 30 ){
+	  calm = 0;
+	  size = std::min( size + cache_target / 8, cache_target );
+	}
+	else return;
+	tileCache->resize( size );
+	if( loglevel >= 2 ){
+	  logfile << "Memory " << ( pressure ? "under pressure" : "pressure relieved" )
+		  << ": resizing tile cache to " << size << " MB" << endl;
+	}
+      } );
+    }
 
-#ifdef DEBUG
-    fclose( f );
+    // Stop our workers once a termination signal has been received. Our event-driven front end
+    // releases any waiting workers when stopped. Otherwise we interrupt any worker blocked in
+    // accept() with a signal, after which libfcgi returns rather than accepting again. Our listen
+    // socket may be shared with other processes, such as those of spawn-fcgi or our prefork
+    // siblings, so must be left untouched
+    atomic<bool> finished( false );
+    thread watcher( [&]{
+      while( !finished && !terminate_signal ) this_thread::sleep_for( chrono::milliseconds( 100 ) );
+      if( !terminate_signal ) return;
+#if defined(HAVE_EPOLL) && !defined(DEBUG)
+      if( server ){
+	server->stop();
+	return;
+      }
+#endif
+#ifdef WIN32
+      // libfcgi cannot be woken from accept() on Windows
+      exit( 0 );
+#else
+      // A worker may be about to call accept() when signalled, so repeat until all have stopped
+      while( !finished ){
+	{
+	  lock_guard<mutex> lock( accepting_mutex );
+	  for( unsigned int n=0; n<accepting.size(); n++ ) pthread_kill( accepting[n], SIGUSR2 );
+	}
+	this_thread::sleep_for( chrono::milliseconds( 100 ) );
+      }
+#endif
+    } );
+
+    // Run our worker loop. Each thread registers itself with our watcher while in accept()
+    auto run = [&]( unsigned int n ){
+      place( n );
+      worker( server );
+    };
+
+    vector<thread> workers;
+    for( unsigned int n=1; n<worker_threads; n++ ) workers.push_back( thread( run, n ) );
+    run( 0 );
+    for( unsigned int n=0; n<workers.size(); n++ ) workers[n].join();
+    finished = true;
+    watcher.join();
+    memoryMonitor.stop();
+
+#ifdef HAVE_EPOLL
+    if( server && !server->getError().empty() && loglevel >= 1 ) logfile << server->getError() << endl;
+    delete server;
 #endif
+  };
 
 
-    // How long did this request take?
-    if( loglevel >= 2 ){
-      logfile << "Total Request Time: " << request_timer.getTime() << " microseconds" << endl
-	      << "Image closed and deleted" << endl
-	      << "Server count: " << IIPcount << endl << endl;
+#ifdef HAVE_SHARED_CACHE
+
+  /***********************************************************
+    Prefork mode: our master process forks our worker processes,
+    which all accept requests on the inherited listen socket.
+    Any worker that exits is replaced, while the shared tile
+    cache remains held by the master. With image affinity, the
+    master instead accepts all connections and dispatches each
+    to the worker responsible for the image requested.
+  ***********************************************************/
+
+  if( worker_processes > 0 ){
+
+    worker_pids.assign( worker_processes, 0 );
+
+#if defined(HAVE_EPOLL) && !defined(DEBUG)
+    Dispatcher* dispatcher = NULL;
+    if( image_affinity ){
+      try{
+	dispatcher = new Dispatcher( listen_socket, worker_processes, http_mode );
+      }
+      catch( const string& error ){
+	if( loglevel >= 1 ) logfile << error << ". Disabling image affinity" << endl;
+      }
     }
+#endif
+
+    while( true ){
+
+      // Pass on any termination signal to our workers and wait for them to save their own
+      // snapshots and exit before we save our shared cache
+      if( terminate_signal ){
+	for( unsigned int n=0; n<worker_processes; n++ ){
+	  if( worker_pids[n] > 0 ) kill( worker_pids[n], terminate_signal );
+	}
+	for( unsigned int n=0; n<worker_processes; n++ ){
+	  if( worker_pids[n] > 0 ) waitpid( worker_pids[n], NULL, 0 );
+	}
+	break;
+      }
+
+      // Fork any missing workers
+      for( unsigned int n=0; n<worker_processes; n++ ){
+
+	if( worker_pids[n] > 0 ) continue;
+
+#if defined(HAVE_EPOLL) && !defined(DEBUG)
+	// Create the channel over which this worker receives its connections
+	int channel = -1;
+	if( dispatcher ){
+	  try{
+	    channel = dispatcher->open( n );
+	  }
+	  catch( const string& error ){
+	    if( loglevel >= 1 ) logfile << error << endl;
+	    continue;
+	  }
+	}
+#endif
+
+	pid_t pid = fork();
+
+	if( pid == 0 ){
+	  // We are a worker. Re-seed our random number generator, run our request loop and exit
+	  worker_pids.clear();
+	  worker_index = n;
+#if defined(HAVE_EPOLL) && !defined(DEBUG)
+	  if( dispatcher ){
+	    dispatcher->release();
+	    listen_socket = channel;
+	    dispatched = true;
+	  }
+#endif
+	  srand( seed_timer.getTime() ^ getpid() );
+#ifdef HAVE_DISK_CACHE
+	  if( !disk_cache.empty() ) open_disk_cache( disk_cache + "." + to_string( n ) );
+#endif
+	  if( !cache_snapshot.empty() ){
+	    restore( cache_snapshot + "." + to_string( n ), shared_cache ? NULL : tileCache, metadataCache );
+	  }
+	  run_workers();
+	  IIPSaveSnapshot();
+	  if( loglevel >= 1 ){
+	    logfile << "Worker process " << getpid() << " terminating after " << IIPcount << " iterations" << endl;
+	    logfile.close();
+	  }
+	  delete tileCache;
+	  delete diskCache;
+	  delete scheduler;
+	  exit( 0 );
+	}
+	else if( pid < 0 ){
+	  if( loglevel >= 1 ) logfile << "Unable to fork worker process: " << strerror( errno ) << endl;
+	}
+	else{
+	  worker_pids[n] = pid;
+	  if( loglevel >= 2 ) logfile << "Started worker process " << pid << endl;
+	}
 
+#if defined(HAVE_EPOLL) && !defined(DEBUG)
+	// Only our worker needs its end of the channel
+	if( channel != -1 ) close( channel );
+#endif
+      }
 
+      // Pass on any cache reload request to our workers
+      int signal = reload_cache.exchange( 0 );
+      if( signal ){
+	tileCache->clear();
+	for( unsigned int n=0; n<worker_processes; n++ ){
+	  if( worker_pids[n] > 0 ) kill( worker_pids[n], signal );
+	}
+      }
+
+      // Check for any workers that have exited
+      int status;
+      pid_t pid = waitpid( -1, &status, WNOHANG );
+      if( pid > 0 ){
+	for( unsigned int n=0; n<worker_processes; n++ ){
+	  if( worker_pids[n] == pid ){
+	    worker_pids[n] = 0;
+#if defined(HAVE_EPOLL) && !defined(DEBUG)
+	    if( dispatcher ) dispatcher->close( n );
+#endif
+	  }
+	}
+	// Workers also exit cleanly when sent a termination signal individually. Only a termination
+	// signal sent to ourselves, which we check above, stops our pool, so always replace them
+	if( loglevel >= 1 ){
+	  logfile << "Worker process " << pid << " exited with ";
+	  if( WIFSIGNALED(status) ) logfile << "signal " << WTERMSIG(status);
+	  else logfile << "status " << WEXITSTATUS(status);
+	  logfile << ". Restarting" << endl;
+	}
+      }
+      else if( pid < 0 && errno == ECHILD ) break;
+#if defined(HAVE_EPOLL) && !defined(DEBUG)
+      // Dispatch incoming connections while waiting
+      else if( dispatcher ) dispatcher->poll( 1000 );
+#endif
+      else sleep( 1 );
+    }
+
+    worker_pids.clear();
+#if defined(HAVE_EPOLL) && !defined(DEBUG)
+    delete dispatcher;
+#endif
 
-    ///////// End of FCGI_ACCEPT while loop or while loop in debug mode //////////
   }
+  else run_workers();
 
+#else
 
-  // Avoid dangling global pointers
-  ic = NULL;
-  tc = NULL;
+  run_workers();
 
+#endif
 
-  // Close our FCGI connection
-#ifndef DEBUG
-  FCGX_Finish_r( &request );
+  // Report how effective our tile cache has been
+  Cache::Statistics cache_stats = tileCache->getStatistics();
+  if( loglevel >= 1 && cache_stats.hits + cache_stats.misses > 0 ){
+    logfile << "Tile cache hit ratio: " << cache_stats.hitRatio()
+	    << ", byte hit ratio: " << cache_stats.byteHitRatio() << endl;
+  }
+#ifdef HAVE_DISK_CACHE
+  if( diskCache && loglevel >= 1 ){
+    DiskCache *dc = static_cast<DiskCache*>( diskCache );
+    logfile << "Disk tile cache hits: " << dc->getHits() << ", misses: " << dc->getMisses()
+	    << ", tiles dropped: " << dc->getDropped() << endl;
+  }
 #endif
 
+  // Our workers have now stopped, so our caches can be safely saved
+  IIPSaveSnapshot();
+
+  delete tileCache;
+  delete diskCache;
+  delete scheduler;
+
 
   if( loglevel >= 1 ){
+    if( terminate_signal ){
+      time_t current_time = time( NULL );
+      char *date = ctime( &current_time );
+
+      // Remove trailing newline
+      date[strcspn(date, "\n")] = '\0';
+
+      // No strsignal on Windows
+#ifdef WIN32
+      int sigstr = terminate_signal;
+#else
+      const char *sigstr = strsignal( terminate_signal );
+#endif
+      logfile << endl << "Caught " << sigstr << " signal. " << date;
+    }
     logfile << endl << "Terminating after " << IIPcount << " iterations" << endl;
     logfile.close();
   }
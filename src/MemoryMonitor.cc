@@ -0,0 +1,222 @@
+// Container Memory Monitor Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+
+#include "MemoryMonitor.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+
+using namespace std;
+
+
+// Mount point of the cgroup v2 hierarchy
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+// System wide memory pressure, used if we have no cgroup
+#define SYSTEM_PRESSURE "/proc/pressure/memory"
+
+// Percentage of time stalled waiting for memory over the last 10 seconds above which we are under pressure
+#define PRESSURE_THRESHOLD 10.0
+
+// Fraction of our limit above which our working set is considered to be under pressure
+#define USAGE_THRESHOLD 0.9
+
+
+
+MemoryMonitor::MemoryMonitor() :
+  limit( 0 ),
+  limited( false ),
+  events( 0 ),
+  interval( 1000 ),
+  stopping( false )
+{
+  // Our cgroup v2 path is given by the "0::" entry of /proc/self/cgroup
+  ifstream file( "/proc/self/cgroup" );
+  string line;
+  while( getline( file, line ) ){
+    if( line.compare( 0, 3, "0::" ) != 0 ) continue;
+    string path = line.substr( 3 );
+    if( path == "/" ) path.clear();
+    string value;
+    if( read( CGROUP_ROOT + path + "/memory.current", value ) ) cgroup = CGROUP_ROOT + path;
+    // Within a cgroup namespace, our own cgroup is mounted at the root
+    else if( read( CGROUP_ROOT "/memory.current", value ) ) cgroup = CGROUP_ROOT;
+  }
+
+  // Our limit is the lowest of the limits of our cgroup and its ancestors
+  string dir = cgroup;
+  while( dir.size() > sizeof(CGROUP_ROOT) - 1 || dir == CGROUP_ROOT ){
+    const char* files[2] = { "/memory.max", "/memory.high" };
+    for( int i=0; i<2; i++ ){
+      string value;
+      unsigned long l;
+      // Unlimited cgroups have a value of "max"
+      if( read( dir + files[i], value ) && (l = strtoul( value.c_str(), NULL, 10 )) > 0 ){
+	if( limit == 0 || l < limit ) limit = l;
+	limited = true;
+      }
+    }
+    if( dir == CGROUP_ROOT ) break;
+    dir = dir.substr( 0, dir.rfind( '/' ) );
+  }
+
+  // Otherwise use the physical memory of the host
+#if defined(_SC_PHYS_PAGES) && defined(_SC_PAGE_SIZE)
+  if( limit == 0 ){
+    long pages = sysconf( _SC_PHYS_PAGES );
+    long size = sysconf( _SC_PAGE_SIZE );
+    if( pages > 0 && size > 0 ) limit = (unsigned long) pages * size;
+  }
+#endif
+
+  if( !cgroup.empty() ) events = readKey( cgroup + "/memory.events", "high" ) + readKey( cgroup + "/memory.events", "max" );
+}
+
+
+
+MemoryMonitor::~MemoryMonitor()
+{
+  stop();
+}
+
+
+
+bool MemoryMonitor::read( const string& path, string& value )
+{
+  ifstream file( path.c_str() );
+  if( !file ) return false;
+  file >> value;
+  return !file.fail();
+}
+
+
+
+unsigned long MemoryMonitor::readKey( const string& path, const string& key )
+{
+  ifstream file( path.c_str() );
+  string line;
+  while( getline( file, line ) ){
+    istringstream ss( line );
+    string name;
+    unsigned long value;
+    if( ss >> name >> value && name == key ) return value;
+  }
+  return 0;
+}
+
+
+
+unsigned long MemoryMonitor::getUsage() const
+{
+  if( !cgroup.empty() ){
+    string value;
+    if( !read( cgroup + "/memory.current", value ) ) return 0;
+    unsigned long current = strtoul( value.c_str(), NULL, 10 );
+    // The file cache of the images we read can be reclaimed by the kernel
+    unsigned long inactive = readKey( cgroup + "/memory.stat", "inactive_file" );
+    return ( current > inactive ) ? current - inactive : 0;
+  }
+
+  // Values in /proc/meminfo are given in kB
+  unsigned long total = readKey( "/proc/meminfo", "MemTotal:" );
+  unsigned long available = readKey( "/proc/meminfo", "MemAvailable:" );
+  return ( total > available ) ? (total - available) * 1024 : 0;
+}
+
+
+
+double MemoryMonitor::getPressure() const
+{
+  // Of the form: some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+  ifstream file( cgroup.empty() ? SYSTEM_PRESSURE : (cgroup + "/memory.pressure").c_str() );
+  string line;
+  while( getline( file, line ) ){
+    if( line.compare( 0, 4, "some" ) != 0 ) continue;
+    size_t avg = line.find( "avg10=" );
+    if( avg != string::npos ) return atof( line.c_str() + avg + 6 );
+  }
+  return 0;
+}
+
+
+
+bool MemoryMonitor::underPressure()
+{
+  bool pressure = false;
+
+  // Any new memory.high or memory.max events mean that the kernel has had to reclaim or throttle us
+  if( !cgroup.empty() ){
+    unsigned long e = readKey( cgroup + "/memory.events", "high" ) + readKey( cgroup + "/memory.events", "max" );
+    if( e > events ) pressure = true;
+    events = e;
+  }
+
+  if( getPressure() >= PRESSURE_THRESHOLD ) pressure = true;
+  if( limit > 0 && getUsage() > limit * USAGE_THRESHOLD ) pressure = true;
+
+  return pressure;
+}
+
+
+
+void MemoryMonitor::start( const function<void(bool)>& f, unsigned int ms )
+{
+  stop();
+  callback = f;
+  interval = ms;
+  stopping = false;
+  monitor = thread( &MemoryMonitor::run, this );
+}
+
+
+
+void MemoryMonitor::stop()
+{
+  {
+    lock_guard<std::mutex> lock( mutex );
+    stopping = true;
+  }
+  condition.notify_all();
+  if( monitor.joinable() ) monitor.join();
+}
+
+
+
+void MemoryMonitor::run()
+{
+  while( true ){
+    {
+      unique_lock<std::mutex> lock( mutex );
+      condition.wait_for( lock, chrono::milliseconds( interval ), [this]{ return stopping; } );
+      if( stopping ) return;
+    }
+    callback( underPressure() );
+  }
+}
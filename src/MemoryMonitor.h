@@ -0,0 +1,136 @@
+// Container Memory Monitor Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+
+#ifndef _MEMORYMONITOR_H
+#define _MEMORYMONITOR_H
+
+
+#include <string>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+
+
+/// Monitor of the memory limit and memory pressure of our cgroup
+/** Reads the memory limit, usage and pressure stall information (PSI) of the cgroup
+    v2 control group to which we belong, so that our caches can be sized to fit
+    within a container and shrunk before the kernel resorts to killing us. Where no
+    cgroup limit is set, the physical memory of the host is used as our limit and
+    system wide pressure information from /proc/pressure/memory is used. Memory is
+    considered to be under pressure if tasks have recently stalled waiting for
+    memory, if the cgroup has hit its memory.high or memory.max limits since we
+    last checked or if our working set, excluding reclaimable file cache, is close
+    to our limit.
+ */
+class MemoryMonitor {
+
+ private:
+
+  /// Directory of our cgroup or empty if not available
+  std::string cgroup;
+
+  /// Memory limit in bytes
+  unsigned long limit;
+
+  /// Whether our limit is imposed by a cgroup
+  bool limited;
+
+  /// Number of times our cgroup has hit its limits when we last checked
+  unsigned long events;
+
+  /// Function called at each check
+  std::function<void(bool)> callback;
+
+  /// Interval between checks in milliseconds
+  unsigned int interval;
+
+  /// Mutex and condition used to wake our thread when stopping
+  std::mutex mutex;
+  std::condition_variable condition;
+
+  /// Whether our thread should stop
+  bool stopping;
+
+  /// Background monitoring thread
+  std::thread monitor;
+
+
+  /// Monitoring thread loop
+  void run();
+
+  /// Read the first value of a file
+  /** @param path file path
+      @param value value read
+      @return whether the file could be read
+   */
+  static bool read( const std::string& path, std::string& value );
+
+  /// Read a named value from a file of key value pairs, such as memory.stat
+  /** @param path file path
+      @param key name of value
+      @return value or 0 if not found
+   */
+  static unsigned long readKey( const std::string& path, const std::string& key );
+
+
+ public:
+
+  /// Constructor - locates our cgroup and reads our memory limit
+  MemoryMonitor();
+
+  /// Destructor - stops any monitoring thread
+  ~MemoryMonitor();
+
+  /// Return our memory limit in MB
+  /** @return the cgroup memory limit or, if there is none, the physical memory of the host */
+  float getLimit() const { return limit / 1024000.0; };
+
+  /// Return whether our limit is imposed by a cgroup
+  bool hasCgroupLimit() const { return limited; };
+
+  /// Return our current working set in bytes: memory in use less inactive file cache
+  unsigned long getUsage() const;
+
+  /// Return the percentage of time some tasks stalled waiting for memory over the last 10 seconds
+  /** @return percentage or 0 if pressure stall information is not available */
+  double getPressure() const;
+
+  /// Check whether memory is currently under pressure
+  /** Updates our count of limit events, so should only be called from one thread */
+  bool underPressure();
+
+  /// Start checking for pressure in a background thread
+  /** @param f function called after each check with whether memory is under pressure
+      @param ms interval between checks in milliseconds
+   */
+  void start( const std::function<void(bool)>& f, unsigned int ms = 1000 );
+
+  /// Stop our background thread
+  void stop();
+
+};
+
+
+#endif
@@ -0,0 +1,197 @@
+// NUMA Node Partitioned Tile Cache Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef _NUMACACHE_H
+#define _NUMACACHE_H
+
+
+#include <vector>
+#include <atomic>
+#include "Cache.h"
+#include "Topology.h"
+
+
+
+/// Tile cache partitioned into one shard per NUMA node
+/** Tiles are inserted into the shard of the node on which the inserting thread
+    is running. As the tile data is copied by that thread, its memory is also
+    allocated on that node. Lookups first search the local shard and only search
+    the shards of other nodes on a local miss. Tiles evicted from any shard are
+    passed to our second tier, which is only searched once all shards have missed,
+    and tiles found there are returned to the local shard. Decodes in progress are
+    tracked across all nodes by our base class.
+ */
+class NUMACache : public Cache {
+
+ private:
+
+  /// Our node topology
+  const Topology& topology;
+
+  /// One cache per node
+  std::vector<Cache*> shards;
+
+  /// Optional second tier shared by all our shards
+  SecondaryCache* secondary;
+
+  /// Counters for our hit and byte hit ratios, which count each lookup once whichever shards it searches
+  std::atomic<unsigned long> hits, misses, hitBytes;
+
+
+ public:
+
+  /// Constructor
+  /** @param max maximum total cache size in MB, which is divided equally between our nodes
+      @param t node topology
+      @param s total number of lock shards, which are divided equally between our nodes
+      @param p eviction policy
+      @param a whether to filter new tiles with W-TinyLFU admission
+      @param z whether to store RAW tiles compressed
+      @param d whether tiles with identical data should share a single buffer within each node
+   */
+  NUMACache( const float max, const Topology& t, unsigned int s = 1, Policy p = LRU, bool a = false, bool z = false, bool d = false ) :
+    Cache( 0 ), topology( t ), secondary( NULL ), hits( 0 ), misses( 0 ), hitBytes( 0 ) {
+    unsigned int n = topology.getNumNodes();
+    for( unsigned int i=0; i<n; i++ ) shards.push_back( new Cache( max / n, (s + n - 1) / n, p, a, z, d ) );
+  };
+
+  /// Destructor
+  ~NUMACache(){
+    for( unsigned int i=0; i<shards.size(); i++ ) delete shards[i];
+  };
+
+  /// Empty all our shards
+  void clear(){
+    for( unsigned int i=0; i<shards.size(); i++ ) shards[i]->clear();
+  };
+
+  /// Insert a tile into the shard of the current node
+  /** Parameters as for Cache::insert() */
+  void insert( const RawTile& r, unsigned long cost = 0 ){
+    shards[ topology.currentNode() % shards.size() ]->insert( r, cost );
+  };
+
+  /// Return the total maximum size of all our shards in MB
+  float getMaxSize() const {
+    float size = 0;
+    for( unsigned int i=0; i<shards.size(); i++ ) size += shards[i]->getMaxSize();
+    return size;
+  };
+
+  /// Divide a new maximum size equally between our shards
+  /** Parameters as for Cache::resize() */
+  void resize( const float max ){
+    for( unsigned int i=0; i<shards.size(); i++ ) shards[i]->resize( max / shards.size() );
+  };
+
+  /// Pin an image in all our shards
+  /** Parameters as for Cache::pin() */
+  void pin( const std::string& f ){
+    for( unsigned int i=0; i<shards.size(); i++ ) shards[i]->pin( f );
+  };
+
+  /// Place a second tier behind all our shards
+  /** Our shards pass evicted tiles to it, but only we look tiles up there, so that a tile
+   *  cached by another node is not read back from disk into the local shard
+   *  @param s second tier or NULL to remove it
+   *  @param lookup whether our lookups fall back to the second tier
+   */
+  void setSecondary( SecondaryCache* s, bool lookup = true ){
+    secondary = lookup ? s : NULL;
+    for( unsigned int i=0; i<shards.size(); i++ ) shards[i]->setSecondary( s, false );
+  };
+
+  /// Remove all tiles of an image from all our shards
+  /** Parameters as for Cache::purge() */
+  unsigned int purge( const std::string& f ){
+    unsigned int n = 0;
+    for( unsigned int i=0; i<shards.size(); i++ ) n += shards[i]->purge( f );
+    return n;
+  };
+
+  /// Remove the stale tiles of an image from all our shards
+  /** Parameters as for Cache::expire() */
+  unsigned int expire( const std::string& f, time_t timestamp ){
+    unsigned int n = 0;
+    for( unsigned int i=0; i<shards.size(); i++ ) n += shards[i]->expire( f, timestamp );
+    return n;
+  };
+
+  /// Return the total number of tiles in all our shards
+  unsigned int getNumElements() const {
+    unsigned int n = 0;
+    for( unsigned int i=0; i<shards.size(); i++ ) n += shards[i]->getNumElements();
+    return n;
+  };
+
+  /// Return the total number of MB stored in all our shards
+  float getMemorySize() const {
+    float size = 0;
+    for( unsigned int i=0; i<shards.size(); i++ ) size += shards[i]->getMemorySize();
+    return size;
+  };
+
+  /// Return our hit and miss counters
+  /** Bytes inserted after misses are summed over all our shards */
+  Statistics getStatistics() const {
+    Statistics stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.hitBytes = hitBytes;
+    for( unsigned int i=0; i<shards.size(); i++ ) stats.missBytes += shards[i]->getStatistics().missBytes;
+    return stats;
+  };
+
+  /// Visit the tiles of each of our shards in turn
+  /** Parameters as for Cache::visit() */
+  bool visit( const std::function<void(const RawTile&)>& f ){
+    bool ok = true;
+    for( unsigned int i=0; i<shards.size(); i++ ) ok = shards[i]->visit( f ) && ok;
+    return ok;
+  };
+
+  /// Get a tile, searching the shard of the current node first, then those of other nodes
+  /// and finally our second tier
+  /** Parameters as for Cache::getTile() */
+  bool getTile( const std::string& f, int r, int t, int h, int v, ImageEncoding c, int q, RawTile& tile ){
+    unsigned int local = topology.currentNode() % shards.size();
+    bool found = shards[local]->getTile( f, r, t, h, v, c, q, tile );
+    for( unsigned int i=0; i<shards.size() && !found; i++ ){
+      if( i != local ) found = shards[i]->getTile( f, r, t, h, v, c, q, tile );
+    }
+    if( !found && secondary && secondary->getTile( this->getIndex( f, r, t, h, v, c, q ), tile ) ){
+      shards[local]->promote( tile );
+      found = true;
+    }
+    if( !found ){
+      misses++;
+      return false;
+    }
+    hits++;
+    hitBytes += tile.dataLength;
+    return true;
+  };
+
+};
+
+
+#endif
@@ -0,0 +1,97 @@
+// Overload Degradation Controller Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#include "OverloadController.h"
+
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+
+
+using namespace std;
+
+
+// Weight given to each new sample in our moving average
+#define SMOOTHING 0.2
+
+// Fraction of a threshold below which the average must fall before we leave a level
+#define HYSTERESIS 0.8
+
+
+
+OverloadController::OverloadController( const string& t ) : average( 0.0 ), level( 0 )
+{
+  size_t start = 0;
+  while( start < t.size() ){
+    size_t end = t.find( ',', start );
+    if( end == string::npos ) end = t.size();
+    double threshold = atof( t.substr( start, end - start ).c_str() );
+    if( threshold > 0 ) thresholds.push_back( threshold );
+    start = end + 1;
+  }
+  sort( thresholds.begin(), thresholds.end() );
+}
+
+
+
+void OverloadController::update( double delay )
+{
+  if( thresholds.empty() ) return;
+
+  lock_guard<std::mutex> lock( mutex );
+  average += SMOOTHING * ( delay - average );
+
+  // Move up as soon as a threshold is exceeded, but only move down once comfortably below it
+  unsigned int l = level;
+  while( l < thresholds.size() && average > thresholds[l] ) l++;
+  while( l > 0 && average < HYSTERESIS * thresholds[l-1] ) l--;
+  level = l;
+}
+
+
+
+double OverloadController::getDelay()
+{
+  lock_guard<std::mutex> lock( mutex );
+  return average;
+}
+
+
+
+double OverloadController::requestStartDelay( const char* header )
+{
+  if( !header ) return 0.0;
+  if( header[0] == 't' && header[1] == '=' ) header += 2;
+
+  double start = atof( header );
+  if( start <= 0 ) return 0.0;
+
+  // Convert to seconds: values are given in either seconds, milliseconds or microseconds
+  if( start > 1e14 ) start /= 1e6;
+  else if( start > 1e11 ) start /= 1e3;
+
+  double now = chrono::duration<double>( chrono::system_clock::now().time_since_epoch() ).count();
+  double delay = ( now - start ) * 1000.0;
+
+  // Ignore clock skew between hosts
+  return ( delay > 0 ) ? delay : 0.0;
+}
@@ -0,0 +1,93 @@
+// Overload Degradation Controller Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef _OVERLOADCONTROLLER_H
+#define _OVERLOADCONTROLLER_H
+
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+
+
+/// Controller lowering the cost of requests when the server is overloaded
+/** Tracks a smoothed average of the time requests spend queued before
+    processing starts. Each configured threshold exceeded by this average
+    raises the degradation level by one. Request handlers use the level to
+    lower their cost knobs: fewer JPEG2000 quality layers, cheaper output
+    encoding and nearest neighbour resampling. Responses produced while
+    degraded must not be cached.
+ */
+class OverloadController {
+
+ private:
+
+  /// Queue delay thresholds in milliseconds in increasing order
+  std::vector<double> thresholds;
+
+  /// Smoothed queue delay in milliseconds
+  double average;
+
+  /// Current degradation level
+  std::atomic<unsigned int> level;
+
+  /// Mutex protecting our average
+  std::mutex mutex;
+
+
+ public:
+
+  /// Constructor
+  /** @param t comma separated list of queue delay thresholds in milliseconds */
+  OverloadController( const std::string& t );
+
+  /// Whether any thresholds have been set
+  bool enabled() const { return !thresholds.empty(); };
+
+  /// Record the queue delay of a request about to be processed
+  /** @param delay queue delay in milliseconds */
+  void update( double delay );
+
+  /// Return the current degradation level: 0 = normal operation
+  unsigned int getLevel() const { return level; };
+
+  /// Return the smoothed queue delay in milliseconds
+  double getDelay();
+
+  /// Return the number of configured thresholds
+  unsigned int getNumThresholds() const { return thresholds.size(); };
+
+  /// Calculate the delay since the time given in an X-Request-Start header
+  /** Front end web servers can set this header to the time at which they received
+      the request, so that time spent queued before reaching us can be measured.
+      Accepts values of the form "t=<time>" in seconds, milliseconds or microseconds
+      @param header header value
+      @return delay in milliseconds or 0 if the header is invalid
+   */
+  static double requestStartDelay( const char* header );
+
+};
+
+
+#endif
@@ -108,8 +108,9 @@ void PNGCompressor::InitCompression( const RawTile& rawtile, unsigned int strip_
     (xmp.size() >0 ? (xmp.size()+XMP_OVERHEAD_SIZE) : 0) +
     (exif.size()>0 ? exif.size() : 0);
  
-  // Allocate enough memory for our header and metadata
+  // Allocate enough memory for our header and metadata, freeing any header left over from a previous image
   unsigned long output_size = metadata_size + MX;
+  if( header ) delete[] header;
   header = new unsigned char[output_size];
   dest.output = header;
   dest.output_size = output_size;     
@@ -314,6 +315,14 @@ unsigned int PNGCompressor::Compress( RawTile& rawtile )
   // Compress row by row
   unsigned char* data = (unsigned char*) rawtile.data;
   for( unsigned int i = 0; i < height; i++ ) {
+    // Periodically check whether our client has gone away
+    if( (i % 64 == 0) && cancelled() ){
+      png_destroy_write_struct( &(dest.png_ptr), &(dest.info_ptr) );
+      dest.png_ptr = NULL;
+      dest.info_ptr = NULL;
+      delete[] dest.output;
+      throw request_cancelled( "PNGCompressor :: request cancelled by client" );
+    }
     png_write_row( dest.png_ptr, (png_byte*) &data[i*ulRowBytes] );
   }  
   
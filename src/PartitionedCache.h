@@ -0,0 +1,213 @@
+// Path Prefix Partitioned Tile Cache Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+
+#ifndef _PARTITIONEDCACHE_H
+#define _PARTITIONEDCACHE_H
+
+
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include "Cache.h"
+
+
+
+/// Tile cache partitioned by image path prefix, with a separate quota for each partition
+/** Each partition is an independent Cache with its own size limit and eviction,
+    so that heavy use of the images of one partition, such as a crawler working
+    through a large collection, cannot evict the tiles of another. Images are
+    assigned to the partition with the longest matching prefix. Prefixes are
+    matched against image paths as requested, that is, relative to any
+    FILESYSTEM_PREFIX. Images matching no prefix share a default partition,
+    which receives whatever memory is not assigned to the other partitions.
+ */
+class PartitionedCache : public Cache {
+
+ private:
+
+  /// Prefix of each of our partitions other than our default partition
+  std::vector<std::string> prefixes;
+
+  /// Our partitions, with our default partition last
+  std::vector<Cache*> partitions;
+
+  /// Configured size of each partition in MB
+  std::vector<float> quotas;
+
+  /// Total configured size of all our partitions in MB
+  float total;
+
+
+  /// Return the partition of an image
+  /** @param f image path */
+  Cache* _partition( const std::string& f ) const {
+    unsigned int best = prefixes.size();
+    size_t length = 0;
+    for( unsigned int i=0; i<prefixes.size(); i++ ){
+      if( prefixes[i].size() > length && f.compare( 0, prefixes[i].size(), prefixes[i] ) == 0 ){
+	best = i;
+	length = prefixes[i].size();
+      }
+    }
+    return partitions[best];
+  };
+
+
+ public:
+
+  /// Constructor
+  /** @param max maximum total cache size in MB
+      @param spec comma separated list of partitions of the form prefix=MB
+      @param s number of lock shards of each partition
+      @param p eviction policy
+      @param a whether to filter new tiles with W-TinyLFU admission
+      @param z whether to store RAW tiles compressed
+      @param d whether tiles with identical data should share a single buffer within each partition
+   */
+  PartitionedCache( const float max, const std::string& spec, unsigned int s = 1, Policy p = LRU,
+		    bool a = false, bool z = false, bool d = false ) : Cache( 0 ), total( 0 ) {
+    float assigned = 0;
+    size_t start = 0;
+    while( start < spec.size() ){
+      size_t end = spec.find( ',', start );
+      if( end == std::string::npos ) end = spec.size();
+      std::string partition = spec.substr( start, end - start );
+      size_t equals = partition.rfind( '=' );
+      if( equals != std::string::npos && equals > 0 ){
+	float quota = atof( partition.substr( equals + 1 ).c_str() );
+	if( quota > 0 ){
+	  prefixes.push_back( partition.substr( 0, equals ) );
+	  partitions.push_back( new Cache( quota, s, p, a, z, d ) );
+	  quotas.push_back( quota );
+	  assigned += quota;
+	}
+      }
+      start = end + 1;
+    }
+    quotas.push_back( (assigned < max) ? max - assigned : 0 );
+    partitions.push_back( new Cache( quotas.back(), s, p, a, z, d ) );
+    total = assigned + quotas.back();
+  };
+
+  /// Destructor
+  ~PartitionedCache(){
+    for( unsigned int i=0; i<partitions.size(); i++ ) delete partitions[i];
+  };
+
+  /// Return the number of partitions, including our default partition
+  unsigned int getNumPartitions() const { return partitions.size(); };
+
+  /// Empty all our partitions
+  void clear(){
+    for( unsigned int i=0; i<partitions.size(); i++ ) partitions[i]->clear();
+  };
+
+  /// Insert a tile into the partition of its image
+  /** Parameters as for Cache::insert() */
+  void insert( const RawTile& r, unsigned long cost = 0 ){
+    this->_partition( r.filename )->insert( r, cost );
+  };
+
+  /// Remove all tiles of an image from its partition
+  /** Parameters as for Cache::purge() */
+  unsigned int purge( const std::string& f ){
+    return this->_partition( f )->purge( f );
+  };
+
+  /// Remove the stale tiles of an image from its partition
+  /** Parameters as for Cache::expire() */
+  unsigned int expire( const std::string& f, time_t timestamp ){
+    return this->_partition( f )->expire( f, timestamp );
+  };
+
+  /// Return the total maximum size of all our partitions in MB
+  float getMaxSize() const {
+    float size = 0;
+    for( unsigned int i=0; i<partitions.size(); i++ ) size += partitions[i]->getMaxSize();
+    return size;
+  };
+
+  /// Scale all our partitions in proportion to their configured sizes
+  /** Parameters as for Cache::resize() */
+  void resize( const float max ){
+    float scale = (total > 0) ? max / total : 0;
+    for( unsigned int i=0; i<partitions.size(); i++ ) partitions[i]->resize( quotas[i] * scale );
+  };
+
+  /// Pin an image within its partition
+  /** Parameters as for Cache::pin() */
+  void pin( const std::string& f ){
+    this->_partition( f )->pin( f );
+  };
+
+  /// Place a second tier behind each of our partitions
+  /** Parameters as for Cache::setSecondary() */
+  void setSecondary( SecondaryCache* s, bool lookup = true ){
+    for( unsigned int i=0; i<partitions.size(); i++ ) partitions[i]->setSecondary( s, lookup );
+  };
+
+  /// Return the total number of tiles in all our partitions
+  unsigned int getNumElements() const {
+    unsigned int n = 0;
+    for( unsigned int i=0; i<partitions.size(); i++ ) n += partitions[i]->getNumElements();
+    return n;
+  };
+
+  /// Return the total number of MB stored in all our partitions
+  float getMemorySize() const {
+    float size = 0;
+    for( unsigned int i=0; i<partitions.size(); i++ ) size += partitions[i]->getMemorySize();
+    return size;
+  };
+
+  /// Return the sum of the hit and miss counters of all our partitions
+  Statistics getStatistics() const {
+    Statistics stats;
+    for( unsigned int i=0; i<partitions.size(); i++ ){
+      Statistics s = partitions[i]->getStatistics();
+      stats.hits += s.hits;
+      stats.misses += s.misses;
+      stats.hitBytes += s.hitBytes;
+      stats.missBytes += s.missBytes;
+    }
+    return stats;
+  };
+
+  /// Visit the tiles of each of our partitions in turn
+  /** Parameters as for Cache::visit() */
+  bool visit( const std::function<void(const RawTile&)>& f ){
+    bool ok = true;
+    for( unsigned int i=0; i<partitions.size(); i++ ) ok = partitions[i]->visit( f ) && ok;
+    return ok;
+  };
+
+  /// Get a tile from the partition of its image
+  /** Parameters as for Cache::getTile() */
+  bool getTile( const std::string& f, int r, int t, int h, int v, ImageEncoding c, int q, RawTile& tile ){
+    return this->_partition( f )->getTile( f, r, t, h, v, c, q, tile );
+  };
+
+};
+
+
+#endif
@@ -27,6 +27,7 @@
 #include <cstdlib>
 #include <cstdint>
 #include <ctime>
+#include <memory>
 
 
 
@@ -99,6 +100,13 @@ class RawTile {
   /// Pointer to the image data
   void *data;
 
+  /// Reference-counted buffer holding our data if it is shared with other tiles
+  /** Shared data is immutable and is only freed once the last tile sharing it is
+      destroyed. Tiles in our tile cache hold their data in this way, so that cache
+      hits can return tiles without copying their data. See share() and unshare()
+   */
+  std::shared_ptr<void> shared;
+
 
   /// Main constructor
   /** @param tn tile number
@@ -159,7 +167,13 @@ class RawTile {
       data( NULL )
   {
 
-    if( tile.data && tile.dataLength > 0 ){
+    // Share the data of shared tiles rather than copying it
+    if( tile.isShared() ){
+      shared = tile.shared;
+      data = tile.data;
+      memoryManaged = 0;
+    }
+    else if( tile.data && tile.dataLength > 0 ){
       allocate( tile.dataLength );
       memcpy( data, tile.data, tile.dataLength );
       memoryManaged = 1;
@@ -174,6 +188,11 @@ class RawTile {
 
     if( this != &tile ){
 
+      // Free any existing data before it is replaced
+      if( memoryManaged ) deallocate( data );
+      data = NULL;
+      shared.reset();
+
       tileNum = tile.tileNum;
       resolution = tile.resolution;
       hSequence = tile.hSequence;
@@ -191,7 +210,12 @@ class RawTile {
       sampleType = tile.sampleType;
       capacity = tile.capacity;
 
-      if( tile.data && tile.dataLength > 0 ){
+      if( tile.isShared() ){
+	shared = tile.shared;
+	data = tile.data;
+	memoryManaged = 0;
+      }
+      else if( tile.data && tile.dataLength > 0 ){
 	allocate( tile.dataLength );
 	memcpy( data, tile.data, tile.dataLength );
 	memoryManaged = 1;
@@ -210,13 +234,14 @@ class RawTile {
 
     if( size == 0 ) size = (uint32_t) width * height * channels * (bpc/8);
 
+    // Round up, as compressed data need not be a whole number of samples
     switch( bpc ){
       case 32:
-	if( sampleType == SampleType::FLOATINGPOINT ) data = new float[size/4];
-	else data = new int[size/4];
+	if( sampleType == SampleType::FLOATINGPOINT ) data = new float[(size+3)/4];
+	else data = new int[(size+3)/4];
 	break;
       case 16:
-	data = new unsigned short[size/2];
+	data = new unsigned short[(size+1)/2];
 	break;
       default:
 	data = new unsigned char[size];
@@ -233,19 +258,7 @@ class RawTile {
   void deallocate( void* buffer ) {
 
     if( buffer ){
-      switch( bpc ){
-        case 32:
-	  if( sampleType == SampleType::FLOATINGPOINT ) delete[] (float*) buffer;
-	  else delete[] (unsigned int*) buffer;
-	  break;
-        case 16:
-	  delete[] (unsigned short*) buffer;
-	  break;
-        default:
-	  delete[] (unsigned char*) buffer;
-	  break;
-      }
-
+      release( buffer, bpc, sampleType );
       buffer = NULL;
       capacity = 0;
       dataLength = 0;
@@ -254,6 +267,108 @@ class RawTile {
 
 
 
+  /// Free a data buffer allocated by allocate()
+  /** @param buffer data buffer
+      @param b bits per channel with which the buffer was allocated
+      @param s sample type with which the buffer was allocated
+   */
+  static void release( void* buffer, int b, SampleType s ) {
+    switch( b ){
+      case 32:
+	if( s == SampleType::FLOATINGPOINT ) delete[] (float*) buffer;
+	else delete[] (unsigned int*) buffer;
+	break;
+      case 16:
+	delete[] (unsigned short*) buffer;
+	break;
+      default:
+	delete[] (unsigned char*) buffer;
+	break;
+    }
+  };
+
+
+
+  /// Whether our data is held in a shared buffer
+  bool isShared() const { return shared && data == shared.get(); };
+
+
+
+  /// Return a fast 64 bit hash of our data
+  /** Used to find tiles with identical content. Not cryptographically secure, so
+      tiles with equal hashes should be compared before being treated as identical
+   */
+  uint64_t digest() const {
+
+    const unsigned char* p = (const unsigned char*) data;
+    const uint64_t k1 = 0x9e3779b97f4a7c15ULL, k2 = 0xd6e8feb86659fd93ULL;
+    uint64_t lanes[4] = { k1, k2, k1 ^ k2, dataLength };
+    uint32_t i = 0;
+
+    // Mix 32 bytes at a time in four independent lanes
+    for( ; p && i + 32 <= dataLength; i += 32 ){
+      for( int l=0; l<4; l++ ){
+	uint64_t w;
+	memcpy( &w, p + i + l*8, 8 );
+	lanes[l] = ( lanes[l] ^ w ) * k1;
+	lanes[l] ^= lanes[l] >> 29;
+      }
+    }
+
+    uint64_t h = dataLength;
+    for( int l=0; l<4; l++ ){
+      h = ( h ^ lanes[l] ) * k2;
+      h ^= h >> 32;
+    }
+    for( ; p && i < dataLength; i++ ) h = ( h ^ p[i] ) * 0x100000001b3ULL;
+    h ^= h >> 29;
+    h *= k1;
+    h ^= h >> 32;
+    return h;
+  };
+
+
+
+  /// Move our data into a reference-counted buffer, which copies of this tile then share
+  /** The data must no longer be modified once shared. Use unshare() first if necessary
+   */
+  void share() {
+
+    if( isShared() || !data || dataLength == 0 ) return;
+
+    // Take a copy of data we do not own
+    if( !memoryManaged ){
+      void* buffer = data;
+      allocate( dataLength );
+      memcpy( data, buffer, dataLength );
+    }
+
+    int b = bpc;
+    SampleType s = sampleType;
+    shared = std::shared_ptr<void>( data, [b,s]( void* buffer ){ release( buffer, b, s ); } );
+    memoryManaged = 0;
+  };
+
+
+
+  /// Give this tile its own copy of any shared data so that it can be modified
+  void unshare() {
+
+    if( !shared ) return;
+
+    if( isShared() ){
+      void* buffer = data;
+      data = NULL;
+      if( dataLength > 0 ){
+	allocate( dataLength );
+	memcpy( data, buffer, dataLength );
+      }
+    }
+    shared.reset();
+  };
+
+
+
   /// Crop tile to the defined dimensions
   /** @param w width of cropped tile
       @param h height of cropped tile
@@ -283,6 +398,7 @@ class RawTile {
 
     // Delete original memory buffer
     if( mm ) deallocate( buffer );
+    shared.reset();
 
     // Set the new tile dimensions and data storage size
     capacity = len;   // Need to set this manually as deallocate sets this to zero
@@ -323,6 +439,7 @@ class RawTile {
 
     // Delete original memory buffer
     if( mm ) deallocate( buffer );
+    shared.reset();
 
     // Set the new tile dimensions and data storage size
     capacity = len;   // Need to set this manually as deallocate sets this to zero
@@ -387,10 +504,11 @@ class RawTile {
       data( NULL )
   {
 
-    if( tile.memoryManaged == 1 ){
+    if( tile.memoryManaged == 1 || tile.isShared() ){
 
       // Transfer ownership of data
       data = tile.data;
+      shared = std::move( tile.shared );
 
       // Free data from other RawTile
       tile.data = nullptr;
@@ -413,7 +531,10 @@ class RawTile {
 
     if( this != &tile ){
 
-      if( data && dataLength>0 ) delete this;
+      // Free any existing data before it is replaced
+      if( memoryManaged ) deallocate( data );
+      data = NULL;
+      shared.reset();
 
       // Use move for std::string. The other fields are of basic type
       filename = std::move( tile.filename );
@@ -433,10 +554,11 @@ class RawTile {
       bpc = tile.bpc;
       sampleType = tile.sampleType;
 
-      if( tile.memoryManaged == 1 ){
+      if( tile.memoryManaged == 1 || tile.isShared() ){
 
 	// Transfer ownership of raw data
 	data = tile.data;
+	shared = std::move( tile.shared );
 
 	// Free data from other tile
 	tile.data = nullptr;
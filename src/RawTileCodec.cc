@@ -0,0 +1,144 @@
+// Lossless RAW Tile Codec Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+
+#include "RawTileCodec.h"
+
+#include <vector>
+#include <cstring>
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+
+using namespace std;
+
+
+
+#ifdef HAVE_LZ4
+
+/// Scratch buffers for shuffled and compressed data, one per thread to avoid repeated allocation
+static thread_local vector<unsigned char> scratch;
+static thread_local vector<char> packed;
+
+
+/// Gather the bytes of each significance of n samples of k bytes each into contiguous planes
+static void shuffle( const unsigned char* in, unsigned char* out, size_t n, unsigned int k )
+{
+  for( unsigned int b=0; b<k; b++ ){
+    unsigned char* plane = out + b*n;
+    for( size_t i=0; i<n; i++ ) plane[i] = in[i*k + b];
+  }
+}
+
+
+/// Reverse shuffle()
+static void unshuffle( const unsigned char* in, unsigned char* out, size_t n, unsigned int k )
+{
+  for( unsigned int b=0; b<k; b++ ){
+    const unsigned char* plane = in + b*n;
+    for( size_t i=0; i<n; i++ ) out[i*k + b] = plane[i];
+  }
+}
+
+
+/// Copy the metadata of a tile and allocate a data buffer for it
+static void prepare( const RawTile& in, RawTile& out, uint32_t length )
+{
+  out = RawTile( in.tileNum, in.resolution, in.hSequence, in.vSequence, in.width, in.height, in.channels, in.bpc );
+  out.filename = in.filename;
+  out.timestamp = in.timestamp;
+  out.sampleType = in.sampleType;
+  out.compressionType = in.compressionType;
+  out.quality = in.quality;
+  out.allocate( length );
+  out.dataLength = length;
+}
+
+#endif
+
+
+
+bool RawTileCodec::available()
+{
+#ifdef HAVE_LZ4
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+
+bool RawTileCodec::compress( const RawTile& in, RawTile& out )
+{
+#ifdef HAVE_LZ4
+  if( !in.data || in.dataLength == 0 || in.dataLength > LZ4_MAX_INPUT_SIZE ) return false;
+
+  const char* source = (const char*) in.data;
+  unsigned int k = in.bpc / 8;
+  if( k > 1 && in.dataLength % k == 0 ){
+    scratch.resize( in.dataLength );
+    shuffle( (const unsigned char*) in.data, scratch.data(), in.dataLength / k, k );
+    source = (const char*) scratch.data();
+  }
+
+  // Only keep the result if it saves space
+  int bound = LZ4_compressBound( in.dataLength );
+  packed.resize( bound );
+  int length = LZ4_compress_default( source, packed.data(), in.dataLength, bound );
+  if( length <= 0 || (uint32_t) length >= in.dataLength ) return false;
+
+  prepare( in, out, length );
+  memcpy( out.data, packed.data(), length );
+  return true;
+#else
+  (void) in; (void) out;
+  return false;
+#endif
+}
+
+
+
+bool RawTileCodec::decompress( const RawTile& in, uint32_t length, RawTile& out )
+{
+#ifdef HAVE_LZ4
+  prepare( in, out, length );
+
+  unsigned int k = in.bpc / 8;
+  bool shuffled = ( k > 1 && length % k == 0 );
+  char* destination = (char*) out.data;
+  if( shuffled ){
+    scratch.resize( length );
+    destination = (char*) scratch.data();
+  }
+
+  if( LZ4_decompress_safe( (const char*) in.data, destination, in.dataLength, length ) != (int) length ) return false;
+
+  if( shuffled ) unshuffle( scratch.data(), (unsigned char*) out.data, length / k, k );
+  return true;
+#else
+  (void) in; (void) length; (void) out;
+  return false;
+#endif
+}
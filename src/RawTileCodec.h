@@ -0,0 +1,65 @@
+// Lossless RAW Tile Codec Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+
+#ifndef _RAWTILECODEC_H
+#define _RAWTILECODEC_H
+
+
+#include <cstdint>
+#include "RawTile.h"
+
+
+
+/// Fast lossless compression of RAW tile data held in our tile cache
+/** Uses LZ4 if available. Before compression, 16 and 32 bit samples are byte
+    shuffled, so that the bytes of equal significance of all samples are stored
+    together. The slowly varying high order bytes of image data then form long
+    runs that compress well, which they do not when interleaved with noisy low
+    order bytes. Without LZ4, compress() always fails and tiles are stored as is.
+ */
+class RawTileCodec {
+
+ public:
+
+  /// Whether compression is supported by this build
+  static bool available();
+
+  /// Compress the data of a RAW tile
+  /** @param in tile to compress
+      @param out tile set to a copy of the metadata of in with the compressed data
+      @return false if compression is unavailable or would not reduce the size of the tile
+   */
+  static bool compress( const RawTile& in, RawTile& out );
+
+  /// Decompress tile data compressed by compress()
+  /** @param in compressed tile
+      @param length uncompressed length of the tile data
+      @param out tile set to a copy of the metadata of in with the decompressed data
+      @return false if the data could not be decompressed
+   */
+  static bool decompress( const RawTile& in, uint32_t length, RawTile& out );
+
+};
+
+
+#endif
@@ -0,0 +1,192 @@
+// Request Scheduler Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#include "Scheduler.h"
+
+#include <vector>
+#include <algorithm>
+#include <cctype>
+
+
+using namespace std;
+
+
+
+// Whether a IIIF request path asks for the full resolution image
+static bool fullSize( const string& path )
+{
+  // IIIF image requests end in {region}/{size}/{rotation}/{quality}.{format}
+  vector<string> segments;
+  size_t start = 0;
+  while( true ){
+    size_t end = path.find( '/', start );
+    segments.push_back( path.substr( start, end - start ) );
+    if( end == string::npos ) break;
+    start = end + 1;
+  }
+  if( segments.size() < 4 ) return false;
+
+  string size = segments[ segments.size() - 3 ];
+
+  // Strip any upscaling prefix, which may be URL encoded
+  if( size.compare( 0, 3, "%5e" ) == 0 ) size.erase( 0, 3 );
+  else if( size.compare( 0, 1, "^" ) == 0 ) size.erase( 0, 1 );
+
+  return ( size == "max" || size == "full" );
+}
+
+
+
+Scheduler::Scheduler( unsigned int interactiveLimit, unsigned int bulkLimit, unsigned int interactiveWeight )
+{
+  limit[INTERACTIVE] = interactiveLimit;
+  limit[BULK] = bulkLimit;
+  weight[INTERACTIVE] = (interactiveWeight > 0) ? interactiveWeight : 1;
+  weight[BULK] = 1;
+
+  for( int c=0; c<NUM_CLASSES; c++ ){
+    running[c] = 0;
+    waiting[c] = 0;
+    maxWaiting[c] = -1;
+    served[c] = 0.0;
+  }
+}
+
+
+
+Scheduler::Class Scheduler::classify( const string& query, const string& uri )
+{
+  // Command names are case insensitive
+  string q = query;
+  transform( q.begin(), q.end(), q.begin(), ::tolower );
+
+  bool command = false;
+  size_t start = 0;
+
+  while( start < q.size() ){
+
+    size_t end = q.find( '&', start );
+    if( end == string::npos ) end = q.size();
+    string argument = q.substr( start, end - start );
+    start = end + 1;
+
+    size_t equals = argument.find( '=' );
+    if( equals == string::npos ) continue;
+    string name = argument.substr( 0, equals );
+
+    // Region exports are always bulk requests
+    if( name == "cvt" ) return BULK;
+
+    // As are full size IIIF requests
+    if( name == "iiif" ) return fullSize( argument.substr( equals + 1 ) ) ? BULK : INTERACTIVE;
+
+    command = true;
+  }
+
+  // Requests without a query command may be IIIF requests mapped through URI_MAP
+  if( !command && !uri.empty() ){
+    string path = uri.substr( 0, uri.find( '?' ) );
+    transform( path.begin(), path.end(), path.begin(), ::tolower );
+    if( fullSize( path ) ) return BULK;
+  }
+
+  return INTERACTIVE;
+}
+
+
+
+void Scheduler::start( int c )
+{
+  running[c]++;
+  served[c] += 1.0 / weight[c];
+
+  // Idle classes may not bank credit: bring them up to the class we have just started
+  for( int o=0; o<NUM_CLASSES; o++ ){
+    if( o != c && waiting[o] == 0 && served[o] < served[c] ) served[o] = served[c];
+  }
+}
+
+
+
+bool Scheduler::eligible( int c ) const
+{
+  // We need a free slot and no other waiting class with a free slot may be owed one first
+  if( !available( c ) ) return false;
+  for( int o=0; o<NUM_CLASSES; o++ ){
+    if( o != c && waiting[o] > 0 && available( o ) && served[o] < served[c] ) return false;
+  }
+  return true;
+}
+
+
+
+bool Scheduler::acquire( Class c )
+{
+  unique_lock<std::mutex> lock( mutex );
+
+  // Refuse rather than wait if this class already has as many waiting requests as allowed
+  if( maxWaiting[c] >= 0 && (int) waiting[c] >= maxWaiting[c] && !eligible( c ) ) return false;
+
+  waiting[c]++;
+  condition.wait( lock, [this,c]{ return eligible( c ); } );
+
+  waiting[c]--;
+  start( c );
+
+  // Our start may have made another waiting class eligible
+  lock.unlock();
+  condition.notify_all();
+  return true;
+}
+
+
+
+int Scheduler::tryAcquire( const bool pending[NUM_CLASSES] )
+{
+  lock_guard<std::mutex> lock( mutex );
+
+  // Choose the eligible class that has received the least weighted service
+  int chosen = -1;
+  for( int c=0; c<NUM_CLASSES; c++ ){
+    if( !pending[c] || !available( c ) ) continue;
+    if( chosen == -1 || served[c] < served[chosen] ) chosen = c;
+  }
+  if( chosen == -1 ) return -1;
+
+  // Treat queued classes as waiting so that they do not lose their accumulated position
+  for( int c=0; c<NUM_CLASSES; c++ ) if( pending[c] ) waiting[c]++;
+  start( chosen );
+  for( int c=0; c<NUM_CLASSES; c++ ) if( pending[c] ) waiting[c]--;
+
+  return chosen;
+}
+
+
+
+void Scheduler::release( Class c )
+{
+  {
+    lock_guard<std::mutex> lock( mutex );
+    if( running[c] > 0 ) running[c]--;
+  }
+  condition.notify_all();
+}
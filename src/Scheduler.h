@@ -0,0 +1,172 @@
+// Request Scheduler Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+
+#include <string>
+#include <mutex>
+#include <condition_variable>
+
+
+
+/// Priority-aware scheduler separating cheap tile requests from heavy requests
+/** Requests are classified as either interactive (tiles, metadata) or bulk (CVT
+    exports and full size IIIF requests). Each class has its own concurrency
+    limit and weight. When requests of both classes are waiting, slots are
+    granted in proportion to the class weights, so that a burst of exports can
+    neither monopolize our workers nor be starved completely.
+ */
+class Scheduler {
+
+ public:
+
+  /// Request classes
+  enum Class { INTERACTIVE = 0, BULK = 1 };
+
+  /// Number of request classes
+  static const int NUM_CLASSES = 2;
+
+
+ private:
+
+  /// Maximum number of requests of each class that may run concurrently (0 = unlimited)
+  unsigned int limit[NUM_CLASSES];
+
+  /// Relative weight of each class
+  unsigned int weight[NUM_CLASSES];
+
+  /// Number of requests of each class currently running
+  unsigned int running[NUM_CLASSES];
+
+  /// Number of requests of each class waiting in acquire()
+  unsigned int waiting[NUM_CLASSES];
+
+  /// Maximum number of requests of each class that may wait in acquire() (-1 = unlimited)
+  int maxWaiting[NUM_CLASSES];
+
+  /// Weighted count of requests of each class that have been started
+  double served[NUM_CLASSES];
+
+  /// Mutex protecting our counters
+  std::mutex mutex;
+
+  /// Condition variable signalling a released slot
+  std::condition_variable condition;
+
+
+  /// Whether a class has a free slot. Must be called with the lock held
+  bool available( int c ) const { return limit[c] == 0 || running[c] < limit[c]; };
+
+  /// Start a request of the given class. Must be called with the lock held
+  void start( int c );
+
+  /// Whether a request of the given class may start now. Must be called with the lock held
+  bool eligible( int c ) const;
+
+
+ public:
+
+  /// Constructor
+  /** @param interactiveLimit maximum concurrent interactive requests (0 = unlimited)
+      @param bulkLimit maximum concurrent bulk requests (0 = unlimited)
+      @param interactiveWeight weight of interactive requests relative to a weight of 1 for bulk requests
+   */
+  Scheduler( unsigned int interactiveLimit, unsigned int bulkLimit, unsigned int interactiveWeight );
+
+
+  /// Classify a request
+  /** @param query the QUERY_STRING of the request
+      @param uri the REQUEST_URI of the request, which is used for URI_MAP mapped requests
+      @return request class
+   */
+  static Class classify( const std::string& query, const std::string& uri );
+
+
+  /// Limit the number of requests of a class that may wait for a slot
+  /** Used with libfcgi, where each waiting request holds a worker thread, so that a burst
+      of bulk requests cannot occupy every thread and leave none to accept tile requests.
+      Must be called before the scheduler is used
+      @param c request class
+      @param n maximum number of waiting requests or -1 for no limit
+   */
+  void setMaxWaiting( Class c, int n ){ maxWaiting[c] = n; };
+
+
+  /// Wait for a slot for a request of the given class
+  /** @param c request class
+      @return true once a slot has been obtained or false, without waiting, if no slot is
+      free and the maximum number of requests of this class are already waiting
+   */
+  bool acquire( Class c );
+
+
+  /// Try to obtain a slot without waiting
+  /** Used by our event-driven front ends, which hold waiting requests in per-class queues.
+      @param pending whether requests of each class are queued
+      @return class for which a slot has been obtained or -1 if none
+   */
+  int tryAcquire( const bool pending[NUM_CLASSES] );
+
+
+  /// Release a slot
+  /** @param c request class */
+  void release( Class c );
+
+
+  /// Return a description of a class for logging
+  static const char* name( Class c ){ return (c == BULK) ? "bulk" : "interactive"; };
+
+};
+
+
+
+/// Scoped scheduler slot, which is automatically released on destruction
+class SchedulerSlot {
+
+ private:
+
+  Scheduler* scheduler;
+  Scheduler::Class c;
+  bool acquired;
+
+ public:
+
+  /// Constructor - waits for a slot
+  /** @param s scheduler or NULL if scheduling is disabled
+      @param cls request class
+   */
+  SchedulerSlot( Scheduler* s, Scheduler::Class cls ) : scheduler( s ), c( cls ), acquired( true ) {
+    if( scheduler ) acquired = scheduler->acquire( c );
+  };
+
+  /// Destructor - releases our slot
+  ~SchedulerSlot(){ if( scheduler && acquired ) scheduler->release( c ); };
+
+  /// Return whether a slot was obtained or the request was refused as too many are waiting
+  bool isAcquired() const { return acquired; };
+
+};
+
+
+#endif
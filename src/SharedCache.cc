@@ -0,0 +1,621 @@
+// Shared Memory Tile Cache Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#include "SharedCache.h"
+
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+using namespace std;
+
+
+// Value used to mark the end of a chain or list
+#define NONE -1
+
+
+
+/// Segment header
+struct SharedCache::Header {
+  pthread_mutex_t mutex;        ///< Process-shared mutex protecting all structures
+  uint32_t blockSize;           ///< Size of each arena block in bytes
+  int32_t numBlocks;            ///< Total number of arena blocks
+  int32_t numBuckets;           ///< Number of hash buckets (a power of 2)
+  int32_t freeBlock;            ///< Head of free block list
+  int32_t freeBlocks;           ///< Number of free blocks
+  int32_t freeEntry;            ///< Head of free entry list
+  int32_t lruHead;              ///< Most recently used entry
+  int32_t lruTail;              ///< Least recently used entry
+  uint32_t numElements;         ///< Number of tiles in cache
+  uint64_t hits;                ///< Number of lookups by all processes that found a tile
+  uint64_t misses;              ///< Number of lookups by all processes that did not
+  uint64_t hitBytes;            ///< Bytes of tile data returned by hits
+  uint64_t missBytes;           ///< Bytes of tile data inserted after misses
+};
+
+
+
+/// Cache entry holding the tile metadata and links to its data blocks
+struct SharedCache::Entry {
+  uint64_t hash;                ///< Hash of key
+  int32_t hashNext;             ///< Next entry in hash chain or free list
+  int32_t lruPrev;              ///< Previous entry in LRU list
+  int32_t lruNext;              ///< Next entry in LRU list
+  int32_t firstBlock;           ///< First block of data chain
+  int32_t numBlocks;            ///< Number of blocks used
+  uint32_t keyLength;           ///< Length of key stored at start of chain
+  uint32_t filenameLength;      ///< Length of filename stored after key
+  uint32_t dataLength;          ///< Length of tile data stored after filename
+  uint32_t width;
+  uint32_t height;
+  int32_t channels;
+  int32_t bpc;
+  int32_t sampleType;
+  int32_t compressionType;
+  int32_t quality;
+  int64_t timestamp;
+  int32_t tileNum;
+  int32_t resolution;
+  int32_t hSequence;
+  int32_t vSequence;
+};
+
+
+
+// Round up to a multiple of 8 bytes to keep our structures aligned
+static inline size_t align8( size_t n ){ return (n + 7) & ~((size_t)7); }
+
+
+
+SharedCache::SharedCache( const float max, unsigned int blockSize ) : Cache( 0 )
+{
+  segment = NULL;
+
+  size_t maxSize = (size_t)( max*1024000 );
+  if( blockSize < 512 ) blockSize = 512;
+
+  int32_t numBlocks = (int32_t)( maxSize / blockSize );
+  if( numBlocks < 16 ) numBlocks = 16;
+
+  // We need at most one entry per block. Use a power of 2 number of buckets
+  int32_t numBuckets = 1;
+  while( numBuckets < numBlocks ) numBuckets <<= 1;
+
+  size_t headerSize = align8( sizeof(Header) );
+  size_t entriesSize = align8( sizeof(Entry) * numBlocks );
+  size_t bucketsSize = align8( sizeof(int32_t) * numBuckets );
+  size_t nextSize = align8( sizeof(int32_t) * numBlocks );
+  segmentSize = headerSize + entriesSize + bucketsSize + nextSize + (size_t) numBlocks * blockSize;
+
+
+  // Create a uniquely named POSIX shared memory segment. We unlink the name as soon as
+  // it has been mapped, so that the segment is automatically freed once all processes
+  // holding the mapping have exited
+  stringstream name;
+  name << "/iipsrv-cache-" << getpid();
+
+  int fd = shm_open( name.str().c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR );
+  if( fd == -1 ){
+    throw string( "SharedCache :: unable to create shared memory segment: " ) + strerror( errno );
+  }
+
+  if( ftruncate( fd, segmentSize ) == -1 ){
+    string error = strerror( errno );
+    close( fd );
+    shm_unlink( name.str().c_str() );
+    throw string( "SharedCache :: unable to size shared memory segment: " ) + error;
+  }
+
+  segment = mmap( NULL, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+  close( fd );
+  shm_unlink( name.str().c_str() );
+
+  if( segment == MAP_FAILED ){
+    segment = NULL;
+    throw string( "SharedCache :: unable to map shared memory segment: " ) + strerror( errno );
+  }
+
+
+  // Set up pointers to each of our structures
+  unsigned char *p = (unsigned char*) segment;
+  header = (Header*) p;
+  entries = (Entry*) ( p + headerSize );
+  buckets = (int32_t*) ( p + headerSize + entriesSize );
+  blockNext = (int32_t*) ( p + headerSize + entriesSize + bucketsSize );
+  arena = p + headerSize + entriesSize + bucketsSize + nextSize;
+
+  header->blockSize = blockSize;
+  header->numBlocks = numBlocks;
+  header->numBuckets = numBuckets;
+
+  // Our counters are kept when the cache is emptied, as for Cache
+  header->hits = 0;
+  header->misses = 0;
+  header->hitBytes = 0;
+  header->missBytes = 0;
+
+
+  // Initialize our process-shared mutex. Make it robust where possible, so that a worker
+  // dying while holding the lock does not deadlock all other workers
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init( &attr );
+  pthread_mutexattr_setpshared( &attr, PTHREAD_PROCESS_SHARED );
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+  pthread_mutexattr_setrobust( &attr, PTHREAD_MUTEX_ROBUST );
+#endif
+  int status = pthread_mutex_init( &header->mutex, &attr );
+  pthread_mutexattr_destroy( &attr );
+
+  if( status != 0 ){
+    munmap( segment, segmentSize );
+    segment = NULL;
+    throw string( "SharedCache :: unable to initialize shared mutex: " ) + strerror( status );
+  }
+
+  this->reset();
+}
+
+
+
+SharedCache::~SharedCache()
+{
+  // Each process simply unmaps its copy - the segment itself is freed once the last mapping is removed
+  if( segment ) munmap( segment, segmentSize );
+}
+
+
+
+void SharedCache::lock() const
+{
+  int status = pthread_mutex_lock( &header->mutex );
+#ifdef HAVE_PTHREAD_MUTEXATTR_SETROBUST
+  // The previous owner died while holding the lock and our structures may therefore be
+  // inconsistent. Empty the cache before marking the mutex as usable again
+  if( status == EOWNERDEAD ){
+    const_cast<SharedCache*>(this)->reset();
+    pthread_mutex_consistent( &header->mutex );
+  }
+#else
+  (void) status;
+#endif
+}
+
+
+
+void SharedCache::unlock() const
+{
+  pthread_mutex_unlock( &header->mutex );
+}
+
+
+
+void SharedCache::reset()
+{
+  // Chain all blocks and entries into their free lists
+  for( int32_t i=0; i<header->numBlocks; i++ ){
+    blockNext[i] = (i+1 < header->numBlocks) ? i+1 : NONE;
+    entries[i].hashNext = (i+1 < header->numBlocks) ? i+1 : NONE;
+  }
+  for( int32_t i=0; i<header->numBuckets; i++ ) buckets[i] = NONE;
+
+  header->freeBlock = 0;
+  header->freeBlocks = header->numBlocks;
+  header->freeEntry = 0;
+  header->lruHead = NONE;
+  header->lruTail = NONE;
+  header->numElements = 0;
+}
+
+
+
+uint64_t SharedCache::hash( const string& key )
+{
+  uint64_t h = 14695981039346656037ULL;
+  for( size_t i=0; i<key.size(); i++ ){
+    h ^= (unsigned char) key[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+
+
+string SharedCache::index( const string& f, int r, int t, int h, int v, ImageEncoding c, int q )
+{
+  stringstream key;
+  key << f << ":" << r << ":" << t << ":" << h << ":" << v << ":" << (int)c << ":" << q;
+  return key.str();
+}
+
+
+
+void SharedCache::copy( int32_t block, size_t offset, void *buffer, size_t length, bool write ) const
+{
+  const size_t bs = header->blockSize;
+  unsigned char *ptr = (unsigned char*) buffer;
+
+  // Skip whole blocks to reach our offset
+  while( offset >= bs ){
+    block = blockNext[block];
+    offset -= bs;
+  }
+
+  while( length > 0 ){
+    size_t n = bs - offset;
+    if( n > length ) n = length;
+    unsigned char *b = arena + (size_t) block * bs + offset;
+    if( write ) memcpy( b, ptr, n );
+    else memcpy( ptr, b, n );
+    ptr += n;
+    length -= n;
+    offset = 0;
+    block = blockNext[block];
+  }
+}
+
+
+
+bool SharedCache::compare( int32_t block, const string& key ) const
+{
+  const size_t bs = header->blockSize;
+  const char *ptr = key.data();
+  size_t length = key.size();
+
+  // Compare our key block by block directly against the arena
+  while( length > 0 ){
+    size_t n = (length < bs) ? length : bs;
+    if( memcmp( arena + (size_t) block * bs, ptr, n ) != 0 ) return false;
+    ptr += n;
+    length -= n;
+    block = blockNext[block];
+  }
+
+  return true;
+}
+
+
+
+int32_t SharedCache::find( const string& key, uint64_t h ) const
+{
+  int32_t e = buckets[ h & (header->numBuckets-1) ];
+
+  while( e != NONE ){
+    const Entry& entry = entries[e];
+    if( entry.hash == h && entry.keyLength == key.size() && this->compare( entry.firstBlock, key ) ) return e;
+    e = entry.hashNext;
+  }
+
+  return NONE;
+}
+
+
+
+void SharedCache::touch( int32_t e )
+{
+  if( header->lruHead == e ) return;
+
+  Entry& entry = entries[e];
+
+  // Unlink from current position
+  if( entry.lruPrev != NONE ) entries[entry.lruPrev].lruNext = entry.lruNext;
+  if( entry.lruNext != NONE ) entries[entry.lruNext].lruPrev = entry.lruPrev;
+  if( header->lruTail == e ) header->lruTail = entry.lruPrev;
+
+  // Insert at head
+  entry.lruPrev = NONE;
+  entry.lruNext = header->lruHead;
+  if( header->lruHead != NONE ) entries[header->lruHead].lruPrev = e;
+  header->lruHead = e;
+  if( header->lruTail == NONE ) header->lruTail = e;
+}
+
+
+
+void SharedCache::remove( int32_t e )
+{
+  Entry& entry = entries[e];
+
+  // Unlink from our hash chain
+  int32_t *link = &buckets[ entry.hash & (header->numBuckets-1) ];
+  while( *link != NONE && *link != e ) link = &entries[*link].hashNext;
+  if( *link == e ) *link = entry.hashNext;
+
+  // Unlink from our LRU list
+  if( entry.lruPrev != NONE ) entries[entry.lruPrev].lruNext = entry.lruNext;
+  else header->lruHead = entry.lruNext;
+  if( entry.lruNext != NONE ) entries[entry.lruNext].lruPrev = entry.lruPrev;
+  else header->lruTail = entry.lruPrev;
+
+  // Return our blocks to the free list
+  int32_t last = entry.firstBlock;
+  while( blockNext[last] != NONE ) last = blockNext[last];
+  blockNext[last] = header->freeBlock;
+  header->freeBlock = entry.firstBlock;
+  header->freeBlocks += entry.numBlocks;
+
+  // And our entry
+  entry.hashNext = header->freeEntry;
+  header->freeEntry = e;
+  header->numElements--;
+}
+
+
+
+void SharedCache::clear()
+{
+  this->lock();
+  this->reset();
+  this->unlock();
+}
+
+
+
+void SharedCache::insert( const RawTile& r, unsigned long )
+{
+  string key = index( r.filename, r.resolution, r.tileNum,
+		      r.hSequence, r.vSequence, r.compressionType, r.quality );
+  uint64_t h = hash( key );
+
+  size_t total = key.size() + r.filename.size() + r.dataLength;
+  int32_t needed = (int32_t)( (total + header->blockSize - 1) / header->blockSize );
+
+  // Tiles larger than the entire cache cannot be stored
+  if( needed > header->numBlocks ) return;
+
+  this->lock();
+
+  header->missBytes += r.dataLength;
+
+  int32_t e = this->find( key, h );
+  if( e != NONE ){
+    // If the cached tile is up to date, simply touch it. Otherwise remove it
+    if( entries[e].timestamp >= (int64_t) r.timestamp ){
+      this->touch( e );
+      this->unlock();
+      return;
+    }
+    this->remove( e );
+  }
+
+  // Evict least recently used tiles until we have enough space
+  while( header->freeBlocks < needed && header->lruTail != NONE ){
+    this->remove( header->lruTail );
+  }
+
+  // Allocate our entry and chain of blocks
+  e = header->freeEntry;
+  header->freeEntry = entries[e].hashNext;
+
+  int32_t first = header->freeBlock;
+  int32_t last = first;
+  for( int32_t i=1; i<needed; i++ ) last = blockNext[last];
+  header->freeBlock = blockNext[last];
+  blockNext[last] = NONE;
+  header->freeBlocks -= needed;
+
+  Entry& entry = entries[e];
+  entry.hash = h;
+  entry.firstBlock = first;
+  entry.numBlocks = needed;
+  entry.keyLength = key.size();
+  entry.filenameLength = r.filename.size();
+  entry.dataLength = r.dataLength;
+  entry.width = r.width;
+  entry.height = r.height;
+  entry.channels = r.channels;
+  entry.bpc = r.bpc;
+  entry.sampleType = (int32_t) r.sampleType;
+  entry.compressionType = (int32_t) r.compressionType;
+  entry.quality = r.quality;
+  entry.timestamp = r.timestamp;
+  entry.tileNum = r.tileNum;
+  entry.resolution = r.resolution;
+  entry.hSequence = r.hSequence;
+  entry.vSequence = r.vSequence;
+
+  // Copy our key, filename and tile data into our block chain
+  this->copy( first, 0, (void*) key.data(), key.size(), true );
+  this->copy( first, key.size(), (void*) r.filename.data(), r.filename.size(), true );
+  if( r.dataLength > 0 ) this->copy( first, key.size() + r.filename.size(), r.data, r.dataLength, true );
+
+  // Link into our hash index and at the head of our LRU list
+  int32_t *bucket = &buckets[ h & (header->numBuckets-1) ];
+  entry.hashNext = *bucket;
+  *bucket = e;
+
+  entry.lruPrev = NONE;
+  entry.lruNext = header->lruHead;
+  if( header->lruHead != NONE ) entries[header->lruHead].lruPrev = e;
+  header->lruHead = e;
+  if( header->lruTail == NONE ) header->lruTail = e;
+
+  header->numElements++;
+
+  this->unlock();
+}
+
+
+
+void SharedCache::extract( int32_t e, RawTile& tile ) const
+{
+  const Entry& entry = entries[e];
+
+  // Free any existing buffer before we change the tile's bit depth
+  if( tile.memoryManaged && tile.data ) tile.deallocate( tile.data );
+  tile.data = NULL;
+
+  tile.width = entry.width;
+  tile.height = entry.height;
+  tile.channels = entry.channels;
+  tile.bpc = entry.bpc;
+  tile.sampleType = (SampleType) entry.sampleType;
+  tile.compressionType = (ImageEncoding) entry.compressionType;
+  tile.quality = entry.quality;
+  tile.timestamp = (time_t) entry.timestamp;
+  tile.tileNum = entry.tileNum;
+  tile.resolution = entry.resolution;
+  tile.hSequence = entry.hSequence;
+  tile.vSequence = entry.vSequence;
+
+  tile.filename.resize( entry.filenameLength );
+  if( entry.filenameLength > 0 ) this->copy( entry.firstBlock, entry.keyLength, &tile.filename[0], entry.filenameLength, false );
+
+  if( entry.dataLength > 0 ){
+    tile.allocate( entry.dataLength );
+    this->copy( entry.firstBlock, entry.keyLength + entry.filenameLength, tile.data, entry.dataLength, false );
+  }
+  tile.dataLength = entry.dataLength;
+}
+
+
+
+bool SharedCache::getTile( const string& f, int r, int t, int h, int v, ImageEncoding c, int q, RawTile& tile )
+{
+  string key = index( f, r, t, h, v, c, q );
+  uint64_t hs = hash( key );
+
+  this->lock();
+
+  int32_t e = this->find( key, hs );
+  if( e == NONE ){
+    header->misses++;
+    this->unlock();
+    return false;
+  }
+
+  this->touch( e );
+  this->extract( e, tile );
+  header->hits++;
+  header->hitBytes += tile.dataLength;
+
+  this->unlock();
+  return true;
+}
+
+
+
+bool SharedCache::visit( const function<void(const RawTile&)>& f )
+{
+  this->lock();
+  for( int32_t e = header->lruTail; e != NONE; e = entries[e].lruPrev ){
+    RawTile tile;
+    this->extract( e, tile );
+    f( tile );
+  }
+  this->unlock();
+  return true;
+}
+
+
+
+unsigned int SharedCache::purge( const string& f )
+{
+  unsigned int n = 0;
+  string filename;
+
+  this->lock();
+  int32_t e = header->lruTail;
+  while( e != NONE ){
+    int32_t prev = entries[e].lruPrev;
+    const Entry& entry = entries[e];
+    if( entry.filenameLength == f.size() ){
+      filename.resize( entry.filenameLength );
+      if( !filename.empty() ) this->copy( entry.firstBlock, entry.keyLength, &filename[0], entry.filenameLength, false );
+      if( filename == f ){
+	this->remove( e );
+	n++;
+      }
+    }
+    e = prev;
+  }
+  this->unlock();
+
+  return n;
+}
+
+
+
+unsigned int SharedCache::getNumElements() const
+{
+  this->lock();
+  unsigned int n = header->numElements;
+  this->unlock();
+  return n;
+}
+
+
+
+float SharedCache::getMemorySize() const
+{
+  this->lock();
+  float size = (float) ( (double)( header->numBlocks - header->freeBlocks ) * header->blockSize / 1024000.0 );
+  this->unlock();
+  return size;
+}
+
+
+
+float SharedCache::getMaxSize() const
+{
+  return (float) ( (double) header->numBlocks * header->blockSize / 1024000.0 );
+}
+
+
+
+void SharedCache::resize( const float )
+{
+  throw string( "SharedCache :: the shared memory tile cache cannot be resized" );
+}
+
+
+
+void SharedCache::pin( const string& )
+{
+  throw string( "SharedCache :: pinned images are not supported by the shared memory tile cache" );
+}
+
+
+
+void SharedCache::setSecondary( SecondaryCache* s, bool )
+{
+  if( s ) throw string( "SharedCache :: a second tier is not supported by the shared memory tile cache" );
+}
+
+
+
+Cache::Statistics SharedCache::getStatistics() const
+{
+  Statistics stats;
+  this->lock();
+  stats.hits = header->hits;
+  stats.misses = header->misses;
+  stats.hitBytes = header->hitBytes;
+  stats.missBytes = header->missBytes;
+  this->unlock();
+  return stats;
+}
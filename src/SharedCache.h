@@ -0,0 +1,210 @@
+// Shared Memory Tile Cache Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef _SHAREDCACHE_H
+#define _SHAREDCACHE_H
+
+
+#include <string>
+#include <cstdint>
+#include "Cache.h"
+
+
+
+/// LRU tile cache held within a POSIX shared memory segment
+/** This cache is created by the master process in prefork mode before any worker
+    processes are forked, so that all workers share the same tile store. Tiles
+    decoded by one worker can therefore be served by all other workers and the
+    contents of the cache survive the crash of any individual worker.
+
+    The segment consists of a header containing a process-shared mutex, a fixed
+    table of entries with a hash index and LRU list, and an arena of fixed-size
+    blocks. Each cached tile (its key, filename and data) is stored in a chain of
+    arena blocks. Links are stored as indices rather than pointers so that the
+    segment remains valid irrespective of where it is mapped. The header also
+    holds the hit and miss counters of all processes.
+ */
+
+class SharedCache : public Cache {
+
+ private:
+
+  struct Header;
+  struct Entry;
+
+  /// Pointer to the start of our mapped segment
+  void *segment;
+
+  /// Size of our mapped segment in bytes
+  size_t segmentSize;
+
+  /// Segment header
+  Header *header;
+
+  /// Table of entries
+  Entry *entries;
+
+  /// Hash index buckets
+  int32_t *buckets;
+
+  /// Per block link to the next block in a chain
+  int32_t *blockNext;
+
+  /// Start of our block arena
+  unsigned char *arena;
+
+
+  /// Lock our process-shared mutex, recovering if a previous owner died
+  void lock() const;
+
+  /// Unlock our process-shared mutex
+  void unlock() const;
+
+  /// Reset all cache structures. Must be called with the lock held
+  void reset();
+
+  /// Find an entry by key. Must be called with the lock held
+  /** @param key cache key
+      @param hash hash of the key
+      @return index of entry or -1 if not found
+   */
+  int32_t find( const std::string& key, uint64_t hash ) const;
+
+  /// Move an entry to the head of our LRU list
+  void touch( int32_t e );
+
+  /// Remove an entry and free its blocks
+  void remove( int32_t e );
+
+  /// Copy data into or out of a block chain starting at a given byte offset
+  /** @param block first block of chain
+      @param offset byte offset within the chain
+      @param buffer source or destination buffer
+      @param length number of bytes to copy
+      @param write whether to write into the chain rather than read from it
+   */
+  void copy( int32_t block, size_t offset, void *buffer, size_t length, bool write ) const;
+
+  /// Compare the key stored at the start of a block chain with a key
+  /** @param block first block of chain, which must hold at least as many bytes as the key
+      @param key cache key
+      @return whether the keys are identical
+   */
+  bool compare( int32_t block, const std::string& key ) const;
+
+  /// Copy an entry into a tile. Must be called with the lock held
+  /** @param e index of entry
+      @param tile RawTile into which the entry is copied
+   */
+  void extract( int32_t e, RawTile& tile ) const;
+
+  /// FNV-1a hash function
+  static uint64_t hash( const std::string& key );
+
+  /// Create the key under which a tile is stored
+  /** Our keys are shared between processes, so contain the image path itself rather
+      than the process-local interned id of a TileKey. Parameters as for Cache::getIndex()
+   */
+  static std::string index( const std::string& f, int r, int t, int h, int v, ImageEncoding c, int q );
+
+
+ public:
+
+  /// Constructor
+  /** Creates and maps the shared memory segment. Throws a string on error
+      @param max Maximum cache size in MB
+      @param blockSize size of each arena block in bytes
+   */
+  SharedCache( const float max, unsigned int blockSize = 8192 );
+
+  /// Destructor
+  ~SharedCache();
+
+  /// Empty the cache
+  void clear();
+
+  /// Insert a tile
+  /** @param r Tile to be inserted
+      @param cost generation cost, which is not used by our LRU eviction
+   */
+  void insert( const RawTile& r, unsigned long cost = 0 );
+
+  /// Remove all tiles of an image
+  /** As our keys are not indexed by image, this scans all our entries
+   *  @param f image path
+   *  @return number of tiles removed
+   */
+  unsigned int purge( const std::string& f );
+
+  /// Stale tiles are not removed in advance
+  /** As our keys are not indexed by image, finding the tiles of an image would mean scanning
+   *  all our entries for each image opened. Stale tiles are instead replaced as they are found
+   *  @return 0
+   */
+  unsigned int expire( const std::string&, time_t ){ return 0; };
+
+  /// Return the number of tiles in the cache
+  unsigned int getNumElements() const;
+
+  /// Return the number of MB stored
+  float getMemorySize() const;
+
+  /// Return the maximum size of the cache in MB, which is the size of our block arena
+  float getMaxSize() const;
+
+  /// Our segment cannot be resized once it has been mapped by our worker processes
+  /** Throws a string */
+  void resize( const float max );
+
+  /// Pinned images are not supported
+  /** Throws a string */
+  void pin( const std::string& f );
+
+  /// A second tier is not supported, as it would be private to a single process
+  /** Throws a string unless s is NULL. Parameters as for Cache::setSecondary() */
+  void setSecondary( SecondaryCache* s, bool lookup = true );
+
+  /// Return our hit and miss counters, which are shared by all processes
+  Statistics getStatistics() const;
+
+  /// Get a tile from the cache
+  /**
+   *  @param f filename
+   *  @param r resolution number
+   *  @param t tile number
+   *  @param h horizontal sequence number
+   *  @param v vertical sequence number
+   *  @param c compression type
+   *  @param q compression quality
+   *  @param tile RawTile into which a copy of the cached tile is made
+   *  @return whether the tile was found in the cache
+   */
+  bool getTile( const std::string& f, int r, int t, int h, int v, ImageEncoding c, int q, RawTile& tile );
+
+  /// Visit every tile in the cache from the least to the most recently used
+  /** Parameters as for Cache::visit() */
+  bool visit( const std::function<void(const RawTile&)>& f );
+
+};
+
+
+#endif
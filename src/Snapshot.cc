@@ -0,0 +1,381 @@
+// Cache Snapshot Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+
+#include "Snapshot.h"
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+
+using namespace std;
+
+
+// File identifier and format version
+#define SNAPSHOT_MAGIC "IIPSNAP"
+#define SNAPSHOT_VERSION 1
+
+// Marker used to detect snapshots written on a machine of different byte order
+#define SNAPSHOT_BYTE_ORDER 0x01020304
+
+// Limit on the length of any string or sequence, used to detect corrupt files
+#define SNAPSHOT_MAX_LENGTH 0x40000000
+
+
+
+// Write a fixed size value
+template <class T> static void put( ostream& out, const T& value )
+{
+  out.write( (const char*) &value, sizeof(T) );
+}
+
+
+// Read a fixed size value
+template <class T> static void get( istream& in, T& value )
+{
+  in.read( (char*) &value, sizeof(T) );
+}
+
+
+// Read and check the length of a string or sequence
+static uint32_t length( istream& in )
+{
+  uint32_t n = 0;
+  get( in, n );
+  if( !in || n > SNAPSHOT_MAX_LENGTH ) throw string( "Snapshot :: corrupt or truncated snapshot" );
+  return n;
+}
+
+
+// Write a string
+static void put( ostream& out, const string& s )
+{
+  put( out, (uint32_t) s.size() );
+  out.write( s.data(), s.size() );
+}
+
+
+// Read a string
+static void get( istream& in, string& s )
+{
+  s.resize( length( in ) );
+  if( !s.empty() ) in.read( &s[0], s.size() );
+}
+
+
+// Write a sequence of fixed size values
+template <class C> static void putSequence( ostream& out, const C& c )
+{
+  put( out, (uint32_t) c.size() );
+  for( typename C::const_iterator i = c.begin(); i != c.end(); ++i ) put( out, *i );
+}
+
+
+// Read a sequence of fixed size values
+template <class C> static void getSequence( istream& in, C& c )
+{
+  uint32_t n = length( in );
+  c.clear();
+  for( uint32_t i=0; i<n && in; i++ ){
+    typename C::value_type value;
+    get( in, value );
+    c.push_back( value );
+  }
+}
+
+
+
+void Snapshot::write( ostream& out, const IIPImage& image )
+{
+  put( out, image.imagePath );
+  put( out, image.fileSystemPrefix );
+  put( out, image.fileSystemSuffix );
+  put( out, image.fileNamePattern );
+  put( out, (uint8_t) image.isFile );
+  put( out, image.suffix );
+  putSequence( out, image.horizontalAnglesList );
+  putSequence( out, image.verticalAnglesList );
+  putSequence( out, image.lut );
+  put( out, (uint32_t) image.virtual_levels );
+  put( out, (int32_t) image.format );
+  put( out, (int32_t) image.pyramid );
+
+  put( out, (uint32_t) image.stack.size() );
+  for( list<Stack>::const_iterator i = image.stack.begin(); i != image.stack.end(); ++i ){
+    put( out, i->name );
+    put( out, i->scale );
+  }
+
+  putSequence( out, image.resolution_ids );
+  putSequence( out, image.image_widths );
+  putSequence( out, image.image_heights );
+  putSequence( out, image.tile_widths );
+  putSequence( out, image.tile_heights );
+  put( out, (int32_t) image.colorspace );
+  put( out, image.dpi_x );
+  put( out, image.dpi_y );
+  put( out, (int32_t) image.dpi_units );
+  put( out, (uint32_t) image.numResolutions );
+  put( out, (uint32_t) image.bpc );
+  put( out, (uint32_t) image.channels );
+  put( out, (int32_t) image.sampleType );
+  putSequence( out, image.min );
+  putSequence( out, image.max );
+  put( out, (uint32_t) image.quality_layers );
+  put( out, (uint8_t) image.isSet );
+  put( out, (int32_t) image.currentX );
+  put( out, (int32_t) image.currentY );
+  putSequence( out, image.histogram );
+
+  put( out, (uint32_t) image.metadata.size() );
+  for( map<const string,const string>::const_iterator i = image.metadata.begin(); i != image.metadata.end(); ++i ){
+    put( out, i->first );
+    put( out, i->second );
+  }
+
+  put( out, (int64_t) image.timestamp );
+}
+
+
+
+void Snapshot::read( istream& in, IIPImage& image )
+{
+  uint8_t u8;
+  uint32_t u32;
+  int32_t i32;
+  int64_t i64;
+
+  get( in, image.imagePath );
+  get( in, image.fileSystemPrefix );
+  get( in, image.fileSystemSuffix );
+  get( in, image.fileNamePattern );
+  get( in, u8 ); image.isFile = u8;
+  get( in, image.suffix );
+  getSequence( in, image.horizontalAnglesList );
+  getSequence( in, image.verticalAnglesList );
+  getSequence( in, image.lut );
+  get( in, u32 ); image.virtual_levels = u32;
+  get( in, i32 ); image.format = (ImageEncoding) i32;
+  get( in, i32 ); image.pyramid = (IIPImage::PyramidType) i32;
+
+  uint32_t n = length( in );
+  image.stack.clear();
+  for( uint32_t i=0; i<n && in; i++ ){
+    Stack s;
+    get( in, s.name );
+    get( in, s.scale );
+    image.stack.push_back( s );
+  }
+
+  getSequence( in, image.resolution_ids );
+  getSequence( in, image.image_widths );
+  getSequence( in, image.image_heights );
+  getSequence( in, image.tile_widths );
+  getSequence( in, image.tile_heights );
+  get( in, i32 ); image.colorspace = (ColorSpace) i32;
+  get( in, image.dpi_x );
+  get( in, image.dpi_y );
+  get( in, i32 ); image.dpi_units = i32;
+  get( in, u32 ); image.numResolutions = u32;
+  get( in, u32 ); image.bpc = u32;
+  get( in, u32 ); image.channels = u32;
+  get( in, i32 ); image.sampleType = (SampleType) i32;
+  getSequence( in, image.min );
+  getSequence( in, image.max );
+  get( in, u32 ); image.quality_layers = u32;
+  get( in, u8 ); image.isSet = u8;
+  get( in, i32 ); image.currentX = i32;
+  get( in, i32 ); image.currentY = i32;
+  getSequence( in, image.histogram );
+
+  n = length( in );
+  image.metadata.clear();
+  for( uint32_t i=0; i<n && in; i++ ){
+    string key, value;
+    get( in, key );
+    get( in, value );
+    image.metadata.insert( {key,value} );
+  }
+
+  get( in, i64 ); image.timestamp = (time_t) i64;
+
+  if( !in ) throw string( "Snapshot :: corrupt or truncated snapshot" );
+}
+
+
+
+void Snapshot::write( ostream& out, const RawTile& tile )
+{
+  put( out, tile.filename );
+  put( out, (uint32_t) tile.width );
+  put( out, (uint32_t) tile.height );
+  put( out, (int32_t) tile.channels );
+  put( out, (int32_t) tile.bpc );
+  put( out, (int32_t) tile.sampleType );
+  put( out, (int32_t) tile.compressionType );
+  put( out, (int32_t) tile.quality );
+  put( out, (int64_t) tile.timestamp );
+  put( out, (int32_t) tile.tileNum );
+  put( out, (int32_t) tile.resolution );
+  put( out, (int32_t) tile.hSequence );
+  put( out, (int32_t) tile.vSequence );
+  put( out, (uint32_t) tile.dataLength );
+  out.write( (const char*) tile.data, tile.dataLength );
+}
+
+
+
+void Snapshot::read( istream& in, RawTile& tile )
+{
+  uint32_t u32;
+  int32_t i32;
+  int64_t i64;
+
+  get( in, tile.filename );
+  get( in, u32 ); tile.width = u32;
+  get( in, u32 ); tile.height = u32;
+  get( in, i32 ); tile.channels = i32;
+  get( in, i32 ); tile.bpc = i32;
+  get( in, i32 ); tile.sampleType = (SampleType) i32;
+  get( in, i32 ); tile.compressionType = (ImageEncoding) i32;
+  get( in, i32 ); tile.quality = i32;
+  get( in, i64 ); tile.timestamp = (time_t) i64;
+  get( in, i32 ); tile.tileNum = i32;
+  get( in, i32 ); tile.resolution = i32;
+  get( in, i32 ); tile.hSequence = i32;
+  get( in, i32 ); tile.vSequence = i32;
+
+  uint32_t size = length( in );
+  if( tile.memoryManaged && tile.data ) tile.deallocate( tile.data );
+
+  // Round up our allocation so that it is never truncated for 16 or 32 bit tiles
+  tile.allocate( (size + 3) & ~3u );
+  in.read( (char*) tile.data, size );
+  tile.dataLength = size;
+
+  if( !in ) throw string( "Snapshot :: corrupt or truncated snapshot" );
+}
+
+
+
+void Snapshot::save( Cache* tileCache, ImageCache* imageCache )
+{
+  tiles = 0;
+  images = 0;
+
+  // Write to a temporary file so that any existing snapshot remains intact until we have finished
+  string tmp = path + ".tmp";
+  ofstream out( tmp.c_str(), ios::out | ios::binary | ios::trunc );
+  if( !out ) throw string( "Snapshot :: unable to open " + tmp + " for writing" );
+
+  out.write( SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC) );
+  put( out, (uint32_t) SNAPSHOT_VERSION );
+  put( out, (uint32_t) SNAPSHOT_BYTE_ORDER );
+
+  // Each image or tile is preceded by a non-zero marker and each list ends with a zero
+  string error;
+  if( imageCache ){
+    bool ok = imageCache->visit( [&]( const string& key, const IIPImage& image ){
+	put( out, (uint8_t) 1 );
+	put( out, key );
+	write( out, image );
+	images++;
+      } );
+    if( !ok ) error = "Snapshot :: unable to lock image metadata cache";
+  }
+  put( out, (uint8_t) 0 );
+
+  // Only save encoded tiles, which are both smaller and more costly to regenerate than RAW tiles
+  if( tileCache ){
+    bool ok = tileCache->visit( [&]( const RawTile& tile ){
+	if( tile.compressionType == ImageEncoding::RAW ) return;
+	put( out, (uint8_t) 1 );
+	write( out, tile );
+	tiles++;
+      } );
+    if( !ok ) error = "Snapshot :: unable to lock tile cache";
+  }
+  put( out, (uint8_t) 0 );
+
+  out.close();
+  if( !out ){
+    remove( tmp.c_str() );
+    throw string( "Snapshot :: error writing " + tmp );
+  }
+
+#ifdef WIN32
+  // Windows cannot rename over an existing file
+  remove( path.c_str() );
+#endif
+  if( rename( tmp.c_str(), path.c_str() ) != 0 ){
+    remove( tmp.c_str() );
+    throw string( "Snapshot :: unable to rename " + tmp + " to " + path );
+  }
+
+  // Report any cache we were unable to save after saving the other
+  if( !error.empty() ) throw error;
+}
+
+
+
+bool Snapshot::load( Cache* tileCache, ImageCache* imageCache, long maxImages )
+{
+  tiles = 0;
+  images = 0;
+
+  ifstream in( path.c_str(), ios::in | ios::binary );
+  if( !in ) return false;
+
+  char magic[ sizeof(SNAPSHOT_MAGIC) ];
+  uint32_t version = 0, order = 0;
+  in.read( magic, sizeof(magic) );
+  get( in, version );
+  get( in, order );
+  if( !in || memcmp( magic, SNAPSHOT_MAGIC, sizeof(magic) ) != 0 ||
+      version != SNAPSHOT_VERSION || order != SNAPSHOT_BYTE_ORDER ){
+    throw string( "Snapshot :: " + path + " is not a valid snapshot for this server" );
+  }
+
+  uint8_t marker = 0;
+  while( get( in, marker ), in && marker ){
+    string key;
+    get( in, key );
+    IIPImage image;
+    read( in, image );
+    if( imageCache ) imageCache->insert( key, image, maxImages );
+    images++;
+  }
+
+  // Tiles were saved from least to most recently used, so our most recent tiles are kept
+  // if our cache is now smaller
+  while( get( in, marker ), in && marker ){
+    RawTile tile;
+    read( in, tile );
+    if( tileCache ) tileCache->insert( tile );
+    tiles++;
+  }
+
+  if( !in ) throw string( "Snapshot :: " + path + " is truncated" );
+  return true;
+}
@@ -0,0 +1,102 @@
+// Cache Snapshot Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+
+#include <string>
+#include <iostream>
+
+#include "Cache.h"
+#include "ImageCache.h"
+
+
+
+/// Snapshot of our tile and image metadata caches, allowing them to survive restarts
+/** On shutdown, the encoded tiles of our tile cache and the images of our metadata
+    cache are written to a compact binary file, which is read back on startup. RAW
+    tiles are not saved. Entries are not checked when loaded: as with any cached entry,
+    stale tiles and metadata are detected and replaced when first used by comparing
+    their timestamps with that of the image file.
+
+    The snapshot is first written to a temporary file, which then replaces any
+    previous snapshot, so that an interrupted save never leaves a corrupt file.
+    Snapshots are specific to the machine architecture on which they were written.
+ */
+class Snapshot {
+
+ private:
+
+  /// Path of our snapshot file
+  std::string path;
+
+  /// Number of tiles saved or loaded
+  unsigned int tiles;
+
+  /// Number of images saved or loaded
+  unsigned int images;
+
+  /// Write an image to a stream
+  static void write( std::ostream& out, const IIPImage& image );
+
+  /// Read an image from a stream
+  static void read( std::istream& in, IIPImage& image );
+
+  /// Write a tile to a stream
+  static void write( std::ostream& out, const RawTile& tile );
+
+  /// Read a tile from a stream
+  static void read( std::istream& in, RawTile& tile );
+
+
+ public:
+
+  /// Constructor
+  /** @param p path of snapshot file */
+  Snapshot( const std::string& p ) : path( p ), tiles( 0 ), images( 0 ) {};
+
+  /// Save our caches. Throws a string on error
+  /** @param tileCache tile cache or NULL
+      @param imageCache image metadata cache or NULL
+   */
+  void save( Cache* tileCache, ImageCache* imageCache );
+
+  /// Load our caches from a previously saved snapshot. Throws a string on error
+  /** @param tileCache tile cache or NULL
+      @param imageCache image metadata cache or NULL
+      @param maxImages maximum number of images to hold in our metadata cache (0 or -1 for no limit)
+      @return false if no snapshot exists
+   */
+  bool load( Cache* tileCache, ImageCache* imageCache, long maxImages );
+
+  /// Return the number of tiles saved or loaded
+  unsigned int getTiles() const { return tiles; };
+
+  /// Return the number of images saved or loaded
+  unsigned int getImages() const { return images; };
+
+};
+
+
+#endif
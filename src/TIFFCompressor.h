@@ -89,6 +89,20 @@ class TIFFCompressor: public Compressor {
 
 
 
+  /// Reset our state for a new request
+  /** @param compression default compression type as for the constructor
+      @param quality default compression level
+   */
+  inline void reset( int compression, int quality )
+  {
+    Compressor::reset( quality );
+    this->setCompression( compression );
+    if( compression == 2 && Q > 9 ) Q = 9;
+    else if( compression == 5 && Q > 19 ) Q = 19;
+  };
+
+
+
   /// Set compression type: 0: None, 1: LZW, 2: Deflate, 3: JPEG, 4: WebP, 5: ZStandard
   /** @param compression compression type
    */
@@ -127,7 +127,7 @@ void TIL::run( Session* session, const std::string& a ){
       int n = i + (j*ntlx);
 
       // Get our tile using our tile manager
-      TileManager tilemanager( session->tileCache, *session->image, session->jpeg, session->logfile, session->loglevel );
+      TileManager tilemanager( session->tileCache, *session->image, session->jpeg, session->logfile, session->loglevel, session->degradation );
       RawTile rawtile = tilemanager.getTile( resolution, n, session->view->xangle,
 					     session->view->yangle, session->view->getLayers(), ImageEncoding::JPEG );
 
@@ -77,6 +77,7 @@ Task* Task::factory( const string& t ){
   else if( type == "col" ) return new COL;
   else if( type == "cnv" ) return new CNV;
   else if( type == "iiif" ) return new IIIF;
+  else if( type == "prg" ) return new PRG;
   else return NULL;
 
 }
@@ -711,3 +712,34 @@ void CNV::run( Session* session, const string& src ){
   }
 
 }
+
+
+
+// Purging is disabled unless explicitly enabled
+bool PRG::enabled = false;
+
+
+void PRG::run( Session* session, const string& src ){
+
+  if( session->loglevel >= 2 ) *(session->logfile) << "PRG handler reached" << endl;
+
+  if( !PRG::enabled ) throw string( "PRG :: purge command not enabled" );
+
+  // Decode and filter our path in the same way as FIF, so that it matches our cache keys
+  URL url( src );
+  string argument = url.decode();
+  unsigned int n;
+  while( (n=argument.find("../")) < argument.length() ) argument.erase(n,3);
+
+  // Remove all tiles of this image and its metadata
+  unsigned int tiles = session->tileCache->purge( argument );
+  bool metadata = session->imageCache->erase( argument );
+
+  if( session->loglevel >= 1 ){
+    *(session->logfile) << "PRG :: Purged " << tiles << " tiles" << ( metadata ? " and metadata" : "" )
+			<< " of image " << argument << " from cache" << endl;
+  }
+
+  session->response->setCachability( false );
+  session->response->addResponse( "Purged-tiles", tiles );
+}
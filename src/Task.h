@@ -1,7 +1,7 @@
 /*
     IIP Session & Generic Task Classes
 
-    Copyright (C) 2006-2025 Ruven Pillay
+    Copyright (C) 2006-2026 Ruven Pillay
 
     This program is free software; you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -31,23 +31,11 @@
 #include "Timer.h"
 #include "Writer.h"
 #include "Cache.h"
+#include "ImageCache.h"
 #include "Watermark.h"
 #include "Transforms.h"
 #include "Logger.h"
-
-
-
-#ifdef HAVE_EXT_POOL_ALLOCATOR
-#include <ext/pool_allocator.h>
-typedef HASHMAP < std::string, IIPImage,
-			      __gnu_cxx::hash< const std::string >,
-			      std::equal_to< const std::string >,
-			      __gnu_cxx::__pool_alloc< std::pair<const std::string,IIPImage> >
-			      > imageCacheMapType;
-#else
-typedef HASHMAP <std::string,IIPImage> imageCacheMapType;
-#endif
-
+#include "CancellationToken.h"
 
 
 
@@ -74,14 +62,16 @@ struct Session {
   std::map <const std::string, std::string> headers;
   std::map <const std::string, unsigned int> codecOptions;
 
-  imageCacheMapType *imageCache;
+  ImageCache *imageCache;
   Cache* tileCache;
 
-#ifdef DEBUG
-  FileWriter* out;
-#else
-  FCGIWriter* out;
-#endif
+  Writer* out;
+
+  // Overload degradation level: 0 = none
+  unsigned int degradation;
+
+  // Cancellation token for the current request
+  CancellationToken* cancellation;
 
 };
 
@@ -410,4 +400,12 @@ class CNV : public Task {
 };
 
 
+/// PRG Command - purge an image from our tile and metadata caches
+class PRG : public Task {
+ public:
+  static bool enabled;                          ///< Whether purging is permitted
+  void run( Session* session, const std::string& argument );
+};
+
+
 #endif
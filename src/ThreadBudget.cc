@@ -0,0 +1,83 @@
+// Thread Budget Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+
+#include "ThreadBudget.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+using namespace std;
+
+
+thread_local unsigned int ThreadBudget::granted = 0;
+
+
+
+ThreadBudget::ThreadBudget( unsigned int cores, unsigned int workers, unsigned int max )
+{
+  available = ( cores > workers ) ? cores - workers : 0;
+  limit = max;
+}
+
+
+
+unsigned int ThreadBudget::acquire( unsigned int max )
+{
+  // Return anything still held from a previous request on this thread
+  if( granted > 0 ) release();
+
+  // Our overall limit for this request
+  unsigned int cap = limit;
+  if( max > 0 && ( cap == 0 || max < cap ) ) cap = max;
+
+  // Take as many extra threads beyond the calling thread itself as we may
+  unsigned int extra;
+  {
+    lock_guard<std::mutex> lock( mutex );
+    extra = available;
+    if( cap > 0 && cap - 1 < extra ) extra = cap - 1;
+    available -= extra;
+  }
+
+  granted = extra + 1;
+
+#ifdef _OPENMP
+  omp_set_num_threads( granted );
+#endif
+
+  return granted;
+}
+
+
+
+void ThreadBudget::release()
+{
+  if( granted == 0 ) return;
+  {
+    lock_guard<std::mutex> lock( mutex );
+    available += granted - 1;
+  }
+  granted = 0;
+}
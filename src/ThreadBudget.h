@@ -0,0 +1,110 @@
+// Thread Budget Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+
+#ifndef _THREADBUDGET_H
+#define _THREADBUDGET_H
+
+
+#include <mutex>
+
+
+
+/// Process-wide budget of processor cores shared between concurrent requests
+/** Each worker thread always has a core of its own. The remaining cores form
+    a shared pool from which each request draws extra cores for its OpenMP image
+    processing loops, Kakadu decoding threads and encoder threads, up to a
+    configurable per-request limit. The cores are returned once the request has
+    finished. Requests arriving while all cores are in use run single-threaded,
+    so that the total number of busy threads never exceeds the number of cores.
+ */
+class ThreadBudget {
+
+ private:
+
+  /// Number of cores currently free in our shared pool
+  unsigned int available;
+
+  /// Maximum number of threads per request (0 = unlimited)
+  unsigned int limit;
+
+  /// Mutex protecting our pool
+  std::mutex mutex;
+
+  /// Threads granted to the request of the calling thread
+  static thread_local unsigned int granted;
+
+
+ public:
+
+  /// Constructor
+  /** @param cores number of cores available to this process
+      @param workers number of worker threads, each of which keeps its own core
+      @param max maximum number of threads per request including the worker thread itself (0 = unlimited)
+   */
+  ThreadBudget( unsigned int cores, unsigned int workers, unsigned int max );
+
+
+  /// Obtain threads for a new request on the calling thread without waiting
+  /** Also sizes the OpenMP thread team of the calling thread accordingly
+      @param max maximum number of threads wanted, such as the cores to which the worker is bound (0 = no limit)
+      @return number of threads granted including the calling thread itself, which is always at least 1
+   */
+  unsigned int acquire( unsigned int max );
+
+
+  /// Return the threads obtained by acquire() to our pool
+  void release();
+
+
+  /// Return the number of threads granted to the request of the calling thread
+  /** @return number of threads or 0 if no budget is in use on this thread */
+  static unsigned int threads(){ return granted; };
+
+};
+
+
+
+/// Scoped thread grant, which is automatically returned on destruction
+class ThreadGrant {
+
+ private:
+
+  ThreadBudget* budget;
+
+ public:
+
+  /// Constructor - obtains threads for the current request
+  /** @param b thread budget or NULL if disabled
+      @param max maximum number of threads wanted (0 = no limit)
+   */
+  ThreadGrant( ThreadBudget* b, unsigned int max ) : budget( b ) {
+    if( budget ) budget->acquire( max );
+  };
+
+  /// Destructor - returns our threads
+  ~ThreadGrant(){ if( budget ) budget->release(); };
+
+};
+
+
+#endif
@@ -0,0 +1,90 @@
+// Tile Cache Key Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#include "TileKey.h"
+#include "Cache.h"
+
+#include <mutex>
+#include <atomic>
+
+
+using namespace std;
+
+
+/// Number of image paths interned after which our table is emptied and ids are allocated afresh
+#define MAX_INTERNED_IMAGES 262144
+
+
+// Interned image paths, those interned permanently, the next id to allocate, the number of
+// times our table has been emptied and the mutex protecting them
+static HASHMAP<string,uint32_t> images;
+static HASHMAP<string,uint32_t> permanent;
+static uint32_t nextId = 1;
+static atomic<unsigned int> generation( 0 );
+static mutex imagesMutex;
+
+
+
+uint32_t TileKey::intern( const string& f, bool keep )
+{
+  // Successive requests from a thread are usually for the same image, so remember
+  // the last path we saw and avoid hashing and locking in the common case
+  static thread_local string last;
+  static thread_local uint32_t lastId = 0;
+  static thread_local unsigned int lastGeneration = 0;
+  if( lastId != 0 && !keep && lastGeneration == generation && f == last ) return lastId;
+
+  uint32_t id;
+  unsigned int g;
+  {
+    lock_guard<mutex> lock( imagesMutex );
+    HASHMAP<string,uint32_t>::iterator i = images.find( f );
+    if( i != images.end() ) id = i->second;
+    else{
+      // Rather than let every path ever requested accumulate, start afresh once our table is full.
+      // Ids are not re-used, so tiles cached under an old id are simply no longer found and age out
+      if( images.size() >= MAX_INTERNED_IMAGES + permanent.size() ){
+	images = permanent;
+	generation++;
+      }
+      id = nextId++;
+      if( nextId == 0 ) nextId = 1;
+      images[f] = id;
+    }
+    if( keep ) permanent[f] = id;
+    g = generation;
+  }
+
+  last = f;
+  lastId = id;
+  lastGeneration = g;
+  return id;
+}
+
+
+
+uint32_t TileKey::lookup( const string& f )
+{
+  lock_guard<mutex> lock( imagesMutex );
+  HASHMAP<string,uint32_t>::const_iterator i = images.find( f );
+  return ( i != images.end() ) ? i->second : 0;
+}
@@ -0,0 +1,140 @@
+// Tile Cache Key Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef _TILEKEY_H
+#define _TILEKEY_H
+
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+#include "RawTile.h"
+
+
+
+/// Compact fixed-size key identifying a cached tile
+/** Image paths are interned to a numeric id, which is packed together with the
+    tile coordinates, encoding and quality into 16 bytes. Keys can therefore be
+    built, hashed and compared without any string formatting or allocation.
+    Interned ids are process-wide, so keys must not be shared between processes.
+    The table of interned paths is bounded: once it is full, it is emptied and
+    paths are given new ids when next seen. Ids are never re-used, so tiles
+    cached under an old id are no longer found and are evicted in due course.
+    Paths interned permanently, such as those of pinned images, keep their ids.
+ */
+struct TileKey {
+
+  uint32_t image;               ///< Interned image id
+  uint32_t tile;                ///< Tile number
+  int16_t resolution;           ///< Resolution number
+  int16_t hSequence;            ///< Horizontal sequence number
+  int16_t vSequence;            ///< Vertical sequence number
+  uint8_t encoding;             ///< Image encoding
+  int8_t quality;               ///< Compression quality
+
+
+  /// Default constructor
+  TileKey() : image( 0 ), tile( 0 ), resolution( 0 ), hSequence( 0 ), vSequence( 0 ), encoding( 0 ), quality( 0 ) {};
+
+  /// Constructor
+  /** @param f image path
+      @param r resolution number
+      @param t tile number
+      @param h horizontal sequence number
+      @param v vertical sequence number
+      @param c encoding
+      @param q compression quality
+   */
+  TileKey( const std::string& f, int r, int t, int h, int v, ImageEncoding c, int q ) :
+    image( intern( f ) ),
+    tile( t ),
+    resolution( r ),
+    hSequence( h ),
+    vSequence( v ),
+    encoding( (uint8_t) c ),
+    quality( q ) {};
+
+  /// Equality operator
+  bool operator==( const TileKey& k ) const { return memcmp( this, &k, sizeof(TileKey) ) == 0; };
+
+  /// Ordering operator for use in ordered maps
+  bool operator<( const TileKey& k ) const { return memcmp( this, &k, sizeof(TileKey) ) < 0; };
+
+  /// Return a hash of our key
+  size_t hash() const {
+    uint64_t a, b;
+    memcpy( &a, this, 8 );
+    memcpy( &b, reinterpret_cast<const char*>(this) + 8, 8 );
+    uint64_t h = ( a * 0x9e3779b97f4a7c15ULL ) ^ b;
+    h ^= h >> 32;
+    h *= 0xd6e8feb86659fd93ULL;
+    h ^= h >> 32;
+    return (size_t) h;
+  };
+
+  /// Return the id of an image path, allocating a new id the first time a path is seen
+  /** @param f image path
+      @param keep whether the path should keep its id when our table of paths is emptied
+      @return id, which is never 0
+   */
+  static uint32_t intern( const std::string& f, bool keep = false );
+
+  /// Return the id of an image path without interning it
+  /** @param f image path
+      @return id or 0 if no key has been created for this path
+   */
+  static uint32_t lookup( const std::string& f );
+
+};
+
+
+// Our key is hashed and compared as raw memory, so must not contain any padding
+static_assert( sizeof(TileKey) == 16, "TileKey must be 16 bytes with no padding" );
+
+
+
+// Hash specializations for each of the hashed map types we may use as HASHMAP
+namespace std {
+  template <> struct hash<TileKey> {
+    size_t operator()( const TileKey& k ) const { return k.hash(); }
+  };
+}
+
+#if defined(HAVE_TR1_UNORDERED_MAP)
+#include <tr1/functional>
+namespace std { namespace tr1 {
+  template <> struct hash<TileKey> {
+    size_t operator()( const TileKey& k ) const { return k.hash(); }
+  };
+} }
+#elif defined(HAVE_EXT_HASH_MAP)
+#include <ext/hash_map>
+namespace __gnu_cxx {
+  template <> struct hash<TileKey> {
+    size_t operator()( const TileKey& k ) const { return k.hash(); }
+  };
+}
+#endif
+
+
+#endif
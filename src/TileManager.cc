@@ -4,7 +4,7 @@
 
 /*  IIP Server: Tile Cache Handler
 
-    Copyright (C) 2005-2025 Ruven Pillay
+    Copyright (C) 2005-2026 Ruven Pillay
 
     This program is free software; you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -31,11 +31,34 @@ using namespace std;
 
 
 
-RawTile TileManager::getNewTile( int resolution, int tile, int xangle, int yangle, int layers, ImageEncoding ctype ){
+int TileManager::degradeLayers( int layers ){
+
+  // Only applies to formats with quality layers such as JPEG2000
+  unsigned int n = image->quality_layers;
+  if( degradation == 0 || n <= 1 ) return layers;
+
+  // Resolve the number of layers our decoder would otherwise use: all layers if negative
+  // and half of the available layers if not specified
+  int l = (layers < 0) ? n : (layers == 0) ? (int) ceil( n/2.0 ) : layers;
+
+  // Halve the number of layers for each degradation level
+  l >>= degradation;
+  if( l < 1 ) l = 1;
+
+  if( loglevel >= 4 ) *logfile << "TileManager :: Overloaded: decoding " << l << " quality layers" << endl;
+  return l;
+}
+
+
+
+RawTile TileManager::getNewTile( int resolution, int tile, int xangle, int yangle, int layers, ImageEncoding ctype, bool cache ){
 
   // If user has overriden quality factor, decode to raw format to allow us to re-encode
   ImageEncoding source_encoding = (compressor->defaultQuality() == true) ? ctype : ImageEncoding::RAW;
 
+  // Time the whole of our decoding and encoding, which our cache uses as the cost of regenerating the tile
+  cost_timer.start();
+
   // Get a tile from the IIPImage image object
   if( loglevel >= 2 ) insert_timer.start();
   RawTile ttt = image->getTile( xangle, yangle, resolution, layers, tile, source_encoding );
@@ -117,11 +140,15 @@ RawTile TileManager::getNewTile( int resolution, int tile, int xangle, int yangl
   }
 
 
-  // Add to our tile cache
-  if( loglevel >= 4 ) insert_timer.start();
-  tileCache->insert( ttt );
-  if( loglevel >= 4 ) *logfile << "TileManager :: Tile cache insertion time: " << insert_timer.getTime()
-			       << " microseconds" << endl;
+  // Add to our tile cache. The tile shares its data with the cache and with any concurrent
+  // requests waiting for it rather than each of these taking a copy
+  if( cache ){
+    ttt.share();
+    if( loglevel >= 4 ) insert_timer.start();
+    tileCache->insert( ttt, cost_timer.getTime() );
+    if( loglevel >= 4 ) *logfile << "TileManager :: Tile cache insertion time: " << insert_timer.getTime()
+				 << " microseconds" << endl;
+  }
 
 
   return ttt;
@@ -132,7 +159,8 @@ RawTile TileManager::getNewTile( int resolution, int tile, int xangle, int yangl
 
 RawTile TileManager::getTile( int resolution, int tile, int xangle, int yangle, int layers, ImageEncoding ctype ){
 
-  RawTile* rawtile = NULL;
+  RawTile rawtile;
+  bool found = false;
   string tileCompression;
   string compName;
 
@@ -148,48 +176,48 @@ RawTile TileManager::getTile( int resolution, int tile, int xangle, int yangle,
     {
 
     case ImageEncoding::JPEG:
-      if( (rawtile = tileCache->getTile( image->getImagePath(), resolution, tile,
-					 xangle, yangle, ImageEncoding::JPEG, compressor->getQuality() )) ) break;
-      if( (rawtile = tileCache->getTile( image->getImagePath(), resolution, tile,
-					 xangle, yangle, ImageEncoding::RAW, 0 )) ) break;
+      if( (found = tileCache->getTile( image->getImagePath(), resolution, tile,
+					 xangle, yangle, ImageEncoding::JPEG, compressor->getQuality(), rawtile )) ) break;
+      if( (found = tileCache->getTile( image->getImagePath(), resolution, tile,
+					 xangle, yangle, ImageEncoding::RAW, 0, rawtile )) ) break;
       break;
 
 
     case ImageEncoding::TIFF:
-      if( (rawtile = tileCache->getTile( image->getImagePath(), resolution, tile,
-					 xangle, yangle, ImageEncoding::TIFF, compressor->getQuality() )) ) break;
-      if( (rawtile = tileCache->getTile( image->getImagePath(), resolution, tile,
-					 xangle, yangle, ImageEncoding::RAW, 0 )) ) break;
+      if( (found = tileCache->getTile( image->getImagePath(), resolution, tile,
+					 xangle, yangle, ImageEncoding::TIFF, compressor->getQuality(), rawtile )) ) break;
+      if( (found = tileCache->getTile( image->getImagePath(), resolution, tile,
+					 xangle, yangle, ImageEncoding::RAW, 0, rawtile )) ) break;
       break;
 
 
     case ImageEncoding::PNG:
-      if( (rawtile = tileCache->getTile( image->getImagePath(), resolution, tile,
-					 xangle, yangle, ImageEncoding::PNG, compressor->getQuality() )) ) break;
-      if( (rawtile = tileCache->getTile( image->getImagePath(), resolution, tile,
-					 xangle, yangle, ImageEncoding::RAW, 0 )) ) break;
+      if( (found = tileCache->getTile( image->getImagePath(), resolution, tile,
+					 xangle, yangle, ImageEncoding::PNG, compressor->getQuality(), rawtile )) ) break;
+      if( (found = tileCache->getTile( image->getImagePath(), resolution, tile,
+					 xangle, yangle, ImageEncoding::RAW, 0, rawtile )) ) break;
       break;
 
 
     case ImageEncoding::WEBP:
-      if( (rawtile = tileCache->getTile( image->getImagePath(), resolution, tile,
-					 xangle, yangle, ImageEncoding::WEBP, compressor->getQuality() )) ) break;
-      if( (rawtile = tileCache->getTile( image->getImagePath(), resolution, tile,
-					 xangle, yangle, ImageEncoding::RAW, 0 )) ) break;
+      if( (found = tileCache->getTile( image->getImagePath(), resolution, tile,
+					 xangle, yangle, ImageEncoding::WEBP, compressor->getQuality(), rawtile )) ) break;
+      if( (found = tileCache->getTile( image->getImagePath(), resolution, tile,
+					 xangle, yangle, ImageEncoding::RAW, 0, rawtile )) ) break;
       break;
 
 
     case ImageEncoding::AVIF:
-      if( (rawtile = tileCache->getTile( image->getImagePath(), resolution, tile,
-					 xangle, yangle, ImageEncoding::AVIF, compressor->getQuality() )) ) break;
-      if( (rawtile = tileCache->getTile( image->getImagePath(), resolution, tile,
-					 xangle, yangle, ImageEncoding::RAW, 0 )) ) break;
+      if( (found = tileCache->getTile( image->getImagePath(), resolution, tile,
+					 xangle, yangle, ImageEncoding::AVIF, compressor->getQuality(), rawtile )) ) break;
+      if( (found = tileCache->getTile( image->getImagePath(), resolution, tile,
+					 xangle, yangle, ImageEncoding::RAW, 0, rawtile )) ) break;
       break;
 
 
     case ImageEncoding::RAW:
-      if( (rawtile = tileCache->getTile( image->getImagePath(), resolution, tile,
-					 xangle, yangle, ImageEncoding::RAW, 0 )) ) break;
+      if( (found = tileCache->getTile( image->getImagePath(), resolution, tile,
+					 xangle, yangle, ImageEncoding::RAW, 0, rawtile )) ) break;
       break;
 
 
@@ -216,11 +244,11 @@ RawTile TileManager::getTile( int resolution, int tile, int xangle, int yangle,
 
 
   // If we haven't been able to get a tile, get a raw one
-  if( !rawtile || (rawtile && (rawtile->timestamp != image->timestamp)) ){
+  if( !found || (rawtile.timestamp != image->timestamp) ){
 
-    if( rawtile && (rawtile->timestamp != image->timestamp) ){
+    if( found && (rawtile.timestamp != image->timestamp) ){
       if( loglevel >= 3 ) *logfile << "TileManager :: Tile has different timestamp "
-			           << rawtile->timestamp << " - " << image->timestamp
+			           << rawtile.timestamp << " - " << image->timestamp
                                    << " ... updating" << endl;
     }
 
@@ -229,10 +257,51 @@ RawTile TileManager::getTile( int resolution, int tile, int xangle, int yangle,
 				 << ", compression: " << compName
 				 << ", quality: " << compressor->getQuality() << endl
 				 << "TileManager :: Cache size: " << tileCache->getNumElements()
-				 << " tiles, " << tileCache->getMemorySize() << " MB" << endl;
+				 << " tiles, " << tileCache->getMemorySize() << " MB" << endl
+				 << "TileManager :: Cache hit ratio: " << tileCache->getStatistics().hitRatio()
+				 << ", byte hit ratio: " << tileCache->getStatistics().byteHitRatio() << endl;
+
+
+    // Tiles decoded with fewer quality layers must neither be cached nor shared with other requests,
+    // as our cache keys do not include the number of layers
+    int l = this->degradeLayers( layers );
+    if( l != layers ){
+      RawTile newtile = this->getNewTile( resolution, tile, xangle, yangle, l, ctype, false );
+      if( loglevel >= 3 ) *logfile << "TileManager :: Total tile access time: "
+				   << tile_timer.getTime() << " microseconds" << endl;
+      return newtile;
+    }
 
+    // Coalesce concurrent decodes of the same tile: only the first request decodes the tile
+    // while any others wait for and share its result
+    RawTile newtile;
+    int quality = (ctype == ImageEncoding::RAW) ? 0 : compressor->getQuality();
+    TileKey key = tileCache->getIndex( image->getImagePath(), resolution, tile, xangle, yangle, ctype, quality );
+
+    // A concurrent decode may have finished and cached our tile since our lookup above
+    auto cached = [&]() -> bool {
+      return tileCache->getTile( image->getImagePath(), resolution, tile, xangle, yangle, ctype, quality, newtile )
+	&& newtile.timestamp == image->timestamp;
+    };
+
+    if( tileCache->beginDecode( key ) ){
+      try{
+	if( !cached() ) newtile = this->getNewTile( resolution, tile, xangle, yangle, layers, ctype );
+      }
+      catch( ... ){
+	// Let any waiting requests decode the tile themselves
+	tileCache->endDecode( key, NULL );
+	throw;
+      }
+      tileCache->endDecode( key, &newtile );
+    }
+    else if( tileCache->waitDecode( key, newtile ) ){
+      if( loglevel >= 3 ) *logfile << "TileManager :: Shared tile decoded by concurrent request" << endl;
+    }
+    else if( !cached() ) newtile = this->getNewTile( resolution, tile, xangle, yangle, layers, ctype );
 
-    RawTile newtile = this->getNewTile( resolution, tile, xangle, yangle, layers, ctype );
+    // As for cache hits, raw tiles may be modified by our caller, so need their own copy
+    if( newtile.compressionType == ImageEncoding::RAW ) newtile.unshare();
 
     if( loglevel >= 3 ) *logfile << "TileManager :: Total tile access time: "
 				 << tile_timer.getTime() << " microseconds" << endl;
@@ -248,22 +317,28 @@ RawTile TileManager::getTile( int resolution, int tile, int xangle, int yangle,
 			       << ", quality: " << compressor->getQuality() << endl
 			       << "TileManager :: Cache size: "
 			       << tileCache->getNumElements() << " tiles, "
-			       << tileCache->getMemorySize() << " MB" << endl;
+			       << tileCache->getMemorySize() << " MB" << endl
+			       << "TileManager :: Cache hit ratio: " << tileCache->getStatistics().hitRatio()
+			       << ", byte hit ratio: " << tileCache->getStatistics().byteHitRatio() << endl;
+
+
+  // Cached tiles share their data with our cache. Encoded tiles can be returned as they are, but raw
+  // tiles may be compressed in place below or modified by our caller, so need their own copy
+  if( rawtile.compressionType == ImageEncoding::RAW ) rawtile.unshare();
 
 
   // Check whether the compression used for out tile matches our requested compression type. If not, we must convert
   // Perform JPEG compression iff we have an 8 bit per channel image and either 1 or 3 bands
   // PNG compression can have 8 or 16 bits and alpha channels
-  if( (rawtile->compressionType == ImageEncoding::RAW) &&
-      ( ( ctype==ImageEncoding::JPEG && rawtile->bpc==8 && (rawtile->channels==1 || rawtile->channels==3) ) ||
+  if( (rawtile.compressionType == ImageEncoding::RAW) &&
+      ( ( ctype==ImageEncoding::JPEG && rawtile.bpc==8 && (rawtile.channels==1 || rawtile.channels==3) ) ||
 	ctype==ImageEncoding::PNG || ctype==ImageEncoding::WEBP || ctype==ImageEncoding::AVIF ) ){
 
-    // Rawtile is a pointer to the cache data, so we need to create a copy of it in case we compress it
-    RawTile ttt( *rawtile );
-
+    // Rawtile is now our own copy of the cached data, so we can compress it in place
+    cost_timer.start();
     if( loglevel >=2 ) compression_timer.start();
-    unsigned int oldlen = rawtile->dataLength;
-    unsigned int newlen = compressor->Compress( ttt );
+    unsigned int oldlen = rawtile.dataLength;
+    unsigned int newlen = compressor->Compress( rawtile );
     if( loglevel >= 3 ) *logfile << "TileManager :: " << compName << " requested, but RAW data found in cache." << endl
 				 << "TileManager :: " << compName << " Compression Time: "
 				 << compression_timer.getTime() << " microseconds" << endl
@@ -272,20 +347,15 @@ RawTile TileManager::getTile( int resolution, int tile, int xangle, int yangle,
 
     // Add our compressed tile to the cache
     if( loglevel >= 3 ) insert_timer.start();
-    tileCache->insert( ttt );
+    tileCache->insert( rawtile, cost_timer.getTime() );
     if( loglevel >= 3 ) *logfile << "TileManager :: Tile cache insertion time: " << insert_timer.getTime()
 				 << " microseconds" << endl;
-
-    if( loglevel >= 3 ) *logfile << "TileManager :: Total tile access time: "
-				 << tile_timer.getTime() << " microseconds" << endl;
-
-    return RawTile( std::move(ttt) );
   }
 
   if( loglevel >= 3 ) *logfile << "TileManager :: Total tile access time: "
 			       << tile_timer.getTime() << " microseconds" << endl;
 
-  return RawTile( *rawtile );
+  return rawtile;
 
 
 }
@@ -298,7 +368,7 @@ RawTile TileManager::getRegion( unsigned int res, int seq, int ang, int layers,
     if( loglevel >= 3 ){
       *logfile << "TileManager getRegion :: requesting region directly from image" << endl;
     }
-    return image->getRegion( seq, ang, res, layers, x, y, width, height );
+    return image->getRegion( seq, ang, res, this->degradeLayers( layers ), x, y, width, height );
   }
 
   // Otherwise do the compositing ourselves
@@ -361,9 +431,14 @@ RawTile TileManager::getRegion( unsigned int res, int seq, int ang, int layers,
 
   unsigned int current_height = 0;
 
+  // Stop decoding if the client has gone away
+  const CancellationToken* cancellation = image->getCancellationToken();
+
   // Decode the image strip by strip
   for( unsigned int i=starty; i<endy; i++ ){
 
+    if( cancellation ) cancellation->check( "TileManager getRegion" );
+
     unsigned long buffer_index = 0;
 
     // Keep track of the current pixel boundary horizontally. ie. only up
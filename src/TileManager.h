@@ -54,7 +54,15 @@ class TileManager{
   IIPImage* image;
   Logger* logfile;
   int loglevel;
-  Timer compression_timer, tile_timer, insert_timer;
+  unsigned int degradation;
+  Timer compression_timer, tile_timer, insert_timer, cost_timer;
+
+  /// Reduce the number of quality layers to decode if we are degrading our output
+  /**
+   *  @param layers number of quality layers requested
+   *  @return number of quality layers to decode
+   */
+  int degradeLayers( int layers );
 
   /// Get a new tile from the image file
   /**
@@ -67,9 +75,10 @@ class TileManager{
    *  @param yangle vertical sequence number
    *  @param number of quality layers within image to decode
    *  @param e tile encoding
+   *  @param cache whether to add the tile to our tile cache
    *  @return RawTile
    */
-  RawTile getNewTile( int resolution, int tile, int xangle, int yangle, int layers, ImageEncoding e );
+  RawTile getNewTile( int resolution, int tile, int xangle, int yangle, int layers, ImageEncoding e, bool cache = true );
 
 
  public:
@@ -82,13 +91,15 @@ class TileManager{
    * @param c  pointer to Compressor object
    * @param s  pointer to Logger object
    * @param l  logging level
+   * @param d  overload degradation level (0 = none)
    */
-  TileManager( Cache* tc, IIPImage* im, Compressor* c, Logger* s, int l ) :
+  TileManager( Cache* tc, IIPImage* im, Compressor* c, Logger* s, int l, unsigned int d = 0 ) :
     tileCache( tc ),
     compressor( c ),
     image( im ),
     logfile( s ),
-    loglevel( l ) {};
+    loglevel( l ),
+    degradation( d ) {};
 
 
 
@@ -0,0 +1,144 @@
+// CPU and NUMA Topology Class Member Functions
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#include "Topology.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#if defined(HAVE_SCHED_GETCPU) || defined(HAVE_PTHREAD_SETAFFINITY_NP)
+#include <sched.h>
+#include <pthread.h>
+#endif
+
+
+using namespace std;
+
+
+// Location of our NUMA node descriptions
+#define NODE_PATH "/sys/devices/system/node/node"
+
+// Maximum number of nodes we look for
+#define MAX_NODES 64
+
+
+
+Topology::Topology()
+{
+  // Nodes may be numbered non-contiguously, so probe each possible node
+  for( int n=0; n<MAX_NODES; n++ ){
+
+    stringstream path;
+    path << NODE_PATH << n << "/cpulist";
+    ifstream file( path.str().c_str() );
+    if( !file ) continue;
+
+    string list;
+    getline( file, list );
+    vector<int> cpus = parseList( list );
+
+    // Memory-only nodes have no CPUs on which to place workers
+    if( cpus.empty() ) continue;
+
+    for( unsigned int i=0; i<cpus.size(); i++ ){
+      if( cpus[i] >= (int) cpuNodes.size() ) cpuNodes.resize( cpus[i] + 1, 0 );
+      cpuNodes[cpus[i]] = nodes.size();
+    }
+    nodes.push_back( cpus );
+  }
+
+  // Otherwise treat all our CPUs as a single node
+  if( nodes.empty() ){
+    unsigned int n = thread::hardware_concurrency();
+    vector<int> cpus;
+    for( unsigned int i=0; i<n; i++ ) cpus.push_back( i );
+    nodes.push_back( cpus );
+    cpuNodes.assign( n, 0 );
+  }
+}
+
+
+
+unsigned int Topology::currentNode() const
+{
+#ifdef HAVE_SCHED_GETCPU
+  int cpu = sched_getcpu();
+  if( cpu >= 0 && cpu < (int) cpuNodes.size() ) return cpuNodes[cpu];
+#endif
+  return 0;
+}
+
+
+
+unsigned int Topology::bind( Placement policy, unsigned int node, unsigned int index ) const
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  if( policy == NONE ) return 0;
+
+  const vector<int>& cpus = nodes[ node % nodes.size() ];
+  if( cpus.empty() ) return 0;
+
+  cpu_set_t set;
+  CPU_ZERO( &set );
+  if( policy == CORE ) CPU_SET( cpus[ index % cpus.size() ], &set );
+  else for( unsigned int i=0; i<cpus.size(); i++ ) CPU_SET( cpus[i], &set );
+
+  if( pthread_setaffinity_np( pthread_self(), sizeof(set), &set ) != 0 ) return 0;
+  return CPU_COUNT( &set );
+#else
+  (void) policy; (void) node; (void) index;
+  return 0;
+#endif
+}
+
+
+
+unsigned int Topology::getAllowedCPUs()
+{
+#ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  cpu_set_t set;
+  CPU_ZERO( &set );
+  if( pthread_getaffinity_np( pthread_self(), sizeof(set), &set ) == 0 ) return CPU_COUNT( &set );
+#endif
+  return 0;
+}
+
+
+
+vector<int> Topology::parseList( const string& list )
+{
+  vector<int> cpus;
+  stringstream ss( list );
+  string range;
+
+  while( getline( ss, range, ',' ) ){
+    if( range.empty() ) continue;
+    size_t dash = range.find( '-' );
+    int first = atoi( range.substr( 0, dash ).c_str() );
+    int last = ( dash == string::npos ) ? first : atoi( range.substr( dash + 1 ).c_str() );
+    for( int c=first; c<=last; c++ ) cpus.push_back( c );
+  }
+
+  return cpus;
+}
@@ -0,0 +1,92 @@
+// CPU and NUMA Topology Class
+
+/*  IIP Image Server
+
+    Copyright (C) 2026 Ruven Pillay.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software Foundation,
+    Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef _TOPOLOGY_H
+#define _TOPOLOGY_H
+
+
+#include <string>
+#include <vector>
+
+
+
+/// Description of our NUMA nodes and their CPUs, used to place worker threads
+/** The topology is read from /sys/devices/system/node on Linux. Elsewhere, or if
+    this information is not available, all CPUs are treated as a single node.
+    Binding a thread also determines where its memory is placed, as Linux
+    allocates pages on the node of the thread that first touches them. Threads
+    subsequently created by a bound thread, such as OpenMP or Kakadu helper
+    threads, inherit its binding.
+ */
+class Topology {
+
+ private:
+
+  /// CPUs belonging to each node
+  std::vector< std::vector<int> > nodes;
+
+  /// Node of each CPU indexed by CPU number
+  std::vector<int> cpuNodes;
+
+
+ public:
+
+  /// Placement policies
+  enum Placement { NONE = 0, NODE = 1, CORE = 2 };
+
+
+  /// Constructor - detects our topology
+  Topology();
+
+  /// Return the number of NUMA nodes
+  unsigned int getNumNodes() const { return nodes.size(); };
+
+  /// Return the CPUs belonging to a node
+  /** @param node node index */
+  const std::vector<int>& getCPUs( unsigned int node ) const { return nodes[node]; };
+
+  /// Return the node on which the calling thread is currently running
+  /** @return node index or 0 if unknown */
+  unsigned int currentNode() const;
+
+  /// Bind the calling thread to a node or to a single core of a node
+  /** @param policy placement policy
+      @param node node index, which is taken modulo the number of nodes
+      @param index index of the thread within the node, used to choose a core with the CORE policy
+      @return number of CPUs to which we are now bound or 0 if binding failed or is unsupported
+   */
+  unsigned int bind( Placement policy, unsigned int node, unsigned int index ) const;
+
+  /// Return the number of CPUs on which the calling thread may run
+  /** @return number of CPUs or 0 if unknown */
+  static unsigned int getAllowedCPUs();
+
+  /// Parse a CPU list of the form "0-3,8,10-11"
+  /** @param list CPU list
+      @return CPU numbers
+   */
+  static std::vector<int> parseList( const std::string& list );
+
+};
+
+
+#endif
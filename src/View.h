@@ -78,7 +78,14 @@ class View{
 
 
   /// Constructor
-  View() {
+  View() { reset(); };
+
+
+  /// Reset our view to its default state so that it can be re-used for a new request
+  /** Any limits set through setMaxSize(), setMaxLayers(), setAllowUpscaling() or
+      setMaxICC() must be set again after a reset
+   */
+  void reset() {
     view_left = 0.0; view_top = 0.0; view_width = 1.0; view_height = 1.0;
     resolution = 0; max_resolutions = 0;
     width = 0; height = 0;
@@ -98,6 +105,8 @@ class View{
     output_format = ImageEncoding::JPEG;
     equalization = false;
     minmax = false;
+    ctw.clear();
+    convolution.clear();
   };
 
 
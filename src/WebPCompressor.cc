@@ -21,11 +21,20 @@
 
 
 #include "WebPCompressor.h"
+#include "ThreadBudget.h"
 
 using namespace std;
 
 
 
+/// Progress hook allowing libwebp to abandon encoding once our client has gone away
+static int webp_progress( int percent, const WebPPicture* pic ){
+  const CancellationToken* cancellation = (const CancellationToken*) pic->user_data;
+  return ( cancellation && cancellation->isCancelled() ) ? 0 : 1;
+}
+
+
+
 /// Initialize chunk-based encoding for the CVT handler
 void WebPCompressor::InitCompression( const RawTile& rawtile, unsigned int strip_height ){
 
@@ -104,6 +113,8 @@ unsigned int WebPCompressor::Compress( RawTile& rawtile ){
   WebPMemoryWriterInit( &writer );
   pic.writer = WebPMemoryWrite;
   pic.custom_ptr = &writer;
+  pic.progress_hook = webp_progress;
+  pic.user_data = (void*) cancellation;
 
 
   if( rawtile.channels == 4 ){
@@ -118,8 +129,15 @@ unsigned int WebPCompressor::Compress( RawTile& rawtile ){
   }
 
 
+  // Only use WebP's extra encoding thread if our request has been granted one
+  config.thread_level = ( ThreadBudget::threads() == 1 ) ? 0 : 1;
+
   // Encode our image buffer
-  WebPEncode( &config, &pic );
+  if( !WebPEncode( &config, &pic ) && pic.error_code == VP8_ENC_ERROR_USER_ABORT ){
+    WebPPictureFree( &pic );
+    WebPMemoryWriterClear( &writer );
+    throw request_cancelled( "WebPCompressor :: request cancelled by client" );
+  }
 
   const uint8_t* buffer;
   size_t size = 0;
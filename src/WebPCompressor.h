@@ -90,6 +90,29 @@ class WebPCompressor : public Compressor {
   };
 
 
+  /// Reset our state for a new request
+  /** @param compressionLevel default WebP compression level (-1 for lossless or 0-100)
+   */
+  void reset( int compressionLevel ){
+
+    Compressor::reset( compressionLevel );
+
+    if( compressionLevel == -1 ){
+      config.lossless = 1;
+      config.quality = 0;
+    }
+    else{
+      config.lossless = 0;
+      config.quality = this->Q;
+    }
+
+    // Remove any metadata chunks embedded for a previous image from our muxer
+    WebPMuxDeleteChunk( mux, "ICCP", 0 );
+    WebPMuxDeleteChunk( mux, "XMP ", 0 );
+    WebPMuxDeleteChunk( mux, "EXIF", 0 );
+  };
+
+
   /// Initialize strip based compression
   /** For strip based encoding, we need to first initialize with InitCompression,
       then compress a single strip at a time using CompressStrip and finally clean up using Finish
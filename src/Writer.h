@@ -1,7 +1,7 @@
 /*
     IIP Generic Output Writer Classes
 
-    Copyright (C) 2006-2025 Ruven Pillay.
+    Copyright (C) 2006-2026 Ruven Pillay.
 
     This program is free software; you can redistribute it and/or modify
     it under the terms of the GNU General Public License as published by
@@ -30,15 +30,86 @@
 #endif
 
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <memory>
+
+#include "CancellationToken.h"
 
 
 /// Virtual base class for various writers
+/** Writers may optionally keep a copy of all output in buffer so that the
+    full response can be stored in Memcached. This copy is only made once
+    capture() has been called, so that responses that will not be stored are
+    written without any intermediate copy
+ */
 class Writer {
 
+ protected:
+
+  /// Add the message to our copy buffer if we have one
+  /** @param msg message string
+      @param len message length in bytes
+   */
+  void cpy2buf( const char* msg, size_t len ){
+    if( !buffer ) return;
+    if( sz+len > capacity ){
+      // Grow geometrically to avoid a reallocation for every small write
+      capacity = ( sz+len > 2*capacity ) ? sz+len : 2*capacity;
+      buffer = (char*) realloc( buffer, capacity );
+    }
+    if( buffer ){
+      memcpy( &buffer[sz], msg, len );
+      sz += len;
+    }
+  };
+
+  /// Allocated size of buffer
+  size_t capacity;
+
+  /// Cancellation token for the current request or NULL
+  CancellationToken* token;
+
+  /// Cancel our request after a failed write
+  /** @return -1 */
+  int fail(){
+    if( token ) token->cancel();
+    return -1;
+  };
+
+
  public:
 
-  virtual ~Writer() = 0;
+  char* buffer;        ///< Copy of output or NULL if not kept
+  size_t sz;           ///< Size of output within buffer
+
+  /// A block of data for use with putV()
+  /** Writers that send their output asynchronously may keep a reference to the
+      owner of a block rather than copying its data */
+  struct Block {
+    const char* data;             ///< Block data
+    size_t length;                ///< Block length in bytes
+    std::shared_ptr<void> owner;  ///< Optional owner of a shared buffer holding the data
+  };
+
+  /// Constructor
+  Writer() : capacity( 0 ), token( NULL ), buffer( NULL ), sz( 0 ) {};
+
+  virtual ~Writer(){ if( buffer ) free( buffer ); };
+
+  /// Keep a copy of all subsequent output in buffer
+  /** @param bufsize initial size of copy buffer */
+  void capture( size_t bufsize = 65536 ){
+    if( !buffer ){
+      buffer = (char*) malloc( bufsize );
+      capacity = buffer ? bufsize : 0;
+    }
+    sz = 0;
+  };
+
+  /// Set a cancellation token, which is cancelled if writing to the client fails
+  /** @param t cancellation token */
+  virtual void setCancellationToken( CancellationToken* t ){ token = t; };
 
   /// Write out a binary string
   /** @param msg message string
@@ -46,6 +117,23 @@ class Writer {
    */
   virtual int putStr( const char* msg, int len ) = 0;
 
+  /// Write out several blocks of data in order, such as an HTTP header followed by an image
+  /** Each block is written directly from its own memory without first being gathered
+      into a single buffer
+      @param blocks array of blocks
+      @param n number of blocks
+      @return total number of bytes written or -1 on error
+   */
+  virtual int putV( const Block* blocks, int n ){
+    int total = 0;
+    for( int i=0; i<n; i++ ){
+      int len = (int) blocks[i].length;
+      if( putStr( blocks[i].data, len ) != len ) return -1;
+      total += len;
+    }
+    return total;
+  };
+
   /// Write out a string using puts()
   /** @param msg message string
       @return number of bytes written
@@ -67,45 +155,22 @@ class Writer {
 
 
 /// FCGI Writer Class
-class FCGIWriter {
+class FCGIWriter : public Writer {
 
  private:
 
   /// FCGI stream output
   FCGX_Stream *out;
 
-  /// Buffer size
-  static const unsigned int bufsize = 65536;
-
-  /// Add the message to our buffer
-  /** @param msg message string
-      @param len message length in bytes
-   */
-  void cpy2buf( const char* msg, size_t len ){
-    if( sz+len > bufsize ) buffer = (char*) realloc( buffer, sz+len );
-    if( buffer ){
-      memcpy( &buffer[sz], msg, len );
-      sz += len;
-    }
-  };
-
 
  public:
 
-  char* buffer;        ///< Buffer
-  size_t sz;           ///< Size of buffer
-
   /// Constructor
   /** @param o FCGI stream pointer */
-  FCGIWriter( FCGX_Stream* o ){
+  FCGIWriter( FCGX_Stream* o ) {
     out = o;
-    buffer = (char*) malloc(bufsize);
-    sz = 0;
   };
 
-  /// Destructor
-  ~FCGIWriter(){ if(buffer) free(buffer); };
-
   /// Add the message to our buffer
   /** @param msg message string
       @param len message length in bytes
@@ -113,7 +178,9 @@ class FCGIWriter {
    */
   int putStr( const char* msg, int len ){
     cpy2buf( msg, len );
-    return FCGX_PutStr( msg, len, out );
+    int n = FCGX_PutStr( msg, len, out );
+    if( n != len ) return fail();
+    return n;
   };
 
   /// Write out a string using puts()
@@ -123,7 +190,7 @@ class FCGIWriter {
   int putS( const char* msg ){
     int len = (int) strlen( msg );
     cpy2buf( msg, len );
-    if( FCGX_PutStr( msg, len, out ) != len ) return -1;
+    if( FCGX_PutStr( msg, len, out ) != len ) return fail();
     return len;
   }
 
@@ -133,13 +200,16 @@ class FCGIWriter {
    */
   int printf( const char* msg ){
     cpy2buf( msg, strlen(msg) );
-    return FCGX_FPrintF( out, msg );
+    int n = FCGX_FPrintF( out, msg );
+    if( n == -1 ) return fail();
+    return n;
   };
 
   /// Flush the output buffer
   /** @return 0 = success, 1 = fail */
   int flush(){
-    return FCGX_FFlush( out );
+    if( FCGX_FFlush( out ) == -1 ) return fail();
+    return 0;
   };
 
 };
@@ -147,7 +217,7 @@ class FCGIWriter {
 
 
 /// File Writer Class
-class FileWriter {
+class FileWriter : public Writer {
 
  private:
 